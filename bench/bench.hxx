@@ -0,0 +1,69 @@
+/*!\file bench.hxx
+
+   \brief Minimal benchmark harness (header file)
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef CLAMFS_BENCH_HXX
+#define CLAMFS_BENCH_HXX
+
+#include <stdio.h>
+#include <time.h>
+
+namespace clamfs {
+
+/*!\brief Returns monotonic time in ns */
+static inline long long benchNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*!\brief Prevents compiler from optimizing out benchmarked value */
+template<typename T> static inline void benchKeep(const T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+/*!\brief Runs function repeatedly and prints result in one line
+   \param name benchmark name
+   \param iterations number of calls
+   \param func function (or functor) to call with iteration number
+
+   Output format is "name iterations total_ns ns_per_op" so it is
+   easy to parse with awk or compare between runs.
+*/
+template<typename F> static inline double benchRun(const char* name, long iterations, F func) {
+    for (long i = 0; i < iterations / 10; ++i) /* warm up */
+        func(i);
+    long long start = benchNow();
+    for (long i = 0; i < iterations; ++i)
+        func(i);
+    long long total = benchNow() - start;
+    double perOp = (double)total / (double)iterations;
+    printf("%-40s %10ld %14lld %10.1f\n", name, iterations, total, perOp);
+    return perOp;
+}
+
+} /* namespace clamfs */
+
+#endif /* CLAMFS_BENCH_HXX */
+
+/* EoF */
@@ -0,0 +1,122 @@
+/*!\file extacl_bench.cxx
+
+   \brief Extension ACL lookup benchmark
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "config.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "extacl.hxx"
+#include "bench.hxx"
+
+using namespace std;
+using namespace clamfs;
+
+/*!\brief Extensions from default clamfs.xml whitelist */
+static const char* whitelist[] = {
+    "dat", "dbx", "log", "nsf", "ntf", "pst", "tbb"
+};
+
+/*!\brief Extensions from default clamfs.xml blacklist */
+static const char* blacklist[] = {
+    "ade", "adp", "asx", "bas", "bat", "chm", "cmd", "com", "cpl", "crt",
+    "dll", "exe", "hlp", "hta", "inf", "ins", "isp", "jse", "js",  "lnk",
+    "mda", "mdz", "msc", "msi", "msp", "mst", "pcd", "pif", "reg", "scr",
+    "sct", "shs", "sys", "url", "vbe", "vbs", "vb",  "wsc", "wsf", "wsh"
+};
+
+/*!\brief File names used as lookup input */
+static const char* names[] = {
+    "/home/user/src/clamfs/src/clamfs.cxx",
+    "/home/user/Downloads/setup.exe",
+    "/var/log/syslog.log",
+    "/home/user/Documents/report.pdf",
+    "/usr/lib/x86_64-linux-gnu/libc.so.6",
+    "/home/user/.bashrc",
+    "/home/user/photos/IMG_0001.jpg",
+    "/srv/share/scripts/run.bat",
+    "/srv/share/data/archive.tar.gz",
+    "/home/user/Makefile"
+};
+
+/*!\brief Former lookup: last dot of path, std::string key, unordered_map */
+static acl_item mapLookup(const unordered_map<string, acl_item>& extensions, const char* path) {
+    const char *ext = rindex(path, '.');
+    if (ext != NULL) {
+        ++ext;
+        unordered_map<string, acl_item>::const_iterator it = extensions.find(ext);
+        if (it != extensions.end())
+            return it->second;
+    }
+    return none;
+}
+
+int main() {
+    unordered_map<string, acl_item> map;
+    ExtensionACL acl;
+
+    for (size_t i = 0; i < sizeof(whitelist) / sizeof(whitelist[0]); ++i) {
+        map[whitelist[i]] = whitelisted;
+        acl.addExtension(whitelist[i], whitelisted, false);
+    }
+    for (size_t i = 0; i < sizeof(blacklist) / sizeof(blacklist[0]); ++i) {
+        map[blacklist[i]] = blacklisted;
+        acl.addExtension(blacklist[i], blacklisted, false);
+    }
+    acl.compile();
+
+    const size_t count = sizeof(names) / sizeof(names[0]);
+    for (size_t i = 0; i < count; ++i) {
+        if (mapLookup(map, names[i]) != acl.match(names[i])) {
+            fprintf(stderr, "result mismatch for %s\n", names[i]);
+            return 1;
+        }
+    }
+
+    const long iterations = 5000000;
+    double before = benchRun("extacl/unordered_map", iterations, [&](long i) {
+        benchKeep(mapLookup(map, names[i % count]));
+    });
+    double after = benchRun("extacl/suffix_trie", iterations, [&](long i) {
+        benchKeep(acl.match(names[i % count]));
+    });
+
+    /* Same rules case insensitive, with multi-dot and file name rules */
+    ExtensionACL extended;
+    for (size_t i = 0; i < sizeof(blacklist) / sizeof(blacklist[0]); ++i)
+        extended.addExtension(blacklist[i], blacklisted, true);
+    extended.addExtension("tar.gz", whitelisted, true);
+    extended.addFilename("Makefile", whitelisted, false);
+    extended.compile();
+    benchRun("extacl/suffix_trie_ignorecase", iterations, [&](long i) {
+        benchKeep(extended.match(names[i % count]));
+    });
+
+    printf("speedup %.2fx\n", before / after);
+    return 0;
+}
+
+/* EoF */
@@ -0,0 +1,387 @@
+/*!\file fakeclamd.cxx
+
+   \brief Stand-in clamd for benchmarks
+
+   Speaks enough of clamd protocol (PING, VERSION, SCAN, FILDES,
+   INSTREAM, IDSESSION/END) over unix socket for ClamFS to use it.
+   Scan time and verdicts are configurable, so benchmark results do
+   not depend on signature database and clamd version.
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "config.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace std;
+
+/*!\enum fake_verdict
+   \brief Verdict returned by fake clamd
+*/
+enum fake_verdict {
+    verdict_marker = 0, /*!< FOUND if data contains marker, OK otherwise */
+    verdict_clean,      /*!< always OK */
+    verdict_infected,   /*!< always FOUND */
+    verdict_error       /*!< always ERROR */
+};
+
+/*!\brief Delay of every scan (in microseconds) */
+static long scanDelay = 0;
+/*!\brief Additional delay per MiB of scanned data (in microseconds) */
+static long mibDelay = 0;
+/*!\brief How verdicts are chosen */
+static fake_verdict verdict = verdict_marker;
+/*!\brief Data marking file as infected (for verdict_marker) */
+static string marker = "CLAMFS-FAKE-VIRUS";
+
+/*!\class Connection
+   \brief Single client connection
+*/
+class Connection {
+    public:
+        /*!\brief Constructor for Connection
+           \param socket connected client socket
+        */
+        explicit Connection(int socket): fd(socket), passedFd(-1), used(0), length(0),
+                                         found(false), tail(), scanned(0) { }
+        /*!\brief Destructor for Connection */
+        ~Connection() { if (passedFd >= 0) close(passedFd); close(fd); }
+
+        /*!\brief Serves commands until client disconnects */
+        void serve();
+
+    private:
+        /*!\brief Forbid usage of copy constructor */
+        Connection(const Connection& aConnection);
+        /*!\brief Forbid usage of assignment operator */
+        Connection& operator = (const Connection& aConnection);
+
+        bool fill();
+        bool readCommand(string& command, char& delimiter);
+        bool readExact(char* buf, size_t size);
+        bool receiveFd(int& passed);
+        void reply(const string& id, const string& text, char delimiter);
+        void scanData(const char* data, size_t size);
+        string verdictFor(const string& name);
+        string handle(const string& command);
+
+        /*!\brief client socket */
+        int fd;
+        /*!\brief descriptor received with data (for FILDES) */
+        int passedFd;
+        /*!\brief buffered input */
+        char buffer[65536];
+        /*!\brief bytes of buffer already consumed */
+        size_t used;
+        /*!\brief bytes of buffer filled */
+        size_t length;
+        /*!\brief marker found in scanned data */
+        bool found;
+        /*!\brief end of previous chunk (marker can span chunks) */
+        string tail;
+        /*!\brief bytes scanned in current request */
+        size_t scanned;
+};
+
+bool Connection::fill() {
+    struct iovec iov;
+    struct msghdr msg;
+    unsigned char control[CMSG_SPACE(sizeof(int))];
+
+    /* descriptor passed by FILDES comes as ancillary data of any byte */
+    iov.iov_base = buffer;
+    iov.iov_len = sizeof(buffer);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n = recvmsg(fd, &msg, 0);
+    if (n <= 0)
+        return false;
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+        if (passedFd >= 0)
+            close(passedFd);
+        memcpy(&passedFd, CMSG_DATA(cmsg), sizeof(int));
+    }
+    used = 0;
+    length = (size_t)n;
+    return true;
+}
+
+bool Connection::readExact(char* buf, size_t size) {
+    while (size > 0) {
+        if (used == length && !fill())
+            return false;
+        size_t take = (length - used < size) ? length - used : size;
+        memcpy(buf, buffer + used, take);
+        used += take;
+        buf += take;
+        size -= take;
+    }
+    return true;
+}
+
+bool Connection::readCommand(string& command, char& delimiter) {
+    char c;
+    command.clear();
+    if (!readExact(&c, 1))
+        return false;
+    if (c == 'n')
+        delimiter = '\n';
+    else if (c == 'z')
+        delimiter = '\0';
+    else {
+        delimiter = '\n';
+        command += c; /* legacy command without prefix */
+    }
+    while (readExact(&c, 1)) {
+        if (c == delimiter)
+            return true;
+        command += c;
+    }
+    return false;
+}
+
+bool Connection::receiveFd(int& passed) {
+    char dummy;
+    if (passedFd < 0 && !readExact(&dummy, 1))
+        return false;
+    if (passedFd < 0)
+        return false;
+    if (used < length && buffer[used] == '\0')
+        ++used; /* skip dummy byte carrying descriptor */
+    passed = passedFd;
+    passedFd = -1;
+    return true;
+}
+
+void Connection::reply(const string& id, const string& text, char delimiter) {
+    string out = id.empty() ? text : id + ": " + text;
+    out += delimiter;
+    const char* p = out.data();
+    size_t left = out.size();
+    while (left > 0) {
+        ssize_t n = send(fd, p, left, MSG_NOSIGNAL);
+        if (n <= 0)
+            return;
+        p += n;
+        left -= (size_t)n;
+    }
+}
+
+void Connection::scanData(const char* data, size_t size) {
+    scanned += size;
+    if (verdict != verdict_marker || found || marker.empty())
+        return;
+
+    /* marker may span chunks, so search end of previous chunk too */
+    string window = tail;
+    window.append(data, (size < marker.size()) ? size : marker.size());
+    if (window.find(marker) != string::npos ||
+        memmem(data, size, marker.data(), marker.size()) != NULL) {
+        found = true;
+        return;
+    }
+    size_t keep = marker.size() - 1;
+    if (size >= keep) {
+        tail.assign(data + size - keep, keep);
+    } else {
+        tail.append(data, size);
+        if (tail.size() > keep)
+            tail.erase(0, tail.size() - keep);
+    }
+}
+
+string Connection::verdictFor(const string& name) {
+    long delay = scanDelay + (long)((double)mibDelay * (double)scanned / 1048576.0);
+    if (delay > 0)
+        usleep((useconds_t)delay);
+
+    switch (verdict) {
+        case verdict_error:
+            return name + ": Fake error. ERROR";
+        case verdict_infected:
+            return name + ": Fake.Benchmark.Virus FOUND";
+        case verdict_clean:
+            return name + ": OK";
+        default:
+            return name + (found ? ": Fake.Benchmark.Virus FOUND" : ": OK");
+    }
+}
+
+string Connection::handle(const string& command) {
+    found = false;
+    scanned = 0;
+    tail.clear();
+
+    if (command == "PING")
+        return "PONG";
+    if (command == "VERSION")
+        return "ClamAV 0.0.0/fakeclamd";
+
+    if (command.compare(0, 5, "SCAN ") == 0) {
+        string name = command.substr(5);
+        int file = open(name.c_str(), O_RDONLY);
+        if (file < 0)
+            return name + ": lstat() failed: No such file or directory. ERROR";
+        char data[65536];
+        ssize_t n;
+        while ((n = read(file, data, sizeof(data))) > 0)
+            scanData(data, (size_t)n);
+        close(file);
+        return verdictFor(name);
+    }
+
+    if (command == "FILDES") {
+        int passed = -1;
+        if (!receiveFd(passed))
+            return "No file descriptor received. ERROR";
+        char data[65536];
+        ssize_t n;
+        off_t offset = 0;
+        while ((n = pread(passed, data, sizeof(data), offset)) > 0) {
+            scanData(data, (size_t)n);
+            offset += n;
+        }
+        close(passed);
+        return verdictFor("fd[" + to_string(passed) + "]");
+    }
+
+    if (command == "INSTREAM") {
+        uint32_t size;
+        char data[65536];
+        while (readExact((char*)&size, sizeof(size))) {
+            size = ntohl(size);
+            if (size == 0)
+                return verdictFor("stream");
+            while (size > 0) {
+                size_t take = (size < sizeof(data)) ? size : sizeof(data);
+                if (!readExact(data, take))
+                    return "";
+                scanData(data, take);
+                size -= (uint32_t)take;
+            }
+        }
+        return "";
+    }
+
+    return "UNKNOWN COMMAND";
+}
+
+void Connection::serve() {
+    string command;
+    char delimiter;
+    bool session = false;
+    unsigned long id = 0;
+
+    while (readCommand(command, delimiter)) {
+        if (command == "IDSESSION") {
+            session = true;
+            continue;
+        }
+        if (command == "END")
+            break;
+
+        string result = handle(command);
+        if (result.empty())
+            break; /* client disconnected in the middle of request */
+        reply(session ? to_string(++id) : string(), result, delimiter);
+        if (!session)
+            break; /* clamd closes connection after each command */
+    }
+}
+
+/*!\brief Prints usage and exits */
+static void usage(const char* name) {
+    fprintf(stderr,
+        "Usage: %s -s socket [-d delay_us] [-m delay_us_per_MiB]\n"
+        "          [-v marker|clean|infected|error] [-k marker]\n", name);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    const char* path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:d:m:v:k:")) != -1) {
+        switch (opt) {
+            case 's': path = optarg; break;
+            case 'd': scanDelay = atol(optarg); break;
+            case 'm': mibDelay = atol(optarg); break;
+            case 'k': marker = optarg; break;
+            case 'v':
+                if (strcmp(optarg, "marker") == 0) verdict = verdict_marker;
+                else if (strcmp(optarg, "clean") == 0) verdict = verdict_clean;
+                else if (strcmp(optarg, "infected") == 0) verdict = verdict_infected;
+                else if (strcmp(optarg, "error") == 0) verdict = verdict_error;
+                else usage(argv[0]);
+                break;
+            default: usage(argv[0]);
+        }
+    }
+    if (path == NULL || strlen(path) >= sizeof(((struct sockaddr_un*)0)->sun_path))
+        usage(argv[0]);
+
+    signal(SIGPIPE, SIG_IGN);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (listener < 0 ||
+        bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(listener, 128) < 0) {
+        perror("fakeclamd");
+        return EXIT_FAILURE;
+    }
+
+    while (true) {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("fakeclamd: accept");
+            return EXIT_FAILURE;
+        }
+        thread([client]() {
+            Connection connection(client);
+            connection.serve();
+        }).detach();
+    }
+}
+
+/* EoF */
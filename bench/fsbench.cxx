@@ -0,0 +1,401 @@
+/*!\file fsbench.cxx
+
+   \brief File system workload driver for mounted ClamFS benchmarks
+
+   Runs parallel open/read/stat workload against mounted file system
+   and prints throughput and latency percentiles as one line of
+   key=value pairs. Cache hit ratio is controlled by changing mtime
+   of backing file (in root directory, bypassing ClamFS) before open,
+   which makes cached verdict stale.
+
+   Sequential workloads (seqread, seqwrite) read or rewrite whole file
+   of each thread in blocks and report data throughput. Run them with
+   -B too, to get baseline of backing file system.
+
+   Lock workload takes and releases POSIX record lock (fcntl F_SETLKW,
+   like SQLite and Maildir do) on own file of each thread, one byte
+   range after another, so it measures lock round trip to ClamFS.
+   Before that it checks that locks of processes sharing one open file
+   (parent and child after fork()) still exclude each other and that
+   close() of the parent does not drop lock of the child.
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "config.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <signal.h>
+
+#include "bench.hxx"
+
+using namespace std;
+using namespace clamfs;
+
+/*!\enum workload
+   \brief Operation done by each benchmark iteration
+*/
+enum workload {
+    workload_open,    /*!< open() and close() */
+    workload_read,    /*!< open(), read() whole file and close() */
+    workload_stat,    /*!< stat() */
+    workload_seqread, /*!< read() own file sequentially in blocks */
+    workload_seqwrite, /*!< rewrite own file sequentially in blocks */
+    workload_lock     /*!< fcntl() lock and unlock byte of own file */
+};
+
+/*!\brief Options of benchmark run */
+struct Options {
+    string root;
+    string mountpoint;
+    workload work;
+    size_t fileSize;
+    unsigned int files;
+    unsigned int threads;
+    long operations;
+    double hitRatio;
+    size_t blockSize;
+    bool baseline;
+};
+
+/*!\brief Next mtime set on backing file to force cache miss */
+static atomic<long> nextMtime(1000000000L);
+
+/*!\brief Creates data set in backing root (skips existing files) */
+static int createFiles(const Options& opt, const string& dir) {
+    string path = opt.root + "/" + dir;
+    if (mkdir(path.c_str(), 0755) < 0 && errno != EEXIST) {
+        perror(path.c_str());
+        return -1;
+    }
+
+    vector<char> data(opt.fileSize);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = (char)('a' + i % 26);
+
+    for (unsigned int f = 0; f < opt.files; ++f) {
+        string name = path + "/" + to_string(f);
+        struct stat st;
+        if (stat(name.c_str(), &st) == 0 && (size_t)st.st_size == opt.fileSize)
+            continue;
+        int fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || write(fd, data.data(), data.size()) != (ssize_t)data.size()) {
+            perror(name.c_str());
+            return -1;
+        }
+        close(fd);
+    }
+    return 0;
+}
+
+/*!\brief Reads or rewrites whole file in blocks
+   \returns number of bytes transferred or -1 on error
+*/
+static long long sequential(const Options& opt, const string& path, vector<char>& buffer) {
+    bool writing = (opt.work == workload_seqwrite);
+    int fd = open(path.c_str(), writing ? (O_WRONLY | O_TRUNC) : O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    long long total = 0;
+    while (writing ? (total < (long long)opt.fileSize) : true) {
+        size_t size = buffer.size();
+        if (writing && (long long)size > (long long)opt.fileSize - total)
+            size = (size_t)((long long)opt.fileSize - total);
+        ssize_t n = writing ? write(fd, buffer.data(), size) : read(fd, buffer.data(), size);
+        if (n < 0) {
+            close(fd);
+            return -1;
+        }
+        if (n == 0)
+            break;
+        total += n;
+    }
+    /* data has to reach backing file system, not only page cache of FUSE */
+    if (writing && fsync(fd) < 0)
+        total = -1;
+    if (close(fd) < 0)
+        total = -1;
+    return total;
+}
+
+/*!\brief Locks and unlocks one byte of file
+   \returns 0 on success or -1 on error
+*/
+static int lockUnlock(int fd, off_t offset) {
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = offset;
+    lock.l_len = 1;
+    if (fcntl(fd, F_SETLKW, &lock) < 0)
+        return -1;
+    lock.l_type = F_UNLCK;
+    return (fcntl(fd, F_SETLK, &lock) < 0) ? -1 : 0;
+}
+
+/*!\brief Takes or tests write lock of first byte of file without waiting
+   \returns fcntl() result
+*/
+static int lockFirst(int fd, int cmd, short type, struct flock* lock) {
+    memset(lock, 0, sizeof(*lock));
+    lock->l_type = type;
+    lock->l_whence = SEEK_SET;
+    lock->l_len = 1;
+    return fcntl(fd, cmd, lock);
+}
+
+/*!\brief Checks that lock of child sharing open file excludes parent
+   \returns 0 on success or -1 if locks of both processes did not conflict
+*/
+static int forkSharing(const string& path) {
+    struct flock lock;
+    int toChild[2], toParent[2];
+    char result = 0;
+
+    int fd = open(path.c_str(), O_RDWR);
+    if (fd < 0) {
+        perror(path.c_str());
+        return -1;
+    }
+    if (pipe(toChild) < 0 || pipe(toParent) < 0) {
+        perror("pipe");
+        close(fd);
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        close(fd);
+        return -1;
+    }
+    if (pid == 0) {
+        /* child locks byte through inherited descriptor and holds it */
+        result = (lockFirst(fd, F_SETLK, F_WRLCK, &lock) == 0) ? 1 : 0;
+        if (write(toParent[1], &result, 1) != 1 || read(toChild[0], &result, 1) < 0)
+            _exit(EXIT_FAILURE);
+        _exit(EXIT_SUCCESS);
+    }
+
+    const char* failure = NULL;
+    if (read(toParent[0], &result, 1) != 1 || result != 1)
+        failure = "child could not lock file";
+    else if (lockFirst(fd, F_SETLK, F_WRLCK, &lock) == 0)
+        failure = "parent locked byte locked by child";
+    else if (lockFirst(fd, F_GETLK, F_WRLCK, &lock) < 0 || lock.l_type == F_UNLCK)
+        failure = "parent does not see lock of child";
+    else {
+        /* flush of parent must not drop lock of child */
+        close(dup(fd));
+        if (lockFirst(fd, F_SETLK, F_WRLCK, &lock) == 0)
+            failure = "close() of parent dropped lock of child";
+    }
+
+    if (write(toChild[1], &result, 1) != 1)
+        kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    if ((failure == NULL) && (lockFirst(fd, F_SETLK, F_WRLCK, &lock) < 0))
+        failure = "lock of exited child was not released";
+    close(toChild[0]);
+    close(toChild[1]);
+    close(toParent[0]);
+    close(toParent[1]);
+    close(fd);
+
+    if (failure != NULL) {
+        fprintf(stderr, "%s: fork sharing: %s\n", path.c_str(), failure);
+        return -1;
+    }
+    return 0;
+}
+
+/*!\brief Worker thread, stores latency of each operation in ns */
+static void worker(const Options& opt, const string& dir, unsigned int seed,
+                   vector<long long>& latencies, atomic<long>& errors,
+                   atomic<long long>& bytes) {
+    mt19937 random(seed);
+    uniform_int_distribution<unsigned int> pick(0, opt.files - 1);
+    uniform_real_distribution<double> chance(0.0, 1.0);
+    bool seq = (opt.work == workload_seqread) || (opt.work == workload_seqwrite);
+    vector<char> buffer(seq ? opt.blockSize : 131072, 'x');
+
+    /* lock workload keeps own file of thread open */
+    int lockfd = -1;
+    if (opt.work == workload_lock) {
+        string name = "/" + dir + "/" + to_string((seed - 1) % opt.files);
+        lockfd = open(((opt.baseline ? opt.root : opt.mountpoint) + name).c_str(), O_RDWR);
+        if (lockfd < 0) {
+            errors += opt.operations;
+            return;
+        }
+    }
+
+    latencies.reserve(opt.operations);
+    for (long i = 0; i < opt.operations; ++i) {
+        /* sequential workloads use one file per thread (seed is thread number) */
+        unsigned int file = seq ? (seed - 1) % opt.files : pick(random);
+        string name = "/" + dir + "/" + to_string(file);
+
+        if ((opt.work != workload_lock) && (chance(random) >= opt.hitRatio)) {
+            /* cache miss: change mtime behind ClamFS back */
+            struct timespec times[2];
+            times[0].tv_sec = times[1].tv_sec = nextMtime++;
+            times[0].tv_nsec = times[1].tv_nsec = 0;
+            utimensat(AT_FDCWD, (opt.root + name).c_str(), times, 0);
+        }
+
+        string path = (opt.baseline ? opt.root : opt.mountpoint) + name;
+        long long start = benchNow();
+        if (lockfd >= 0) {
+            if (lockUnlock(lockfd, (off_t)(i % 4096)) < 0)
+                ++errors;
+        } else if (seq) {
+            long long n = sequential(opt, path, buffer);
+            if (n < 0)
+                ++errors;
+            else
+                bytes += n;
+        } else if (opt.work == workload_stat) {
+            struct stat st;
+            if (stat(path.c_str(), &st) < 0)
+                ++errors;
+        } else {
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                ++errors;
+            } else {
+                if (opt.work == workload_read) {
+                    ssize_t n;
+                    while ((n = read(fd, buffer.data(), buffer.size())) > 0)
+                        bytes += n;
+                }
+                close(fd);
+            }
+        }
+        latencies.push_back(benchNow() - start);
+    }
+    if (lockfd >= 0)
+        close(lockfd);
+}
+
+/*!\brief Prints usage and exits */
+static void usage(const char* name) {
+    fprintf(stderr,
+        "Usage: %s -r root -m mountpoint [-w open|read|stat|seqread|seqwrite|lock]\n"
+        "          [-s file_size] [-f files] [-t threads] [-n operations_per_thread]\n"
+        "          [-c hit_ratio] [-b block_size] [-B]\n"
+        "  -B  run workload on root instead of mountpoint (baseline)\n", name);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    opt.work = workload_open;
+    opt.fileSize = 4096;
+    opt.files = 256;
+    opt.threads = 4;
+    opt.operations = 1000;
+    opt.hitRatio = 0.9;
+    opt.blockSize = 1048576;
+    opt.baseline = false;
+
+    const char* work = "open";
+    int c;
+    while ((c = getopt(argc, argv, "r:m:w:s:f:t:n:c:b:B")) != -1) {
+        switch (c) {
+            case 'r': opt.root = optarg; break;
+            case 'm': opt.mountpoint = optarg; break;
+            case 's': opt.fileSize = strtoul(optarg, NULL, 10); break;
+            case 'f': opt.files = (unsigned int)atoi(optarg); break;
+            case 't': opt.threads = (unsigned int)atoi(optarg); break;
+            case 'n': opt.operations = atol(optarg); break;
+            case 'c': opt.hitRatio = atof(optarg); break;
+            case 'b': opt.blockSize = strtoul(optarg, NULL, 10); break;
+            case 'B': opt.baseline = true; break;
+            case 'w':
+                work = optarg;
+                if (strcmp(optarg, "open") == 0) opt.work = workload_open;
+                else if (strcmp(optarg, "read") == 0) opt.work = workload_read;
+                else if (strcmp(optarg, "stat") == 0) opt.work = workload_stat;
+                else if (strcmp(optarg, "seqread") == 0) opt.work = workload_seqread;
+                else if (strcmp(optarg, "seqwrite") == 0) opt.work = workload_seqwrite;
+                else if (strcmp(optarg, "lock") == 0) opt.work = workload_lock;
+                else usage(argv[0]);
+                break;
+            default: usage(argv[0]);
+        }
+    }
+    if (opt.root.empty() || opt.mountpoint.empty() || opt.files == 0 ||
+        opt.threads == 0 || opt.operations <= 0 || opt.blockSize == 0)
+        usage(argv[0]);
+
+    string dir = "fsbench-" + to_string(opt.fileSize);
+    if (createFiles(opt, dir) < 0)
+        return EXIT_FAILURE;
+    if ((opt.work == workload_lock) &&
+        (forkSharing((opt.baseline ? opt.root : opt.mountpoint) + "/" + dir + "/0") < 0))
+        return EXIT_FAILURE;
+
+    vector< vector<long long> > latencies(opt.threads);
+    vector<thread> workers;
+    atomic<long> errors(0);
+    atomic<long long> bytes(0);
+
+    long long start = benchNow();
+    for (unsigned int t = 0; t < opt.threads; ++t)
+        workers.push_back(thread(worker, cref(opt), cref(dir), t + 1,
+                                 ref(latencies[t]), ref(errors), ref(bytes)));
+    for (unsigned int t = 0; t < opt.threads; ++t)
+        workers[t].join();
+    double seconds = (double)(benchNow() - start) / 1e9;
+
+    vector<long long> all;
+    for (unsigned int t = 0; t < opt.threads; ++t)
+        all.insert(all.end(), latencies[t].begin(), latencies[t].end());
+    sort(all.begin(), all.end());
+
+    #define PERCENTILE(p) ((double)all[(size_t)((double)(all.size() - 1) * (p))] / 1000.0)
+    printf("target=%s workload=%s size=%zu files=%u threads=%u hit_ratio=%.2f ops=%zu errors=%ld "
+           "seconds=%.3f ops_per_sec=%.1f mib_per_sec=%.1f p50_us=%.1f p90_us=%.1f p99_us=%.1f max_us=%.1f\n",
+           opt.baseline ? "backing" : "clamfs", work, opt.fileSize, opt.files, opt.threads,
+           opt.hitRatio, all.size(), errors.load(), seconds, (double)all.size() / seconds,
+           (double)bytes.load() / 1048576.0 / seconds,
+           PERCENTILE(0.50), PERCENTILE(0.90), PERCENTILE(0.99), (double)all.back() / 1000.0);
+    #undef PERCENTILE
+
+    return (errors == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* EoF */
@@ -0,0 +1,167 @@
+/*!\file hotpath_bench.cxx
+
+   \brief Benchmarks of small routines called on every file system operation
+
+   Covers config[] lookups, path fixing, caller name lookup and clamd
+   reply parsing. None of them needs FUSE or root (caller name is
+   looked up for current process, as fuse_get_context() is valid only
+   inside FUSE callbacks).
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "config.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "utils.hxx"
+#include "clamav.hxx"
+#include "bench.hxx"
+
+using namespace std;
+using namespace clamfs;
+
+/*!\brief Keys stored in config by default clamfs.xml */
+static const char* keys[] = {
+    "socket", "mode", "check", "root", "mountpoint", "public", "nonempty",
+    "entries", "expire", "maximal-size", "method", "filename", "verbose",
+    "atexit", "every", "mailto", "subject", "server", "from", "readonly",
+    "program", "sniff", "threads", "partial-head", "partial-tail"
+};
+
+/*!\brief Keys looked up in clamfs_open() (some are not set) */
+static const char* lookups[] = {
+    "maximal-size", "sniff", "partial-head", "partial-tail", "mode"
+};
+
+/*!\brief Paths as passed by FUSE */
+static const char* paths[] = {
+    "/",
+    "/README",
+    "/home/user/Documents/report.pdf",
+    "/usr/lib/x86_64-linux-gnu/libc.so.6",
+    "/srv/share/scripts/run.bat"
+};
+
+/*!\brief Replies of clamd to scan command */
+static const string replies[] = {
+    "/home/user/Documents/report.pdf: OK",
+    "/srv/share/scripts/run.bat: Eicar-Signature FOUND",
+    "stream: OK",
+    "/tmp/x: lstat() failed: No such file or directory. ERROR",
+    "/tmp/empty: Empty file",
+    "OK",
+    ""
+};
+
+/*!\brief Descriptor of root directory (like savefd in clamfs.cxx) */
+static int savefd;
+
+/*!\brief Copy of fixpath() from clamfs.cxx (without logging) */
+static const char* fixpath(const char* path) {
+    if (fchdir(savefd) < 0)
+        return NULL;
+    char* fixed = new char[strlen(path)+2];
+    strcpy(fixed,".");
+    strcat(fixed,path);
+    return fixed;
+}
+
+int main() {
+    const long iterations = 2000000;
+
+    /*
+     * config[] lookups
+     */
+    map<const char*, char*, ltstr> config;
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); ++i)
+        config[strdup(keys[i])] = strdup("yes");
+    const size_t lookupCount = sizeof(lookups) / sizeof(lookups[0]);
+    benchRun("config/find", iterations, [&](long i) {
+        benchKeep(config.find(lookups[i % lookupCount]));
+    });
+    benchRun("config/is_yes", iterations, [&](long i) {
+        const char* key = lookups[i % lookupCount];
+        map<const char*, char*, ltstr>::const_iterator it = config.find(key);
+        benchKeep((it != config.end()) && (strncmp(it->second, "yes", 3) == 0));
+    });
+
+    /*
+     * fixpath() compared with relative path for *at() calls
+     */
+    savefd = open("/", O_RDONLY | O_DIRECTORY);
+    if (savefd < 0) {
+        perror("/");
+        return 1;
+    }
+    const size_t pathCount = sizeof(paths) / sizeof(paths[0]);
+    benchRun("fixpath/fchdir_new", iterations, [&](long i) {
+        const char* fpath = fixpath(paths[i % pathCount]);
+        benchKeep(fpath);
+        delete[] fpath;
+    });
+    benchRun("fixpath/relative", iterations, [&](long i) {
+        const char* path = paths[i % pathCount];
+        benchKeep(path[1] == '\0' ? "." : path + 1);
+    });
+    struct stat st;
+    benchRun("fixpath/fchdir_new_lstat", iterations / 4, [&](long i) {
+        const char* fpath = fixpath(paths[i % pathCount]);
+        benchKeep(lstat(fpath, &st));
+        delete[] fpath;
+    });
+    benchRun("fixpath/fstatat", iterations / 4, [&](long i) {
+        const char* path = paths[i % pathCount];
+        benchKeep(fstatat(savefd, path[1] == '\0' ? "." : path + 1, &st, AT_SYMLINK_NOFOLLOW));
+    });
+    close(savefd);
+
+    /*
+     * getcallername() and getusername() lookups
+     */
+    char callername[CALLERNAME_MAX];
+    char username[USERNAME_MAX];
+    pid_t pid = getpid();
+    uid_t uid = getuid();
+    benchRun("callername/cached", iterations, [&](long) {
+        benchKeep(processNameCache.lookup(pid, callername, sizeof(callername)));
+    });
+    benchRun("username/cached", iterations, [&](long) {
+        benchKeep(userNameCache.lookup(uid, username, sizeof(username)));
+    });
+
+    /*
+     * clamd reply parsing
+     */
+    const size_t replyCount = sizeof(replies) / sizeof(replies[0]);
+    benchRun("clamd/parse_reply", iterations, [&](long i) {
+        benchKeep(ClamavParseReply(replies[i % replyCount]));
+    });
+
+    return 0;
+}
+
+/* EoF */
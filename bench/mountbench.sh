@@ -0,0 +1,124 @@
+#!/usr/bin/env bash
+#
+# Mounts ClamFS against fakeclamd and runs fsbench workloads on it.
+# Prints one line of key=value pairs per run (see fsbench.cxx).
+#
+# Tunables (environment):
+#   CLAMFS     - clamfs binary (default: ../src/clamfs)
+#   BENCHDIR   - directory with fakeclamd and fsbench (default: script dir)
+#   MODES      - clamd modes to test (default: "fdpass stream")
+#   WORKLOADS  - fsbench workloads (default: "open read stat")
+#   SIZES      - file sizes in bytes (default: "4096 1048576")
+#   HITS       - cache hit ratios (default: "0 0.9 1")
+#   THREADS    - worker threads (default: 4)
+#   OPS        - operations per thread (default: 500)
+#   DELAY      - fakeclamd delay per scan in us (default: 1000)
+#   MIB_DELAY  - fakeclamd delay per MiB scanned in us (default: 2000)
+#   SEQ_SIZES  - file sizes for seqread/seqwrite (default: 268435456)
+#   SEQ_OPS    - whole file passes per thread (default: 4)
+#   BLOCK      - read/write block size of seqread/seqwrite (default: 1048576)
+#   FUSE       - attributes of <fuse> element (default: empty, built-in defaults)
+#   LOCKS      - lock modes for lock workload (default: "ofd ulockmgr local")
+#   LOCK_OPS   - lock and unlock pairs per thread (default: 10000)
+#   TIMEOUT    - seconds to wait for fakeclamd and mount (default: 30)
+#
+# Sequential and lock workloads are run on backing root first
+# (target=backing), so ClamFS can be compared with underlying file system.
+#
+set -euo pipefail
+
+here=$(cd "$(dirname "$0")" && pwd)
+clamfs=${CLAMFS:-$here/../src/clamfs}
+bin=${BENCHDIR:-$here}
+tmp=$(mktemp -d "${TMPDIR:-/tmp}/clamfs-bench.XXXXXX")
+root=$tmp/root
+mnt=$tmp/mnt
+sock=$tmp/clamd.sock
+mkdir -p "$root" "$mnt"
+
+cleanup() {
+    fusermount3 -u "$mnt" 2>/dev/null || fusermount -u "$mnt" 2>/dev/null || true
+    [ -n "${fakepid:-}" ] && kill "$fakepid" 2>/dev/null || true
+    rm -rf "$tmp"
+}
+trap cleanup EXIT
+
+"$bin/fakeclamd" -s "$sock" -d "${DELAY:-1000}" -m "${MIB_DELAY:-2000}" -v clean &
+fakepid=$!
+
+# waitfor command... (fails after TIMEOUT or once fakeclamd is gone)
+waitfor() {
+    local tries=$(( ${TIMEOUT:-30} * 10 ))
+    while ! "$@"; do
+        if [ "$tries" -le 0 ] || ! kill -0 "$fakepid" 2>/dev/null; then
+            return 1
+        fi
+        tries=$((tries - 1))
+        sleep 0.1
+    done
+}
+
+if ! waitfor test -S "$sock"; then
+    echo "$0: fakeclamd did not start" >&2
+    exit 1
+fi
+
+# mountclamfs mode fuse_attributes log_name
+mountclamfs() {
+    cat > "$tmp/clamfs.xml" <<EOF
+<?xml version="1.0" encoding="UTF-8"?>
+<clamfs>
+    <clamd socket="$sock" mode="$1" check="yes" />
+    <filesystem root="$root" mountpoint="$mnt" public="no" />
+    <cache entries="65536" expire="10800000" />
+    <stats atexit="no" />
+    <fuse $2 />
+    <log method="file" filename="$tmp/clamfs-$3.log" verbose="no" />
+</clamfs>
+EOF
+    "$clamfs" "$tmp/clamfs.xml"
+    # clamfs daemonizes, so its exit is seen only as mount never showing up
+    if ! waitfor mountpoint -q "$mnt"; then
+        echo "$0: clamfs did not mount $mnt" >&2
+        cat "$tmp/clamfs-$3.log" >&2 2>/dev/null || true
+        exit 1
+    fi
+}
+
+for mode in ${MODES:-fdpass stream}; do
+    mountclamfs "$mode" "${FUSE:-}" "$mode"
+
+    for size in ${SIZES:-4096 1048576}; do
+        for work in ${WORKLOADS:-open read stat}; do
+            for hit in ${HITS:-0 0.9 1}; do
+                printf 'mode=%s ' "$mode"
+                "$bin/fsbench" -r "$root" -m "$mnt" -w "$work" -s "$size" \
+                    -t "${THREADS:-4}" -n "${OPS:-500}" -c "$hit"
+            done
+        done
+    done
+
+    for size in ${SEQ_SIZES:-268435456}; do
+        for work in seqwrite seqread; do
+            for target in -B ""; do
+                printf 'mode=%s ' "$mode"
+                "$bin/fsbench" -r "$root" -m "$mnt" -w "$work" -s "$size" $target \
+                    -b "${BLOCK:-1048576}" -t "${THREADS:-4}" -n "${SEQ_OPS:-4}" -c 1
+            done
+        done
+    done
+
+    fusermount3 -u "$mnt" 2>/dev/null || fusermount -u "$mnt"
+done
+
+for locks in ${LOCKS:-ofd ulockmgr local}; do
+    mountclamfs fdpass "${FUSE:-} locks=\"$locks\"" "locks-$locks"
+    for target in -B ""; do
+        printf 'locks=%s ' "$locks"
+        "$bin/fsbench" -r "$root" -m "$mnt" -w lock $target \
+            -t "${THREADS:-4}" -n "${LOCK_OPS:-10000}" -c 1
+    done
+    fusermount3 -u "$mnt" 2>/dev/null || fusermount -u "$mnt"
+done
+
+# EoF
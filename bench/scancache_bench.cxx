@@ -0,0 +1,97 @@
+/*!\file scancache_bench.cxx
+
+   \brief ScanCache lookup and insertion benchmark
+
+   Runs open() pattern of cache use (get, add on miss) from growing
+   number of threads, so lock contention of ScanCache is visible.
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "config.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "config.h"
+
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "scancache.hxx"
+#include "bench.hxx"
+
+using namespace std;
+using namespace clamfs;
+
+/*!\brief Number of distinct inodes looked up */
+static const ino_t inodes = 65536;
+/*!\brief Cache size (smaller than inodes, so some lookups miss) */
+static const unsigned long entries = 49152;
+/*!\brief Lookups done by each thread */
+static const long iterations = 500000;
+
+/*!\brief Worker thread, does the same as clamfs_open() does with cache */
+static void worker(ScanCache& cache, unsigned int seed) {
+    for (long i = 0; i < iterations; ++i) {
+        seed = seed * 1103515245 + 12345;
+        scan_key_t key = make_pair((dev_t)1, (ino_t)(seed >> 8) % inodes);
+        SharedPtr<CachedResult> ptr = cache.get(key);
+        if (ptr.isNull()) {
+            CachedResult result(true, (time_t)i);
+            cache.add(key, result);
+        } else {
+            benchKeep(ptr->isClean);
+        }
+    }
+}
+
+int main() {
+    unsigned int maxThreads = thread::hardware_concurrency();
+    if (maxThreads < 4)
+        maxThreads = 4;
+
+    for (unsigned int threads = 1; threads <= maxThreads; threads *= 2) {
+        ScanCache cache(entries, 3600000);
+        for (ino_t ino = 0; ino < entries; ++ino)
+            cache.add(make_pair((dev_t)1, ino), CachedResult(true, 0));
+
+        vector<thread> workers;
+        long long start = benchNow();
+        for (unsigned int t = 0; t < threads; ++t)
+            workers.push_back(thread(worker, ref(cache), t + 1));
+        for (unsigned int t = 0; t < threads; ++t)
+            workers[t].join();
+        long long total = benchNow() - start;
+
+        /* same format as benchRun(), ns_per_op is wall time per lookup */
+        char name[64];
+        long lookups = iterations * (long)threads;
+        snprintf(name, sizeof(name), "scancache/get_add/threads:%u", threads);
+        printf("%-40s %10ld %14lld %10.1f\n", name, lookups, total,
+               (double)total / (double)lookups);
+    }
+
+    return 0;
+}
+
+/* EoF */
@@ -0,0 +1,228 @@
+/*!\file asyncscan.cxx
+
+   \brief Background (allow-then-verify) scanning routines
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "asyncscan.hxx"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "stats.hxx"
+
+namespace clamfs {
+
+extern ScanCache* cache;
+
+ScanTicket::ScanTicket(const char* filePath, int scanFd, const struct stat& st,
+                       const vector<ScanRange>* scanRanges,
+                       const struct fuse_context* openContext):
+    path(filePath), fd(scanFd), size(st.st_size),
+    key(ScanCacheKey(st)), mtime(st.st_mtime),
+    partial(scanRanges != NULL), context(*openContext),
+    state(scan_pending), scanned(0) {
+    if (scanRanges != NULL)
+        ranges = *scanRanges;
+    context.fuse = NULL;
+    context.private_data = NULL;
+}
+
+ScanTicket::~ScanTicket() {
+    if (fd >= 0)
+        close(fd);
+}
+
+void ScanTicket::finish(int scanResult) {
+    Mutex::ScopedLock lock(mutex);
+    if (scanResult == 0)
+        state = scan_clean;
+    else if (scanResult == 1)
+        state = scan_infected;
+    else
+        state = scan_failed;
+    verdict.broadcast();
+}
+
+void ScanTicket::advance(off_t offset) {
+    Mutex::ScopedLock lock(mutex);
+    scanned = offset;
+    verdict.broadcast();
+}
+
+int ScanTicket::check(verify_reads mode, off_t end) {
+    Mutex::ScopedLock lock(mutex);
+    if (end > size)
+        end = size; /* data appended after open is covered by verdict only */
+    while (state == scan_pending) {
+        if (mode == reads_serve)
+            break;
+        /* end of file is held back until verdict, so whole file is never served unverified */
+        if (mode == reads_stream && end <= scanned && end < size)
+            break;
+        verdict.wait(mutex);
+    }
+    return (state == scan_pending || state == scan_clean) ? 0 : -EPERM;
+}
+
+AsyncScanner::AsyncScanner(verify_reads readsMode, unsigned int threadCount):
+    mode(readsMode), stopping(false) {
+    if (threadCount == 0)
+        threadCount = 1;
+    for (unsigned int i = 0; i < threadCount; ++i)
+        threads.push_back(new Thread("asyncscan"));
+}
+
+AsyncScanner::~AsyncScanner() {
+    stop();
+}
+
+void AsyncScanner::start() {
+    for (size_t i = 0; i < threads.size(); ++i)
+        threads[i]->start(*this);
+}
+
+void AsyncScanner::stop() {
+    deque<SharedPtr<ScanTicket> > pending;
+    {
+        Mutex::ScopedLock lock(mutex);
+        if (stopping)
+            return;
+        stopping = true;
+        pending.swap(queue);
+        queued.broadcast();
+    }
+    for (size_t i = 0; i < threads.size(); ++i)
+        if (threads[i]->isRunning())
+            threads[i]->join();
+
+    /* do not leave readers waiting for verdict that never comes */
+    for (size_t i = 0; i < pending.size(); ++i)
+        pending[i]->finish(-1);
+}
+
+bool AsyncScanner::submit(int handle, SharedPtr<ScanTicket> ticket) {
+    {
+        Mutex::ScopedLock lock(mutex);
+        if (stopping || queue.size() >= ASYNCSCAN_QUEUE_MAX)
+            return false;
+        queue.push_back(ticket);
+        queued.signal();
+    }
+
+    FastMutex::ScopedLock lock(handlesMutex);
+    handles[handle] = ticket;
+    ++attached;
+    return true;
+}
+
+int AsyncScanner::checkRead(int handle, off_t offset, size_t size) {
+    if (attached == 0)
+        return 0; /* no file opened in allow-then-verify mode */
+
+    SharedPtr<ScanTicket> ticket;
+    {
+        FastMutex::ScopedLock lock(handlesMutex);
+        map<int, SharedPtr<ScanTicket> >::iterator it = handles.find(handle);
+        if (it == handles.end())
+            return 0;
+        ticket = it->second;
+    }
+
+    return ticket->check(mode, offset + (off_t)size);
+}
+
+bool AsyncScanner::verifies(int handle) {
+    if (attached == 0)
+        return false;
+
+    FastMutex::ScopedLock lock(handlesMutex);
+    return handles.find(handle) != handles.end();
+}
+
+void AsyncScanner::release(int handle) {
+    if (attached == 0)
+        return;
+
+    FastMutex::ScopedLock lock(handlesMutex);
+    if (handles.erase(handle) > 0)
+        --attached;
+}
+
+void AsyncScanner::run() {
+    Mutex::ScopedLock lock(mutex);
+    while (true) {
+        while (queue.empty() && !stopping)
+            queued.wait(mutex);
+        if (stopping)
+            break;
+
+        SharedPtr<ScanTicket> ticket = queue.front();
+        queue.pop_front();
+
+        ScopedUnlock<Mutex> unlock(mutex);
+        scan(ticket);
+    }
+}
+
+void AsyncScanner::scan(SharedPtr<ScanTicket> ticket) {
+    Logger& logger = Logger::root();
+
+    int scanResult = ClamavScanFile(ticket->path.c_str(), ticket->fd, ticket->size,
+                                    ticket->partial ? &ticket->ranges : NULL,
+                                    &ticket->context,
+                                    (mode == reads_stream) ? ticket.get() : NULL);
+
+    /*
+     * Store verdict in cache, so next open() does not scan again
+     */
+    if (cache != NULL) {
+        if (scanResult == 0 || scanResult == 1) {
+            CachedResult result(scanResult == 0, ticket->mtime, ticket->partial);
+            cache->add(ticket->key, result);
+        } else {
+            cache->remove(ticket->key);
+        }
+    }
+
+    if (scanResult == 2) {
+        poco_debug_f1(logger, "%s: access kept although clamd is unavailable", ticket->path);
+        scanResult = 0;
+    } else if (scanResult == 1) {
+        INC_STAT_COUNTER(asyncRevoked);
+        poco_warning_f1(logger, "%s: access revoked after background scan found virus", ticket->path);
+    } else if (scanResult != 0) {
+        INC_STAT_COUNTER(scanFailed);
+        INC_STAT_COUNTER(asyncRevoked);
+        poco_warning_f1(logger, "%s: access revoked because background scan failed", ticket->path);
+    }
+
+    ticket->finish(scanResult);
+
+    /* descriptor is not needed any more */
+    Mutex::ScopedLock lock(ticket->mutex);
+    close(ticket->fd);
+    ticket->fd = -1;
+}
+
+} /* namespace clamfs */
+
+/* EoF */
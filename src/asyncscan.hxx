@@ -0,0 +1,261 @@
+/*!\file asyncscan.hxx
+
+   \brief Background (allow-then-verify) scanning routines (header file)
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef CLAMFS_ASYNCSCAN_HXX
+#define CLAMFS_ASYNCSCAN_HXX
+
+#include "config.h"
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <string>
+#include <sys/stat.h>
+#include <Poco/Mutex.h>
+#include <Poco/Condition.h>
+#include <Poco/ScopedUnlock.h>
+#include <Poco/Runnable.h>
+#include <Poco/Thread.h>
+#include <Poco/SharedPtr.h>
+#include <Poco/AtomicCounter.h>
+
+#ifdef DMALLOC
+   #include <stdlib.h>
+   #ifdef HAVE_MALLOC_H
+      #include <malloc.h>
+   #endif
+   #include <dmalloc.h>
+#endif
+
+#include "logger.hxx"
+#include "clamav.hxx"
+#include "scancache.hxx"
+
+/*!\def ASYNCSCAN_QUEUE_MAX
+   \brief Maximal number of files waiting for background scan
+
+   Files opened while queue is full are scanned synchronously.
+*/
+#define ASYNCSCAN_QUEUE_MAX 256
+
+/*!\def ASYNCSCAN_DEFAULT_THREADS
+   \brief Default number of background scanning threads
+*/
+#define ASYNCSCAN_DEFAULT_THREADS 4
+
+namespace clamfs {
+
+using namespace std;
+using namespace Poco;
+
+/*!\enum scan_state
+   \brief State of background scan
+*/
+enum scan_state {
+    scan_pending = 0, /*!< scan queued or in progress */
+    scan_clean,       /*!< no virus found */
+    scan_infected,    /*!< virus found, access revoked */
+    scan_failed       /*!< scan failed, access revoked */
+};
+
+/*!\enum verify_reads
+   \brief Handling of reads while background scan is pending
+*/
+enum verify_reads {
+    reads_serve = 0, /*!< serve reads at once */
+    reads_block,     /*!< block reads until verdict is known */
+    reads_stream     /*!< serve data already sent to clamd, block beyond it */
+};
+
+/*!\class ScanTicket
+   \brief Background scan of single opened file
+
+   Ticket is shared by file handle (to check verdict on read) and
+   scanning thread (to report verdict). It owns read only descriptor
+   used for scan, so handle can be released before scan completes.
+*/
+class ScanTicket: public ScanProgress {
+    public:
+        /*!\brief Constructor for ScanTicket
+           \param path file path in real filesystem tree
+           \param fd read only descriptor (owned by ticket)
+           \param st file stat (size, device, inode and mtime are used)
+           \param ranges ranges for partial scan or NULL
+           \param context process which opened file
+        */
+        ScanTicket(const char* path, int fd, const struct stat& st,
+                   const vector<ScanRange>* ranges,
+                   const struct fuse_context* context);
+        /*!\brief Destructor for ScanTicket */
+        virtual ~ScanTicket();
+
+        /*!\brief Stores verdict and wakes up waiting readers
+           \param scanResult result of ClamavScanFile() call
+        */
+        void finish(int scanResult);
+
+        /*!\brief Records data already sent to clamd and wakes up readers
+           \param offset end of file data already sent to clamd
+        */
+        virtual void advance(off_t offset);
+
+        /*!\brief Checks if file can be read
+           \param mode handling of reads while scan is pending
+           \param end end of requested data (for reads_stream mode)
+           \returns 0 if read is allowed, -EPERM otherwise
+        */
+        int check(verify_reads mode, off_t end);
+
+    private:
+        /*!\brief Forbid usage of copy constructor */
+        ScanTicket(const ScanTicket& aScanTicket);
+        /*!\brief Forbid usage of assignment operator */
+        ScanTicket& operator = (const ScanTicket& aScanTicket);
+
+        friend class AsyncScanner;
+
+        /*!\brief file path in real filesystem tree */
+        string path;
+        /*!\brief read only descriptor used for scan */
+        int fd;
+        /*!\brief file size */
+        off_t size;
+        /*!\brief file device and inode (scan cache key) */
+        scan_key_t key;
+        /*!\brief file modification time (scan cache timestamp) */
+        time_t mtime;
+        /*!\brief true for partial scan */
+        bool partial;
+        /*!\brief ranges for partial scan */
+        vector<ScanRange> ranges;
+        /*!\brief process which opened file */
+        struct fuse_context context;
+
+        /*!\brief protects state */
+        Mutex mutex;
+        /*!\brief signalled when verdict is known */
+        Condition verdict;
+        /*!\brief state of scan */
+        scan_state state;
+        /*!\brief end of file data already sent to clamd */
+        off_t scanned;
+};
+
+/*!\class AsyncScanner
+   \brief Background scanning threads for allow-then-verify mode
+
+   Files opened in allow-then-verify mode are returned to caller at
+   once and queued for scan. Queued files are scanned by bounded pool
+   of threads, so reads gated on scan of one file do not wait for
+   scans of files queued before it (unless all threads are busy). Reads of such handles are checked with
+   checkRead(), which either serves data while scan is pending, blocks
+   until verdict is known, or serves only data already streamed to
+   clamd (scan-ahead). Once virus is found every further read of handle
+   fails with EPERM.
+*/
+class AsyncScanner: public Runnable {
+    public:
+        /*!\brief Constructor for AsyncScanner
+           \param readsMode handling of reads while scan is pending
+           \param threadCount number of scanning threads
+        */
+        AsyncScanner(verify_reads readsMode, unsigned int threadCount);
+        /*!\brief Destructor for AsyncScanner */
+        virtual ~AsyncScanner();
+
+        /*!\brief Starts scanning threads */
+        void start();
+        /*!\brief Stops scanning threads (pending scans fail) */
+        void stop();
+
+        /*!\brief Attaches ticket to file handle and queues scan
+           \param handle file descriptor handed to FUSE
+           \param ticket scan to queue
+           \returns false if queue is full (file has to be scanned at once)
+        */
+        bool submit(int handle, SharedPtr<ScanTicket> ticket);
+
+        /*!\brief Checks if file handle can be read
+           \param handle file descriptor handed to FUSE
+           \param offset offset of requested data
+           \param size size of requested data
+           \returns 0 if read is allowed, -EPERM otherwise
+        */
+        int checkRead(int handle, off_t offset, size_t size);
+
+        /*!\brief Checks if reads of file handle wait for background scan
+           \param handle file descriptor handed to FUSE
+           \returns true if ticket is attached to handle
+        */
+        bool verifies(int handle);
+
+        /*!\brief Detaches ticket from file handle (call before close())
+           \param handle file descriptor handed to FUSE
+        */
+        void release(int handle);
+
+        /*!\brief Scanning threads main loop */
+        virtual void run();
+
+    private:
+        /*!\brief Forbid usage of copy constructor */
+        AsyncScanner(const AsyncScanner& aAsyncScanner);
+        /*!\brief Forbid usage of assignment operator */
+        AsyncScanner& operator = (const AsyncScanner& aAsyncScanner);
+
+        /*!\brief Scans file and stores verdict in ticket and cache
+           \param ticket scan to do
+        */
+        void scan(SharedPtr<ScanTicket> ticket);
+
+        /*!\brief handling of reads while scan is pending */
+        verify_reads mode;
+
+        /*!\brief protects handles */
+        FastMutex handlesMutex;
+        /*!\brief tickets attached to open file handles */
+        map<int, SharedPtr<ScanTicket> > handles;
+        /*!\brief number of attached tickets (fast path for reads) */
+        AtomicCounter attached;
+
+        /*!\brief protects queue and stopping */
+        Mutex mutex;
+        /*!\brief signalled when ticket is queued */
+        Condition queued;
+        /*!\brief tickets waiting for scan */
+        deque<SharedPtr<ScanTicket> > queue;
+        /*!\brief true when threads were requested to stop */
+        bool stopping;
+        /*!\brief scanning threads */
+        vector<SharedPtr<Thread> > threads;
+};
+
+/*!\brief extern to access scanner pointer from clamfs.cxx */
+extern AsyncScanner* scanner;
+
+} /* namespace clamfs */
+
+#endif /* CLAMFS_ASYNCSCAN_HXX */
+
+/* EoF */
@@ -0,0 +1,162 @@
+/*!\file breaker.cxx
+
+   \brief Clamd circuit breaker
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "breaker.hxx"
+
+#include <Poco/ScopedUnlock.h>
+#include <Poco/Timestamp.h>
+
+#include "logger.hxx"
+#include "clamav.hxx"
+#include "stats.hxx"
+
+namespace clamfs {
+
+ClamdBreaker::ClamdBreaker(const char* socket, unsigned int count, long probe, bool failOpen,
+                           long wait):
+    address(socket), threshold((count > 0) ? count : 1),
+    interval(((probe > 0) ? probe : 1) * 1000), allowUnscanned(failOpen),
+    patience((wait > 0) ? wait : 0), backoff(BREAKER_FIRST_PROBE),
+    failures(0), tripped(false), stopping(false), thread("clamdbreaker") {
+}
+
+ClamdBreaker::~ClamdBreaker() {
+    stop();
+}
+
+bool ClamdBreaker::allow() {
+    FastMutex::ScopedLock lock(mutex);
+    return !tripped;
+}
+
+bool ClamdBreaker::await() {
+    FastMutex::ScopedLock lock(mutex);
+    if (!tripped || (patience == 0))
+        return !tripped;
+
+    /*
+     * Give clamd (still starting or restarting) a chance to come back
+     */
+    INC_STAT_COUNTER(breakerWaited);
+    Timestamp started;
+    while (tripped && !stopping) {
+        long left = patience - (long)(started.elapsed() / 1000);
+        if ((left <= 0) || !recovered.tryWait(mutex, left))
+            break;
+    }
+    return !tripped;
+}
+
+void ClamdBreaker::trip() {
+    Logger& logger = Logger::root();
+
+    FastMutex::ScopedLock lock(mutex);
+    if (tripped)
+        return;
+    tripped = true;
+    backoff = 0; /* probe at once */
+    poco_information_f1(logger, "clamd not checked yet, files are %s without scan until it replies",
+        string(allowUnscanned ? "allowed" : "denied"));
+    wakeup.signal();
+}
+
+bool ClamdBreaker::failsOpen() const {
+    return allowUnscanned;
+}
+
+void ClamdBreaker::success() {
+    FastMutex::ScopedLock lock(mutex);
+    failures = 0;
+}
+
+void ClamdBreaker::failure() {
+    Logger& logger = Logger::root();
+
+    FastMutex::ScopedLock lock(mutex);
+    if (tripped || ++failures < threshold)
+        return;
+    tripped = true;
+    backoff = BREAKER_FIRST_PROBE;
+    poco_warning_f2(logger, "clamd failed %u times in a row, files are %s without scan until it is back",
+        failures, string(allowUnscanned ? "allowed" : "denied"));
+    wakeup.signal();
+}
+
+void ClamdBreaker::start() {
+    thread.start(*this);
+}
+
+void ClamdBreaker::stop() {
+    {
+        FastMutex::ScopedLock lock(mutex);
+        if (stopping)
+            return;
+        stopping = true;
+        wakeup.broadcast();
+        recovered.broadcast();
+    }
+    if (thread.isRunning())
+        thread.join();
+}
+
+void ClamdBreaker::run() {
+    Logger& logger = Logger::root();
+
+    FastMutex::ScopedLock lock(mutex);
+    while (!stopping) {
+        if (!tripped) {
+            wakeup.wait(mutex);
+            continue;
+        }
+        if (backoff > 0)
+            wakeup.tryWait(mutex, backoff);
+        if (stopping)
+            break;
+
+        /*
+         * Probe clamd (connection is not used by scans)
+         */
+        bool available;
+        {
+            ScopedUnlock<FastMutex> unlock(mutex);
+            available = (OpenClamav(address.c_str()) == 0) && (PingClamav() == 0);
+            CloseClamav();
+        }
+        if (available) {
+            tripped = false;
+            failures = 0;
+            recovered.broadcast();
+            poco_information(logger, "clamd is available, files are scanned as usual");
+        } else {
+            /* clamd loading signatures is probed often, dead one rarely */
+            backoff = (backoff > 0) ? backoff * 2 : BREAKER_FIRST_PROBE;
+            if (backoff > interval)
+                backoff = interval;
+        }
+    }
+}
+
+} /* namespace clamfs */
+
+/* EoF */
@@ -0,0 +1,159 @@
+/*!\file breaker.hxx
+
+   \brief Clamd circuit breaker (header file)
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef CLAMFS_BREAKER_HXX
+#define CLAMFS_BREAKER_HXX
+
+#include "config.h"
+
+#include <string>
+#include <Poco/Mutex.h>
+#include <Poco/Condition.h>
+#include <Poco/Runnable.h>
+#include <Poco/Thread.h>
+
+#ifdef DMALLOC
+   #include <stdlib.h>
+   #ifdef HAVE_MALLOC_H
+      #include <malloc.h>
+   #endif
+   #include <dmalloc.h>
+#endif
+
+/*!\def BREAKER_DEFAULT_FAILURES
+   \brief Default number of failed scans in a row opening circuit breaker
+*/
+#define BREAKER_DEFAULT_FAILURES 5
+
+/*!\def BREAKER_DEFAULT_PROBE
+   \brief Default interval between clamd availability probes (in seconds)
+*/
+#define BREAKER_DEFAULT_PROBE 5
+
+/*!\def BREAKER_FIRST_PROBE
+   \brief Delay of first probe after breaker opened (in ms), doubled
+          after each failed probe up to probe interval
+*/
+#define BREAKER_FIRST_PROBE 250
+
+namespace clamfs {
+
+using namespace std;
+using namespace Poco;
+
+/*!\class ClamdBreaker
+   \brief Stops sending scans to clamd after sustained failures
+
+   Breaker opens after given number of scans failed in a row (clamd
+   unreachable or not replying in time). While it is open no scan is
+   sent to clamd and files are allowed or denied by configured policy
+   at once, instead of each open waiting for its own timeout. Separate
+   thread probes clamd with PING (with exponential backoff) and closes
+   breaker when it replies. Breaker may also be opened before first
+   scan, so file system is mounted before clamd is up.
+*/
+class ClamdBreaker: public Runnable {
+    public:
+        /*!\brief Constructor for ClamdBreaker
+           \param socket clamd socket probed while breaker is open
+           \param failures number of failed scans in a row opening breaker
+           \param probe interval between probes in seconds
+           \param failOpen true if files are allowed while breaker is open
+           \param wait time scan waits for clamd while breaker is open (in ms)
+        */
+        ClamdBreaker(const char* socket, unsigned int failures, long probe, bool failOpen,
+                     long wait = 0);
+        /*!\brief Destructor for ClamdBreaker */
+        virtual ~ClamdBreaker();
+
+        /*!\brief Checks if scan may be sent to clamd
+           \returns true if breaker is closed
+        */
+        bool allow();
+        /*!\brief Checks if scan may be sent to clamd, waits for clamd
+                  (up to configured time) if breaker is open
+           \returns true if breaker is closed
+        */
+        bool await();
+        /*!\brief Opens breaker until clamd replies to probe (used when
+                  clamd was not checked on startup)
+        */
+        void trip();
+        /*!\brief Returns true if files are allowed while breaker is open */
+        bool failsOpen() const;
+        /*!\brief Records scan which got clamd reply */
+        void success();
+        /*!\brief Records scan which failed to get clamd reply */
+        void failure();
+
+        /*!\brief Starts probe thread */
+        void start();
+        /*!\brief Stops probe thread */
+        void stop();
+        /*!\brief Probe thread main loop */
+        virtual void run();
+
+    private:
+        /*!\brief Forbid usage of copy constructor */
+        ClamdBreaker(const ClamdBreaker& aBreaker);
+        /*!\brief Forbid usage of assignment operator */
+        ClamdBreaker& operator = (const ClamdBreaker& aBreaker);
+
+        /*!\brief clamd socket */
+        string address;
+        /*!\brief number of failed scans in a row opening breaker */
+        unsigned int threshold;
+        /*!\brief interval between probes in ms */
+        long interval;
+        /*!\brief true if files are allowed while breaker is open */
+        bool allowUnscanned;
+        /*!\brief time scan waits for clamd while breaker is open (in ms) */
+        long patience;
+
+        /*!\brief protects state below */
+        FastMutex mutex;
+        /*!\brief signalled when breaker opens or thread is stopped */
+        Condition wakeup;
+        /*!\brief broadcast when breaker closes */
+        Condition recovered;
+        /*!\brief delay of next probe (in ms) */
+        long backoff;
+        /*!\brief number of failed scans in a row */
+        unsigned int failures;
+        /*!\brief true if breaker is open */
+        bool tripped;
+        /*!\brief stop request flag */
+        bool stopping;
+        /*!\brief probe thread */
+        Thread thread;
+};
+
+/*!\brief extern to access breaker pointer (NULL if breaker is disabled) */
+extern ClamdBreaker* breaker;
+
+} /* namespace clamfs */
+
+#endif /* CLAMFS_BREAKER_HXX */
+
+/* EoF */
@@ -23,6 +23,10 @@
 */
 
 #include "clamav.hxx"
+#include "clamengine.hxx"
+#include "clamdclient.hxx"
+#include "breaker.hxx"
+#include "stats.hxx"
 
 /* must be first because it may define _XOPEN_SOURCE */
 #include "fdpassing.h"
@@ -30,14 +34,10 @@
 #include "Poco/Net/SocketAddress.h"
 #include "Poco/Net/StreamSocket.h"
 #include "Poco/Net/SocketStream.h"
-#include "Poco/StreamCopier.h"
-#include "Poco/FileStream.h"
-#include "Poco/File.h"
 
 namespace clamfs {
 
 extern config_t config;
-extern FastMutex scanMutex;
 
 /*!\def CHECK_CLAMD
    \brief Check if we are connected to clamd
@@ -55,19 +55,8 @@ extern FastMutex scanMutex;
     }\
 } while(0)
 
-#ifdef HAVE_FD_PASSING
-class ClamFStreamSocket: public StreamSocket {
-    public:
-        ssize_t sendFd(struct msghdr* msg) {
-            return sendmsg(sockfd(), msg, 0);
-        }
-};
-/*!\brief Custom stream socket used to communicate with clamd */
-ClamFStreamSocket clamdSocket;
-#else
-/*!\brief POCO stream socket used to communicate with clamd */
+/*!\brief POCO stream socket used to check clamd availability */
 StreamSocket clamdSocket;
-#endif
 
 /*!\brief Opens connection to clamd through unix socket
    \param unixSocket name of unix socket
@@ -77,9 +66,22 @@ int OpenClamav(const char *unixSocket) {
     SocketAddress sa(unixSocket);
     Logger& logger = Logger::root();
 
+    long connectTimeout = (config["connect-timeout"] != NULL) ?
+        atol(config["connect-timeout"]) : CLAMD_DEFAULT_CONNECT_TIMEOUT;
+    long replyTimeout = (config["reply-timeout"] != NULL) ?
+        atol(config["reply-timeout"]) : CLAMD_DEFAULT_REPLY_TIMEOUT;
+
     poco_debug_f1(logger, "attempt to open connection to clamd via %s", string(unixSocket));
     try {
-       clamdSocket.connect(sa);
+       if (connectTimeout > 0)
+           clamdSocket.connect(sa, (Timestamp::TimeDiff)connectTimeout * 1000);
+       else
+           clamdSocket.connect(sa);
+       /* do not wait forever for wedged clamd */
+       if (replyTimeout > 0) {
+           clamdSocket.setReceiveTimeout((Timestamp::TimeDiff)replyTimeout * 1000);
+           clamdSocket.setSendTimeout((Timestamp::TimeDiff)replyTimeout * 1000);
+       }
     } catch (Exception &exc) {
        /* Ignore 'Socket is already connected' exception */
        if (exc.code() != EISCONN) {
@@ -115,6 +117,27 @@ int PingClamav() {
     return 0;
 }
 
+/*!\brief Query clamd version with VERSION command
+   \param version reply ("ClamAV <engine>/<signatures>/<date>")
+   \returns 0 on success and -1 on failure
+*/
+int VersionClamav(string& version) {
+    Logger& logger = Logger::root();
+
+    SocketStream clamd(clamdSocket);
+    CHECK_CLAMD(clamd);
+    clamd << "nVERSION" << endl;
+    getline(clamd, version);
+
+    if (version.compare(0, 7, "ClamAV ") != 0) {
+        poco_warning_f1(logger, "invalid reply for VERSION received: %s", version);
+        return -1;
+    }
+
+    poco_debug_f1(logger, "clamd version is %s", version);
+    return 0;
+}
+
 /*!\brief Close clamd connection
 */
 void CloseClamav() {
@@ -124,76 +147,76 @@ void CloseClamav() {
     clamdSocket.close();
 }
 
-#ifdef HAVE_FD_PASSING
-/*!\brief Send file descriptor over clamd connection
-   \param fd file descriptor to pass to clamd
- */
-static void SendFileDescriptorForFile(const int fd) {
-    struct iovec iov[1];
-    struct msghdr msg;
-    struct cmsghdr *cmsg;
-    unsigned char fdbuf[CMSG_SPACE(sizeof(int))];
-    char dummy[]   = "";
-
-    iov[0].iov_base = dummy;
-    iov[0].iov_len  = 1;
-
-    memset(&msg, 0, sizeof(msg));
-    msg.msg_control    = fdbuf;
-    msg.msg_iov        = iov;
-    msg.msg_iovlen     = 1;
-    msg.msg_controllen = CMSG_LEN(sizeof(int));
-    cmsg               = CMSG_FIRSTHDR(&msg);
-    cmsg->cmsg_len     = CMSG_LEN(sizeof(int));
-    cmsg->cmsg_level   = SOL_SOCKET;
-    cmsg->cmsg_type    = SCM_RIGHTS;
-    memcpy(CMSG_DATA(cmsg), &fd, sizeof(fd));
-
-    clamdSocket.sendFd(&msg);
+void PartialScanRanges(const off_t size, const off_t head, const off_t tail,
+                       const unsigned int samples, const off_t sampleSize,
+                       vector<ScanRange>& ranges) {
+    ScanRange range;
+    off_t headEnd = (head < size) ? head : size;
+    off_t tailStart = (tail < size - headEnd) ? size - tail : headEnd;
+
+    ranges.clear();
+    if (headEnd > 0) {
+        range.offset = 0;
+        range.length = headEnd;
+        ranges.push_back(range);
+    }
+
+    /* samples spread evenly over the gap between head and tail */
+    off_t gap = tailStart - headEnd;
+    if ((samples > 0) && (sampleSize > 0) && (gap > 0)) {
+        off_t step = gap / (off_t)(samples + 1);
+        off_t last = headEnd;
+        for (unsigned int i = 1; i <= samples; ++i) {
+            off_t offset = headEnd + step * i - sampleSize / 2;
+            if (offset < last)
+                offset = last;
+            off_t length = sampleSize;
+            if (offset + length > tailStart)
+                length = tailStart - offset;
+            if (length <= 0)
+                break;
+            range.offset = offset;
+            range.length = length;
+            ranges.push_back(range);
+            last = offset + length;
+        }
+    }
+
+    if (tailStart < size) {
+        range.offset = tailStart;
+        range.length = size - tailStart;
+        ranges.push_back(range);
+    }
 }
-#endif
 
-/*!\brief Request anti-virus scanning on file
-   \param filename name of file to scan
-   \returns -1 one error when opening clamd connection,
-             0 if no virus found and
-             1 if virus was found (or clamd error occurred)
+/*!\brief Scan open file with clamd
+   \param filename name of file to scan (used by SCAN command and in logs)
+   \param fd readable file descriptor of file to scan
+   \param size size of file
+   \param ranges file ranges to scan (always INSTREAM) or NULL to scan whole file
+   \param progress receives progress of scan (forces INSTREAM) or NULL
+   \param reply clamd reply
+   \returns 0 if reply was received and -1 on error
  */
-int ClamavScanFile(const char *filename) {
-    string reply;
+static int ClamdScan(const char *filename, const int fd, const off_t size,
+                     const vector<ScanRange>* ranges, ScanProgress* progress,
+                     string& reply) {
     Logger& logger = Logger::root();
+    clamd_command command;
 
-    poco_debug_f1(logger, "attempt to scan file %s", string(filename));
-
-    /*
-     * Enqueue requests
-     */
-    FastMutex::ScopedLock lock(scanMutex);
-
-    /*
-     * Open clamd socket
-     */
-    poco_debug_f1(logger, "started scanning file %s", string(filename));
-    OpenClamav(config["socket"]);
-    SocketStream clamd(clamdSocket);
-    if (!clamd)
-        return -1;
-
-    if ((config["mode"] != NULL) &&
-        strncmp(config["mode"], "fdpass", 6) == 0) {
+    if ((ranges != NULL) || (progress != NULL)) {
+        /*
+         * Scan selected ranges of file (or whole file, reporting
+         * progress) using INSTREAM command
+         */
+        command = command_instream;
+    } else if ((config["mode"] != NULL) &&
+               strncmp(config["mode"], "fdpass", 6) == 0) {
 #ifdef HAVE_FD_PASSING
         /*
          * Scan file using FILDES command
          */
-        int fd = open(filename, O_RDONLY);
-        if (fd >= 0) {
-            clamd << "nFILDES"<< endl << flush;
-            SendFileDescriptorForFile(fd);
-            close(fd);
-        } else {
-            poco_warning_f1(logger, "Unable to pass fd for file '%s'", string(filename));
-            return -1;
-        }
+        command = command_fildes;
 #else
         poco_warning(logger, "Scan command FILDES not available due to lack of fd passing.");
         return -1;
@@ -203,85 +226,131 @@ int ClamavScanFile(const char *filename) {
         /*
          * Scan file using INSTREAM command
          */
-        FileInputStream istr(filename, std::ios::binary);
-        if (istr.good()) {
-            std::string chunkSizeStr;
-            File f(filename);
-            size_t chunkSize = htonl(f.getSize());
-
-            chunkSizeStr.assign((const char*)&chunkSize, 4);
-            clamd << "nINSTREAM" << endl;
-            clamd << chunkSizeStr;
-            StreamCopier::copyStream(istr, clamd);
-            chunkSizeStr.assign("\0\0\0\0", 4);
-            clamd << chunkSizeStr << flush;
-        } else {
-            poco_warning_f1(logger, "Unable to pass stream for file '%s'", string(filename));
-            return -1;
-        }
+        command = command_instream;
     } else {
         /*
          * Scan file using SCAN command
          */
-        clamd << "nSCAN " << filename << endl;
+        command = command_scan;
+    }
+
+    if ((command != command_scan) && (fd < 0)) {
+        poco_warning_f1(logger, "Unable to pass fd or stream for file '%s'", string(filename));
+        return -1;
     }
 
+    vector<ScanRange> whole(1);
+    whole[0].offset = 0;
+    whole[0].length = size;
+
     /*
-     * Receive results and close stream
+     * Queue request to clamd client and wait for reply
      */
-    getline(clamd, reply);
-    CloseClamav();
+    poco_debug_f1(logger, "started scanning file %s", string(filename));
+    ClamdRequest request(command, filename, fd, (ranges != NULL) ? *ranges : whole, progress);
+    if (client->scan(request) != 0) {
+        poco_warning_f1(logger, "Unable to get clamd reply for file '%s'", string(filename));
+        if (breaker != NULL)
+            breaker->failure();
+        return -1;
+    }
+    reply = request.reply();
+    if (breaker != NULL)
+        breaker->success();
+
+    return 0;
+}
+
+/*!\brief Request anti-virus scanning on open file
+   \param filename name of file to scan (used by SCAN command and in logs)
+   \param fd readable file descriptor of file to scan
+   \param size size of file (from fstat() done by caller)
+   \param ranges file ranges to scan (partial scan, always INSTREAM)
+                 or NULL to scan whole file
+   \param context process which opened file (if scan is not done
+                  in FUSE thread) or NULL
+   \param progress receives progress of scan (forces INSTREAM) or NULL
+   \returns -1 one error when opening clamd connection,
+             0 if no virus found,
+             1 if virus was found (or clamd error occurred) and
+             2 if file was not scanned because clamd is unavailable,
+               but policy allows such files
+ */
+int ClamavScanFile(const char *filename, const int fd, const off_t size,
+                   const vector<ScanRange>* ranges, const struct fuse_context* context,
+                   ScanProgress* progress) {
+    string reply;
+    clamd_reply result;
+    Logger& logger = Logger::root();
+
+    poco_debug_f1(logger, "attempt to scan file %s", string(filename));
+
+#ifdef HAVE_LIBCLAMAV
+    if (engine != NULL) {
+        /*
+         * Scan file in process with libclamav
+         */
+        result = engine->scan(filename, fd, size, ranges, progress, reply);
+    } else
+#endif
+    {
+        /*
+         * Do not wait for clamd known to be unavailable
+         */
+        if ((breaker != NULL) && !breaker->await()) {
+            INC_STAT_COUNTER(breakerSkipped);
+            poco_debug_f1(logger, "clamd unavailable, file %s not scanned", string(filename));
+            return breaker->failsOpen() ? 2 : -1;
+        }
+        if (ClamdScan(filename, fd, size, ranges, progress, reply) != 0)
+            return -1;
+        poco_debug_f2(logger, "clamd reply for file '%s' is: '%s'", string(filename), reply);
+        result = ClamavParseReply(reply);
+    }
 
     /*
      * Check for scan results, return if file is clean
      */
-    poco_debug_f2(logger, "clamd reply for file '%s' is: '%s'", string(filename), reply);
-    if (strncmp(reply.c_str() + reply.size() - 2,  "OK", 2) == 0 ||
-        strncmp(reply.c_str() + reply.size() - 10, "Empty file", 10) == 0 ||
-        strncmp(reply.c_str() + reply.size() - 8,  "Excluded", 8) == 0 ||
-        strncmp(reply.c_str() + reply.size() - 29, "Excluded (another filesystem)", 29) == 0 ) {
+    if (result == reply_clean)
         return 0;
-    }
 
     /*
      * Log result through Logger (if virus is found or scan failed)
      */
-    char* username = getusername();
-    char* callername = getcallername();
-    poco_warning_f(logger, "(%s:%d) (%s:%u) '%s': %s", string(callername), fuse_get_context()->pid,
-        string(username), fuse_get_context()->uid, string(filename),
+    if (context == NULL)
+        context = fuse_get_context();
+    char username[USERNAME_MAX];
+    char callername[CALLERNAME_MAX];
+    userNameCache.lookup(context->uid, username, sizeof(username));
+    processNameCache.lookup(context->pid, callername, sizeof(callername));
+    poco_warning_f(logger, "(%s:%d) (%s:%u) '%s': %s", string(callername), context->pid,
+        string(username), context->uid, string(filename),
         reply.empty() ? "< empty clamd reply >" : reply);
-    free(username);
-    free(callername);
 
     /*
-     * If reply was empty or no reply was received
-     * return without any interpretation of reply
+     * If scan failed (or no reply was received) return without
+     * sending e-mail alert
      */
-    if (reply.empty())
-       return -1;
-
-    /*
-     * If scan failed return without sending e-mail alert
-     */
-    if (strncmp(reply.c_str() + reply.size() - 20, "Access denied. ERROR", 20) == 0 ||
-       strncmp(reply.c_str() + reply.size() - 21, "lstat() failed. ERROR", 21) == 0 ||
-       strncmp(reply.c_str() + reply.size() - 40, "lstat() failed: Permission denied. ERROR", 40) == 0 ||
-       strncmp(reply.c_str() + reply.size() - 48, "lstat() failed: No such file or directory. ERROR", 48) == 0 ||
-       strncmp(reply.c_str() + reply.size() - 34, "No file descriptor received. ERROR", 34) == 0 ||
-       strncmp(reply.c_str() + reply.size() - 35, "INSTREAM size limit exceeded. ERROR", 35) == 0) {
+    if (result == reply_failed)
         return -1;
-    }
 
-    if (strncmp(reply.c_str() + reply.size() - 5, "FOUND", 5) != 0) {
+    if (result == reply_unknown) {
        poco_warning(logger, "Response not ending with 'FOUND' was received and left uninterpreted!");
     }
 
     /*
-     * Send mail notification
+     * Queue mail notification (SMTP session is handled by
+     * MailNotifier thread, so scan is not held up by it)
      */
-    SendMailNotification(config["server"], config["to"],
-             config["from"], config["subject"], reply.c_str());
+    if (notifier) {
+        MailAlert alert;
+        alert.callername = callername;
+        alert.pid = context->pid;
+        alert.username = username;
+        alert.uid = context->uid;
+        alert.scanresult = reply;
+        notifier->enqueue(alert);
+    }
 
     return 1;
 }
@@ -27,7 +27,10 @@
 
 #include "config.h"
 
+#include <cstdlib>
 #include <cstring>
+#include <vector>
+#include <sys/types.h>
 #include <Poco/Mutex.h>
 #include <Poco/ScopedLock.h>
 
@@ -42,6 +45,31 @@
 #include "config.hxx"
 #include "mnotify.hxx"
 
+/*!\def CLAMD_CHUNK_SIZE
+   \brief Size of chunk sent to clamd by INSTREAM command
+*/
+#define CLAMD_CHUNK_SIZE 65536
+
+/*!\def CLAMD_DEFAULT_CONNECT_TIMEOUT
+   \brief Default time to connect to clamd (in ms)
+*/
+#define CLAMD_DEFAULT_CONNECT_TIMEOUT 5000
+
+/*!\def CLAMD_DEFAULT_SEND_TIMEOUT
+   \brief Default time clamd may not accept any data sent to it (in ms)
+*/
+#define CLAMD_DEFAULT_SEND_TIMEOUT 30000
+
+/*!\def CLAMD_DEFAULT_REPLY_TIMEOUT
+   \brief Default time to wait for clamd reply once file was sent (in ms)
+*/
+#define CLAMD_DEFAULT_REPLY_TIMEOUT 60000
+
+/*!\def CLAMD_DEFAULT_REPLY_PER_MIB
+   \brief Default extra time to wait for reply per MiB of file (in ms)
+*/
+#define CLAMD_DEFAULT_REPLY_PER_MIB 1000
+
 namespace clamfs {
 
 using namespace std;
@@ -50,8 +78,107 @@ using namespace Poco::Net;
 
 int OpenClamav(const char *unixSocket);
 int PingClamav();
+int VersionClamav(string& version);
 void CloseClamav();
-int ClamavScanFile(const char *filename);
+/*!\struct ScanRange
+   \brief Range of file sent to clamd by partial scan
+*/
+struct ScanRange {
+    /*!\brief offset of range in file */
+    off_t offset;
+    /*!\brief length of range */
+    off_t length;
+};
+
+/*!\enum clamd_reply
+   \brief Classification of clamd scan reply
+*/
+enum clamd_reply {
+    reply_clean = 0, /*!< no virus found (or file excluded from scan) */
+    reply_infected,  /*!< virus found */
+    reply_failed,    /*!< scan failed or reply is empty */
+    reply_unknown    /*!< reply not understood (handled as virus found) */
+};
+
+/*!\brief Checks if clamd reply ends with given string
+   \param reply clamd reply
+   \param suffix expected end of reply
+   \returns true if reply ends with suffix
+*/
+static inline bool ClamavReplyEndsWith(const string& reply, const char* suffix) {
+    size_t length = strlen(suffix);
+    return (reply.size() >= length) &&
+           (reply.compare(reply.size() - length, length, suffix) == 0);
+}
+
+/*!\brief Classifies clamd reply to SCAN, FILDES or INSTREAM command
+   \param reply clamd reply (without trailing new line)
+   \returns classification of reply
+*/
+static inline clamd_reply ClamavParseReply(const string& reply) {
+    if (reply.empty())
+        return reply_failed;
+
+    if (ClamavReplyEndsWith(reply, "OK") ||
+        ClamavReplyEndsWith(reply, "Empty file") ||
+        ClamavReplyEndsWith(reply, "Excluded") ||
+        ClamavReplyEndsWith(reply, "Excluded (another filesystem)"))
+        return reply_clean;
+
+    if (ClamavReplyEndsWith(reply, "FOUND"))
+        return reply_infected;
+
+    if (ClamavReplyEndsWith(reply, "Access denied. ERROR") ||
+        ClamavReplyEndsWith(reply, "lstat() failed. ERROR") ||
+        ClamavReplyEndsWith(reply, "lstat() failed: Permission denied. ERROR") ||
+        ClamavReplyEndsWith(reply, "lstat() failed: No such file or directory. ERROR") ||
+        ClamavReplyEndsWith(reply, "No file descriptor received. ERROR") ||
+        ClamavReplyEndsWith(reply, "INSTREAM size limit exceeded. ERROR"))
+        return reply_failed;
+
+    return reply_unknown;
+}
+
+/*!\brief Extracts signature database version from clamd VERSION reply
+   \param version reply to VERSION ("ClamAV 1.0.1/26900/Tue Apr 11 07:35:57 2023")
+   \returns signature database version or 0 if reply does not have one
+*/
+static inline unsigned long ClamavSignatureVersion(const string& version) {
+    size_t slash = version.find('/');
+    if (slash == string::npos)
+        return 0;
+    return strtoul(version.c_str() + slash + 1, NULL, 10);
+}
+
+/*!\class ScanProgress
+   \brief Receives progress of streamed (INSTREAM) scan
+*/
+class ScanProgress {
+    public:
+        /*!\brief Destructor for ScanProgress */
+        virtual ~ScanProgress() { }
+        /*!\brief Called after each chunk sent to clamd
+           \param offset end of file data already sent to clamd
+        */
+        virtual void advance(off_t offset) = 0;
+};
+
+int ClamavScanFile(const char *filename, const int fd, const off_t size,
+                   const vector<ScanRange>* ranges = NULL,
+                   const struct fuse_context* context = NULL,
+                   ScanProgress* progress = NULL);
+
+/*!\brief Computes ranges of file for partial scan
+   \param size size of file
+   \param head number of bytes from beginning of file
+   \param tail number of bytes from end of file
+   \param samples number of samples taken between head and tail
+   \param sampleSize size of each sample
+   \param ranges computed ranges (ordered and not overlapping)
+*/
+void PartialScanRanges(const off_t size, const off_t head, const off_t tail,
+                       const unsigned int samples, const off_t sampleSize,
+                       vector<ScanRange>& ranges);
 
 } /* namespace clamfs */
 
@@ -0,0 +1,738 @@
+/*!\file clamdclient.cxx
+
+   \brief Event-driven clamd client
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "clamdclient.hxx"
+
+/* must be first because it may define _XOPEN_SOURCE */
+#include "fdpassing.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+#include <Poco/Exception.h>
+#include <Poco/Net/SocketAddress.h>
+
+#include "logger.hxx"
+
+namespace clamfs {
+
+/*!\def IO_READ
+   \brief Connection is readable (or waits to be)
+*/
+#define IO_READ 1
+/*!\def IO_WRITE
+   \brief Connection is writable (or waits to be)
+*/
+#define IO_WRITE 2
+/*!\def IO_ERROR
+   \brief Error or hang up on connection
+*/
+#define IO_ERROR 4
+
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+/*!\brief Sets descriptor into non-blocking, close-on-exec mode */
+static int set_nonblocking(int fd)
+{
+    if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == -1)
+        return -1;
+    return fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+ClamdRequest::ClamdRequest(clamd_command cmd, const char* name, int file,
+                           const vector<ScanRange>& fileRanges, ScanProgress* scanProgress):
+    command(cmd), filename(name), fd(file), ranges(fileRanges), progress(scanProgress),
+    id(0), started(false), sent(false), failed(false), retries(0), range(0), offset(0),
+    deadline(0) {
+}
+
+ClamdRequest::~ClamdRequest() {
+}
+
+void ClamdRequest::complete(const string& reply) {
+    result = reply;
+    done.set(); /* must be last, waiting thread may destroy request */
+}
+
+void ClamdRequest::wait() {
+    done.wait();
+}
+
+const string& ClamdRequest::reply() const {
+    return result;
+}
+
+void ClamdRequest::rewind() {
+    id = 0;
+    started = false;
+    sent = false;
+    failed = false;
+    range = 0;
+    offset = 0;
+}
+
+ClamdClient::ClamdClient(const char* socket, unsigned int connections, unsigned int limit):
+    address(socket), pipeline((limit > 0) ? limit : 1),
+    connectTimeout((Clock::ClockDiff)CLAMD_DEFAULT_CONNECT_TIMEOUT * 1000),
+    sendTimeout((Clock::ClockDiff)CLAMD_DEFAULT_SEND_TIMEOUT * 1000),
+    replyTimeout((Clock::ClockDiff)CLAMD_DEFAULT_REPLY_TIMEOUT * 1000),
+    replyPerMiB((Clock::ClockDiff)CLAMD_DEFAULT_REPLY_PER_MIB * 1000),
+    conns((connections > 0) ? connections : 1), chunk(CLAMD_CHUNK_SIZE), stopping(false), pollFd(-1), thread("clamdclient") {
+    for (size_t i = 0; i < conns.size(); ++i) {
+        conns[i].fd = -1;
+        conns[i].connecting = false;
+        conns[i].lastId = 0;
+        conns[i].load = 0;
+        conns[i].outSent = 0;
+        conns[i].passFd = -1;
+        conns[i].events = 0;
+    }
+    if (pipe(wakeFds) == -1) {
+        wakeFds[0] = wakeFds[1] = -1;
+    } else {
+        set_nonblocking(wakeFds[0]);
+        set_nonblocking(wakeFds[1]);
+    }
+}
+
+ClamdClient::~ClamdClient() {
+    stop();
+    if (wakeFds[0] >= 0) {
+        close(wakeFds[0]);
+        close(wakeFds[1]);
+    }
+}
+
+void ClamdClient::setTimeouts(long connect, long send, long reply, long perMiB) {
+    connectTimeout = (Clock::ClockDiff)connect * 1000;
+    sendTimeout = (Clock::ClockDiff)send * 1000;
+    replyTimeout = (Clock::ClockDiff)reply * 1000;
+    replyPerMiB = (Clock::ClockDiff)perMiB * 1000;
+}
+
+void ClamdClient::submit(ClamdRequest* request) {
+    /* reply deadline grows with amount of data clamd has to scan */
+    if (replyTimeout > 0) {
+        off_t bytes = 0;
+        for (size_t i = 0; i < request->ranges.size(); ++i)
+            bytes += request->ranges[i].length;
+        request->deadline = replyTimeout + replyPerMiB * (Clock::ClockDiff)(bytes >> 20);
+    }
+
+    {
+        FastMutex::ScopedLock lock(mutex);
+        if (!stopping && (wakeFds[1] >= 0)) {
+            pending.push_back(request);
+            char byte = 0;
+            if (write(wakeFds[1], &byte, 1) == -1) {
+                /* pipe is full, so I/O thread is going to wake up anyway */
+            }
+            return;
+        }
+    }
+    request->complete("");
+}
+
+int ClamdClient::scan(ClamdRequest& request) {
+    submit(&request);
+    request.wait();
+    return request.reply().empty() ? -1 : 0;
+}
+
+bool ClamdClient::connect(Connection& conn) {
+    Logger& logger = Logger::root();
+
+    if (conn.fd >= 0)
+        return true;
+
+    try {
+        SocketAddress sa(address);
+        conn.fd = socket(sa.af(), SOCK_STREAM, 0);
+        if (conn.fd < 0 || set_nonblocking(conn.fd) == -1) {
+            poco_warning_f1(logger, "error: unable to create clamd socket: %s", string(strerror(errno)));
+            if (conn.fd >= 0)
+                close(conn.fd);
+            conn.fd = -1;
+            return false;
+        }
+#ifdef SO_NOSIGPIPE
+        int one = 1;
+        setsockopt(conn.fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+        conn.connecting = false;
+        if (::connect(conn.fd, sa.addr(), sa.length()) == -1) {
+            if (errno != EINPROGRESS && errno != EAGAIN) {
+                poco_warning_f2(logger, "error: unable to open connection to clamd via %s: %s",
+                    address, string(strerror(errno)));
+                close(conn.fd);
+                conn.fd = -1;
+                return false;
+            }
+            conn.connecting = true;
+        }
+    } catch (Exception &exc) {
+        poco_warning_f1(logger, "error: invalid clamd socket address: %s", exc.displayText());
+        if (conn.fd >= 0)
+            close(conn.fd);
+        conn.fd = -1;
+        return false;
+    }
+
+    poco_debug_f1(logger, "opening clamd session via %s", address);
+    conn.lastId = 0;
+    conn.out.assign("zIDSESSION", sizeof("zIDSESSION")); /* with NUL */
+    conn.outSent = 0;
+    conn.passFd = -1;
+    conn.in.clear();
+    conn.used.update();
+    conn.opened.update();
+    conn.progress.update();
+    conn.expired.clear();
+    conn.events = 0;
+#ifdef HAVE_SYS_EPOLL_H
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLOUT;
+    ev.data.ptr = &conn;
+    epoll_ctl(pollFd, EPOLL_CTL_ADD, conn.fd, &ev);
+    conn.events = IO_READ | IO_WRITE;
+#endif
+    return true;
+}
+
+void ClamdClient::drop(Connection& conn, bool retry) {
+    Logger& logger = Logger::root();
+    deque<ClamdRequest*> failed;
+
+    if (conn.fd >= 0) {
+#ifdef HAVE_SYS_EPOLL_H
+        epoll_ctl(pollFd, EPOLL_CTL_DEL, conn.fd, NULL);
+#endif
+        close(conn.fd);
+        conn.fd = -1;
+    }
+
+    /* request being sent is in both sending and waiting */
+    for (map<unsigned int, ClamdRequest*>::iterator i = conn.waiting.begin();
+         i != conn.waiting.end(); ++i)
+        failed.push_back(i->second);
+    for (size_t i = 0; i < conn.sending.size(); ++i)
+        if (!conn.sending[i]->started)
+            failed.push_back(conn.sending[i]);
+    conn.waiting.clear();
+    conn.sending.clear();
+    conn.out.clear();
+    conn.outSent = 0;
+    conn.passFd = -1;
+    conn.in.clear();
+    conn.expired.clear();
+    conn.load = 0;
+    conn.connecting = false;
+    conn.events = 0;
+
+    if (failed.empty())
+        return;
+    poco_debug_f1(logger, "clamd session closed with %z request(s) outstanding", failed.size());
+
+    /* clamd may close session at any time (e.g. on idle timeout racing
+       with new request), so each request is sent once again */
+    deque<ClamdRequest*> again;
+    for (size_t i = 0; i < failed.size(); ++i) {
+        if (retry && failed[i]->retries == 0) {
+            failed[i]->retries++;
+            failed[i]->rewind();
+            again.push_back(failed[i]);
+        } else {
+            failed[i]->complete("");
+        }
+    }
+    if (!again.empty()) {
+        FastMutex::ScopedLock lock(mutex);
+        pending.insert(pending.begin(), again.begin(), again.end());
+    }
+}
+
+void ClamdClient::assign() {
+    for (;;) {
+        ClamdRequest* request;
+        {
+            FastMutex::ScopedLock lock(mutex);
+            if (pending.empty())
+                return;
+            request = pending.front();
+        }
+
+        /* least loaded connection (closed one has no load) */
+        Connection* best = NULL;
+        for (size_t i = 0; i < conns.size(); ++i) {
+            if (conns[i].load >= pipeline)
+                continue;
+            if ((best == NULL) || (conns[i].load < best->load) ||
+                ((conns[i].load == best->load) && (best->fd < 0) && (conns[i].fd >= 0)))
+                best = &conns[i];
+        }
+        if (best == NULL)
+            return; /* all connections are busy, request waits */
+
+        {
+            FastMutex::ScopedLock lock(mutex);
+            pending.pop_front();
+        }
+        if (!connect(*best)) {
+            request->complete("");
+            continue;
+        }
+        best->sending.push_back(request);
+        best->load++;
+    }
+}
+
+bool ClamdClient::fill(Connection& conn) {
+    if (conn.sending.empty())
+        return false;
+
+    ClamdRequest* request = conn.sending.front();
+    if (!request->started) {
+        request->started = true;
+        request->id = ++conn.lastId;
+        conn.waiting[request->id] = request;
+        switch (request->command) {
+            case command_scan:
+                conn.out.append("zSCAN ");
+                conn.out.append(request->filename);
+                conn.out.push_back('\0');
+                request->sent = true;
+                request->sentAt.update();
+                conn.sending.pop_front();
+                break;
+            case command_fildes:
+                conn.out.append("zFILDES", sizeof("zFILDES"));
+                /* request is sent (and its deadline runs) only once
+                   descriptor is passed, see flush() */
+                conn.passFd = request->fd;
+                break;
+            case command_instream:
+                conn.out.append("zINSTREAM", sizeof("zINSTREAM"));
+                if (!request->ranges.empty())
+                    request->offset = request->ranges[0].offset;
+                break;
+        }
+        return true;
+    }
+
+    /*
+     * Send next chunk of INSTREAM (one at a time, so data of many
+     * files is not buffered in memory at once)
+     */
+    const vector<ScanRange>& ranges = request->ranges;
+    while ((request->range < ranges.size()) &&
+           (request->offset >= ranges[request->range].offset + ranges[request->range].length)) {
+        if (++request->range < ranges.size())
+            request->offset = ranges[request->range].offset;
+    }
+
+    uint32_t chunkSize;
+    if (request->range < ranges.size()) {
+        off_t end = ranges[request->range].offset + ranges[request->range].length;
+        size_t want = chunk.size();
+        if ((off_t)want > end - request->offset)
+            want = (size_t)(end - request->offset);
+        ssize_t bytes;
+        do {
+            bytes = pread(request->fd, &chunk[0], want, request->offset);
+        } while (bytes < 0 && errno == EINTR);
+        if (bytes > 0) {
+            chunkSize = htonl((uint32_t)bytes);
+            conn.out.append((const char*)&chunkSize, sizeof(chunkSize));
+            conn.out.append(&chunk[0], (size_t)bytes);
+            request->offset += bytes;
+            if (request->progress != NULL)
+                request->progress->advance(request->offset);
+            return true;
+        }
+        /* read error or file truncated in the meantime, end stream
+           and fail request when its reply comes */
+        request->failed = true;
+    }
+
+    chunkSize = 0;
+    conn.out.append((const char*)&chunkSize, sizeof(chunkSize));
+    request->sent = true;
+    request->sentAt.update();
+    conn.sending.pop_front();
+    return true;
+}
+
+int ClamdClient::flush(Connection& conn) {
+    for (;;) {
+        if (conn.outSent < conn.out.size()) {
+            ssize_t bytes = send(conn.fd, conn.out.data() + conn.outSent,
+                                 conn.out.size() - conn.outSent, SEND_FLAGS);
+            if (bytes < 0) {
+                if (errno == EINTR)
+                    continue;
+                return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+            }
+            conn.outSent += (size_t)bytes;
+            conn.progress.update();
+            continue;
+        }
+        conn.out.clear();
+        conn.outSent = 0;
+
+        if (conn.passFd >= 0) {
+#ifdef HAVE_FD_PASSING
+            struct iovec iov[1];
+            struct msghdr msg;
+            struct cmsghdr *cmsg;
+            unsigned char fdbuf[CMSG_SPACE(sizeof(int))];
+            char dummy[] = "";
+
+            iov[0].iov_base = dummy;
+            iov[0].iov_len  = 1;
+
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_control    = fdbuf;
+            msg.msg_iov        = iov;
+            msg.msg_iovlen     = 1;
+            msg.msg_controllen = CMSG_LEN(sizeof(int));
+            cmsg               = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_len     = CMSG_LEN(sizeof(int));
+            cmsg->cmsg_level   = SOL_SOCKET;
+            cmsg->cmsg_type    = SCM_RIGHTS;
+            memcpy(CMSG_DATA(cmsg), &conn.passFd, sizeof(conn.passFd));
+
+            if (sendmsg(conn.fd, &msg, SEND_FLAGS) < 0) {
+                if (errno == EINTR)
+                    continue;
+                return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+            }
+#endif
+            conn.passFd = -1;
+            conn.progress.update();
+            ClamdRequest* request = conn.sending.front();
+            request->sent = true;
+            request->sentAt.update();
+            conn.sending.pop_front();
+            continue;
+        }
+
+        if (!fill(conn))
+            return 0;
+    }
+}
+
+int ClamdClient::receive(Connection& conn) {
+    Logger& logger = Logger::root();
+    char buffer[4096];
+
+    for (;;) {
+        ssize_t bytes = recv(conn.fd, buffer, sizeof(buffer), 0);
+        if (bytes < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            return -1;
+        }
+        if (bytes == 0)
+            return -1; /* session closed by clamd */
+        conn.in.append(buffer, (size_t)bytes);
+    }
+
+    /*
+     * Replies are "<id>: <reply>" terminated with NUL (in any order)
+     */
+    size_t start = 0, end;
+    while ((end = conn.in.find('\0', start)) != string::npos) {
+        const char* line = conn.in.c_str() + start;
+        char* rest;
+        unsigned long id = strtoul(line, &rest, 10);
+        start = end + 1;
+
+        map<unsigned int, ClamdRequest*>::iterator i = conn.waiting.end();
+        if (rest != line && rest[0] == ':' && rest[1] == ' ') {
+            if (conn.expired.erase((unsigned int)id) > 0)
+                continue; /* late reply for request failed by deadline */
+            i = conn.waiting.find((unsigned int)id);
+        }
+        if (i == conn.waiting.end()) {
+            poco_warning_f1(logger, "unexpected reply in clamd session: %s", string(line));
+            continue;
+        }
+
+        ClamdRequest* request = i->second;
+        if (!request->sent) {
+            /* clamd gave up on request still being sent (e.g. INSTREAM
+               size limit exceeded), session cannot continue */
+            conn.waiting.erase(i);
+            conn.sending.pop_front();
+            conn.load--;
+            request->complete(string(rest + 2));
+            conn.in.erase(0, start);
+            return -1;
+        }
+        conn.waiting.erase(i);
+        conn.load--;
+        request->complete(request->failed ? string() : string(rest + 2));
+    }
+    conn.in.erase(0, start);
+    conn.used.update();
+    return 0;
+}
+
+void ClamdClient::watch(Connection& conn) {
+    int events = IO_READ;
+    if (conn.connecting || (conn.outSent < conn.out.size()) || (conn.passFd >= 0) ||
+        !conn.sending.empty())
+        events |= IO_WRITE;
+    else
+        conn.progress.update(); /* nothing to send, so nothing is stalled */
+#ifdef HAVE_SYS_EPOLL_H
+    if (events != conn.events) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | ((events & IO_WRITE) ? (uint32_t)EPOLLOUT : 0);
+        ev.data.ptr = &conn;
+        epoll_ctl(pollFd, EPOLL_CTL_MOD, conn.fd, &ev);
+    }
+#endif
+    conn.events = events;
+}
+
+bool ClamdClient::expire(Connection& conn) {
+    Logger& logger = Logger::root();
+
+    if (conn.connecting && (connectTimeout > 0) && conn.opened.isElapsed(connectTimeout)) {
+        poco_warning_f1(logger, "error: timeout connecting to clamd via %s", address);
+        drop(conn, false);
+        return false;
+    }
+    if (!conn.connecting && (sendTimeout > 0) && (conn.events & IO_WRITE) &&
+        conn.progress.isElapsed(sendTimeout)) {
+        poco_warning(logger, "error: clamd does not accept data, closing session");
+        drop(conn, false);
+        return false;
+    }
+
+    map<unsigned int, ClamdRequest*>::iterator i = conn.waiting.begin();
+    while (i != conn.waiting.end()) {
+        ClamdRequest* request = i->second;
+        if (!request->sent || (request->deadline == 0) ||
+            !request->sentAt.isElapsed(request->deadline)) {
+            ++i;
+            continue;
+        }
+        poco_warning_f2(logger, "error: no clamd reply for file '%s' within %ld ms",
+            request->filename, (long)(request->deadline / 1000));
+        conn.expired.insert(i->first);
+        conn.waiting.erase(i++);
+        conn.load--;
+        request->complete("");
+    }
+    return true;
+}
+
+void ClamdClient::poll(int timeout, vector<pair<Connection*, int> >& ready) {
+    ready.clear();
+#ifdef HAVE_SYS_EPOLL_H
+    struct epoll_event events[16];
+    int count = epoll_wait(pollFd, events, 16, timeout);
+    for (int i = 0; i < count; ++i) {
+        if (events[i].data.ptr == NULL)
+            continue; /* wake up pipe */
+        int flags = 0;
+        if (events[i].events & EPOLLIN)
+            flags |= IO_READ;
+        if (events[i].events & EPOLLOUT)
+            flags |= IO_WRITE;
+        if (events[i].events & (EPOLLERR | EPOLLHUP))
+            flags |= IO_ERROR;
+        ready.push_back(make_pair((Connection*)events[i].data.ptr, flags));
+    }
+#else
+    vector<struct pollfd> fds;
+    vector<Connection*> owners;
+    struct pollfd pfd;
+
+    pfd.fd = wakeFds[0];
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    fds.push_back(pfd);
+    owners.push_back(NULL);
+    for (size_t i = 0; i < conns.size(); ++i) {
+        if (conns[i].fd < 0)
+            continue;
+        pfd.fd = conns[i].fd;
+        pfd.events = POLLIN | ((conns[i].events & IO_WRITE) ? POLLOUT : 0);
+        fds.push_back(pfd);
+        owners.push_back(&conns[i]);
+    }
+    if (::poll(&fds[0], fds.size(), timeout) <= 0)
+        return;
+    for (size_t i = 1; i < fds.size(); ++i) {
+        int flags = 0;
+        if (fds[i].revents & POLLIN)
+            flags |= IO_READ;
+        if (fds[i].revents & POLLOUT)
+            flags |= IO_WRITE;
+        if (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL))
+            flags |= IO_ERROR;
+        if (flags != 0)
+            ready.push_back(make_pair(owners[i], flags));
+    }
+#endif
+}
+
+void ClamdClient::start() {
+    thread.start(*this);
+}
+
+void ClamdClient::stop() {
+    {
+        FastMutex::ScopedLock lock(mutex);
+        if (stopping)
+            return;
+        stopping = true;
+        char byte = 0;
+        if (wakeFds[1] >= 0 && write(wakeFds[1], &byte, 1) == -1) {
+            /* pipe is full, so I/O thread is going to wake up anyway */
+        }
+    }
+    if (thread.isRunning())
+        thread.join();
+
+    /* fail requests still queued (I/O thread is gone) */
+    deque<ClamdRequest*> left;
+    {
+        FastMutex::ScopedLock lock(mutex);
+        left.swap(pending);
+    }
+    for (size_t i = 0; i < left.size(); ++i)
+        left[i]->complete("");
+}
+
+void ClamdClient::run() {
+    Logger& logger = Logger::root();
+    vector<pair<Connection*, int> > ready;
+
+#ifdef HAVE_SYS_EPOLL_H
+    pollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (pollFd < 0) {
+        poco_error_f1(logger, "cannot create epoll instance: %s", string(strerror(errno)));
+        return;
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(pollFd, EPOLL_CTL_ADD, wakeFds[0], &ev);
+#endif
+    poco_debug_f2(logger, "clamd client started (%z connections, %u requests per connection)",
+        conns.size(), pipeline);
+
+    for (;;) {
+        {
+            FastMutex::ScopedLock lock(mutex);
+            if (stopping)
+                break;
+        }
+
+        char drain[64];
+        while (read(wakeFds[0], drain, sizeof(drain)) > 0)
+            ;
+
+        assign();
+        for (size_t i = 0; i < conns.size(); ++i) {
+            Connection& conn = conns[i];
+            if (conn.fd < 0)
+                continue;
+            /* close idle session before clamd does */
+            if ((conn.load == 0) && conn.used.isElapsed(CLAMD_IDLE_CLOSE * 1000)) {
+                if (send(conn.fd, "zEND", sizeof("zEND"), SEND_FLAGS) < 0) {
+                    /* session is closed anyway */
+                }
+                drop(conn, false);
+                continue;
+            }
+            watch(conn);
+            expire(conn);
+        }
+
+        poll(250, ready);
+        for (size_t i = 0; i < ready.size(); ++i) {
+            Connection& conn = *ready[i].first;
+            int flags = ready[i].second;
+            if (conn.fd < 0)
+                continue;
+
+            if (conn.connecting && (flags & (IO_WRITE | IO_ERROR))) {
+                int err = 0;
+                socklen_t len = sizeof(err);
+                getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                if (err != 0) {
+                    poco_warning_f2(logger, "error: unable to open connection to clamd via %s: %s",
+                        address, string(strerror(err)));
+                    drop(conn, false);
+                    continue;
+                }
+                conn.connecting = false;
+            }
+            if ((flags & IO_READ) && receive(conn) != 0) {
+                drop(conn, true);
+                continue;
+            }
+            if ((flags & IO_ERROR) && !(flags & IO_READ)) {
+                drop(conn, true);
+                continue;
+            }
+            if (!conn.connecting && (flags & IO_WRITE) && flush(conn) != 0)
+                drop(conn, true);
+        }
+    }
+
+    /* fail outstanding requests */
+    for (size_t i = 0; i < conns.size(); ++i)
+        drop(conns[i], false);
+#ifdef HAVE_SYS_EPOLL_H
+    close(pollFd);
+    pollFd = -1;
+#endif
+    poco_debug(logger, "clamd client stopped");
+}
+
+} /* namespace clamfs */
+
+/* EoF */
@@ -0,0 +1,320 @@
+/*!\file clamdclient.hxx
+
+   \brief Event-driven clamd client (header file)
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef CLAMFS_CLAMDCLIENT_HXX
+#define CLAMFS_CLAMDCLIENT_HXX
+
+#include "config.h"
+
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <Poco/Mutex.h>
+#include <Poco/Event.h>
+#include <Poco/Runnable.h>
+#include <Poco/Thread.h>
+#include <Poco/Clock.h>
+
+#ifdef DMALLOC
+   #include <stdlib.h>
+   #ifdef HAVE_MALLOC_H
+      #include <malloc.h>
+   #endif
+   #include <dmalloc.h>
+#endif
+
+#include "clamav.hxx"
+
+/*!\def CLAMD_DEFAULT_CONNECTIONS
+   \brief Default number of clamd connections
+*/
+#define CLAMD_DEFAULT_CONNECTIONS 4
+
+/*!\def CLAMD_DEFAULT_PIPELINE
+   \brief Default number of requests outstanding on one clamd connection
+*/
+#define CLAMD_DEFAULT_PIPELINE 16
+
+/*!\def CLAMD_IDLE_CLOSE
+   \brief Idle clamd connection is closed after this time (in ms),
+          before clamd closes it by itself (IdleTimeout is 30s by default)
+*/
+#define CLAMD_IDLE_CLOSE 10000
+
+namespace clamfs {
+
+using namespace std;
+using namespace Poco;
+
+/*!\enum clamd_command
+   \brief Command used to pass file to clamd
+*/
+enum clamd_command {
+    command_scan = 0, /*!< pass file name (SCAN) */
+    command_fildes,   /*!< pass file descriptor (FILDES) */
+    command_instream  /*!< pass file content (INSTREAM) */
+};
+
+class ClamdClient;
+
+/*!\class ClamdRequest
+   \brief Scan request queued to ClamdClient
+
+   Request is a future of clamd reply. It is filled and completed by
+   client I/O thread and must stay alive (with its file descriptor
+   open) until complete() is called.
+*/
+class ClamdRequest {
+    public:
+        /*!\brief Constructor for ClamdRequest
+           \param command command used to pass file
+           \param filename name of file (passed by command_scan)
+           \param fd readable file descriptor (passed by command_fildes
+                     or read with pread() by command_instream)
+           \param ranges file ranges sent by command_instream
+           \param progress receives offset of data sent so far or NULL
+        */
+        ClamdRequest(clamd_command command, const char* filename, int fd,
+                     const vector<ScanRange>& ranges, ScanProgress* progress);
+        /*!\brief Destructor for ClamdRequest */
+        virtual ~ClamdRequest();
+
+        /*!\brief Called by I/O thread when reply is received
+           \param reply clamd reply (empty on error)
+
+           Request is not used by client anymore after this call.
+        */
+        virtual void complete(const string& reply);
+        /*!\brief Waits for reply (for requests not overriding complete()) */
+        void wait();
+        /*!\brief Returns clamd reply (empty on error) */
+        const string& reply() const;
+
+    private:
+        friend class ClamdClient;
+
+        /*!\brief Forbid usage of copy constructor */
+        ClamdRequest(const ClamdRequest& aRequest);
+        /*!\brief Forbid usage of assignment operator */
+        ClamdRequest& operator = (const ClamdRequest& aRequest);
+
+        /*!\brief Makes request ready to be sent again */
+        void rewind();
+
+        /*!\brief command used to pass file */
+        clamd_command command;
+        /*!\brief name of file */
+        string filename;
+        /*!\brief readable file descriptor */
+        int fd;
+        /*!\brief file ranges sent by INSTREAM */
+        vector<ScanRange> ranges;
+        /*!\brief receives progress of INSTREAM or NULL */
+        ScanProgress* progress;
+
+        /*!\brief request id in clamd session */
+        unsigned int id;
+        /*!\brief true once command was queued for sending */
+        bool started;
+        /*!\brief true once whole request was queued for sending */
+        bool sent;
+        /*!\brief true if file could not be read (reply is ignored) */
+        bool failed;
+        /*!\brief number of times request was sent again */
+        unsigned int retries;
+        /*!\brief index of range being sent */
+        size_t range;
+        /*!\brief offset in file of next data to send */
+        off_t offset;
+        /*!\brief time to wait for reply once request is sent (in us, 0 waits forever) */
+        Clock::ClockDiff deadline;
+        /*!\brief time request was sent */
+        Clock sentAt;
+
+        /*!\brief clamd reply */
+        string result;
+        /*!\brief signalled on completion */
+        Event done;
+};
+
+/*!\class ClamdClient
+   \brief Non-blocking clamd client multiplexing scans over few connections
+
+   Single I/O thread drives a few connections to clamd in IDSESSION
+   mode. Each of them carries many outstanding requests (up to pipeline
+   limit) and replies are matched to requests by their ids, so scans of
+   many files proceed at once without connection per scan and without
+   thread per connection. Connections are opened when needed and
+   closed when idle. Requests which lose connection before reply are
+   sent once again over a new one. Connect, send and reply deadlines
+   bound time spent on each request, so wedged clamd fails requests
+   instead of blocking them forever.
+*/
+class ClamdClient: public Runnable {
+    public:
+        /*!\brief Constructor for ClamdClient
+           \param socket clamd socket (UNIX socket path or host:port)
+           \param connections maximal number of connections
+           \param pipeline maximal number of requests outstanding on connection
+        */
+        ClamdClient(const char* socket, unsigned int connections, unsigned int pipeline);
+        /*!\brief Destructor for ClamdClient */
+        virtual ~ClamdClient();
+
+        /*!\brief Sets deadlines (in ms, 0 disables deadline)
+           \param connect time to connect to clamd
+           \param send time clamd may not accept any data sent to it
+           \param reply time to wait for reply once request is sent
+           \param replyPerMiB extra time to wait for reply per MiB of file
+        */
+        void setTimeouts(long connect, long send, long reply, long replyPerMiB);
+
+        /*!\brief Queues request (completed by I/O thread) */
+        void submit(ClamdRequest* request);
+        /*!\brief Scans file and waits for reply
+           \param request request to send
+           \returns 0 if reply was received and -1 on error
+        */
+        int scan(ClamdRequest& request);
+
+        /*!\brief Starts I/O thread */
+        void start();
+        /*!\brief Stops I/O thread (outstanding requests fail) */
+        void stop();
+        /*!\brief I/O thread main loop */
+        virtual void run();
+
+    private:
+        /*!\brief Forbid usage of copy constructor */
+        ClamdClient(const ClamdClient& aClient);
+        /*!\brief Forbid usage of assignment operator */
+        ClamdClient& operator = (const ClamdClient& aClient);
+
+        /*!\brief Single clamd connection (session) */
+        struct Connection {
+            /*!\brief socket or -1 if closed */
+            int fd;
+            /*!\brief true while connect() is in progress */
+            bool connecting;
+            /*!\brief id of last request in session */
+            unsigned int lastId;
+            /*!\brief number of requests queued and not completed */
+            unsigned int load;
+            /*!\brief data to send */
+            string out;
+            /*!\brief part of out already sent */
+            size_t outSent;
+            /*!\brief file descriptor to pass after out is sent or -1 */
+            int passFd;
+            /*!\brief requests being sent (in order) */
+            deque<ClamdRequest*> sending;
+            /*!\brief requests waiting for reply by id */
+            map<unsigned int, ClamdRequest*> waiting;
+            /*!\brief received data not parsed yet */
+            string in;
+            /*!\brief time of last activity */
+            Clock used;
+            /*!\brief time connect() was started */
+            Clock opened;
+            /*!\brief time of last progress of sending (or of idle output) */
+            Clock progress;
+            /*!\brief ids of requests failed by deadline (their replies are ignored) */
+            set<unsigned int> expired;
+            /*!\brief events connection is registered for */
+            int events;
+        };
+
+        /*!\brief Assigns pending requests to connections */
+        void assign();
+        /*!\brief Opens connection
+           \returns true if connection is open or being opened
+        */
+        bool connect(Connection& conn);
+        /*!\brief Closes connection, requests are sent again or failed */
+        void drop(Connection& conn, bool retry);
+        /*!\brief Appends next part of request being sent to out
+           \returns false if there is nothing more to send
+        */
+        bool fill(Connection& conn);
+        /*!\brief Sends as much data as possible
+           \returns 0 on success and -1 if connection is broken
+        */
+        int flush(Connection& conn);
+        /*!\brief Receives and dispatches replies
+           \returns 0 on success and -1 if connection is broken or closed
+        */
+        int receive(Connection& conn);
+        /*!\brief Registers events connection waits for */
+        void watch(Connection& conn);
+        /*!\brief Fails requests and connections which missed deadline
+           \returns false if connection was dropped
+        */
+        bool expire(Connection& conn);
+        /*!\brief Waits for events
+           \param timeout maximal time to wait (in ms)
+           \param ready connections ready for I/O
+        */
+        void poll(int timeout, vector<pair<Connection*, int> >& ready);
+
+        /*!\brief clamd socket address */
+        string address;
+        /*!\brief maximal number of requests outstanding on connection */
+        unsigned int pipeline;
+        /*!\brief time to connect (in us) */
+        Clock::ClockDiff connectTimeout;
+        /*!\brief time clamd may not accept data (in us) */
+        Clock::ClockDiff sendTimeout;
+        /*!\brief time to wait for reply (in us) */
+        Clock::ClockDiff replyTimeout;
+        /*!\brief extra time to wait for reply per MiB (in us) */
+        Clock::ClockDiff replyPerMiB;
+        /*!\brief connections to clamd */
+        vector<Connection> conns;
+        /*!\brief buffer for file data sent by INSTREAM */
+        vector<char> chunk;
+
+        /*!\brief protects pending and stopping */
+        FastMutex mutex;
+        /*!\brief requests not assigned to connection yet */
+        deque<ClamdRequest*> pending;
+        /*!\brief stop request flag */
+        bool stopping;
+        /*!\brief pipe waking I/O thread up */
+        int wakeFds[2];
+        /*!\brief epoll instance (-1 if poll() is used) */
+        int pollFd;
+        /*!\brief I/O thread */
+        Thread thread;
+};
+
+/*!\brief extern to access client pointer */
+extern ClamdClient* client;
+
+} /* namespace clamfs */
+
+#endif /* CLAMFS_CLAMDCLIENT_HXX */
+
+/* EoF */
@@ -0,0 +1,324 @@
+/*!\file clamengine.cxx
+
+   \brief In-process libclamav scan engine
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "clamengine.hxx"
+
+#ifdef HAVE_LIBCLAMAV
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <Poco/ScopedUnlock.h>
+
+#include "logger.hxx"
+
+namespace clamfs {
+
+/*!\struct engine_map
+   \brief Ranges of file presented to libclamav as one continuous map
+*/
+struct engine_map {
+    /*!\brief readable file descriptor */
+    int fd;
+    /*!\brief ranges of file (in order) */
+    const vector<ScanRange>* ranges;
+    /*!\brief receives end of data already read or NULL */
+    ScanProgress* progress;
+    /*!\brief end of map data read without gaps so far */
+    off_t contiguous;
+};
+
+/*!\brief Converts offset in map to offset in file */
+static off_t map_to_file(const vector<ScanRange>& ranges, off_t offset)
+{
+    off_t start = 0;
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        if (offset <= start + ranges[i].length)
+            return ranges[i].offset + (offset - start);
+        start += ranges[i].length;
+    }
+    return ranges.empty() ? 0 : ranges.back().offset + ranges.back().length;
+}
+
+extern "C" {
+
+/*!\brief pread() callback of libclamav map, reads ranges as one stream */
+static off_t engine_map_pread(void *handle, void *buf, size_t count, off_t offset)
+{
+    engine_map *map = (engine_map *) handle;
+    const vector<ScanRange>& ranges = *map->ranges;
+    char *out = (char *) buf;
+    size_t done = 0;
+    off_t start = 0;
+
+    for (size_t i = 0; (i < ranges.size()) && (done < count); ++i) {
+        off_t end = start + ranges[i].length;
+        while ((done < count) && (offset + (off_t)done < end)) {
+            off_t within = offset + (off_t)done - start;
+            size_t want = count - done;
+            if ((off_t)want > ranges[i].length - within)
+                want = (size_t)(ranges[i].length - within);
+            ssize_t bytes = pread(map->fd, out + done, want, ranges[i].offset + within);
+            if (bytes < 0 && errno == EINTR)
+                continue;
+            if (bytes <= 0) /* read error or file truncated in the meantime */
+                return (done > 0) ? (off_t)done : -1;
+            done += (size_t)bytes;
+        }
+        start = end;
+    }
+
+    /* engine may read map out of order, only data without gaps counts */
+    if ((map->progress != NULL) && (offset <= map->contiguous) &&
+        (offset + (off_t)done > map->contiguous)) {
+        map->contiguous = offset + (off_t)done;
+        map->progress->advance(map_to_file(ranges, map->contiguous));
+    }
+    return (off_t)done;
+}
+
+} /* extern "C" */
+
+ClamEngine::ClamEngine(const char* dbdir, long reload, unsigned int threads):
+    database((dbdir != NULL) ? dbdir : ""), interval(reload * 1000),
+    maxScans((threads > 0) ? threads : 1), current(NULL),
+    running(0), stopping(false), thread("clamengine") {
+    memset(&dbstat, 0, sizeof(dbstat));
+}
+
+ClamEngine::~ClamEngine() {
+    stop();
+    if (current != NULL)
+        cl_engine_free(current);
+    if (dbstat.dir != NULL)
+        cl_statfree(&dbstat);
+}
+
+struct cl_engine* ClamEngine::build(unsigned int& signatures) {
+    Logger& logger = Logger::root();
+
+    struct cl_engine* fresh = cl_engine_new();
+    if (fresh == NULL) {
+        poco_warning(logger, "libclamav: cannot create engine");
+        return NULL;
+    }
+
+    signatures = 0;
+    cl_error_t ret = cl_load(database.c_str(), fresh, &signatures, CL_DB_STDOPT);
+    if (ret == CL_SUCCESS)
+        ret = cl_engine_compile(fresh);
+    if (ret != CL_SUCCESS) {
+        poco_warning_f2(logger, "libclamav: cannot load database %s: %s",
+            database, string(cl_strerror(ret)));
+        cl_engine_free(fresh);
+        return NULL;
+    }
+    return fresh;
+}
+
+bool ClamEngine::load() {
+    Logger& logger = Logger::root();
+
+    cl_error_t ret = cl_init(CL_INIT_DEFAULT);
+    if (ret != CL_SUCCESS) {
+        poco_warning_f1(logger, "libclamav: initialization failed: %s", string(cl_strerror(ret)));
+        return false;
+    }
+    if (database.empty())
+        database = cl_retdbdir();
+
+    if (cl_statinidir(database.c_str(), &dbstat) != CL_SUCCESS)
+        memset(&dbstat, 0, sizeof(dbstat));
+
+    unsigned int signatures;
+    current = build(signatures);
+    if (current == NULL)
+        return false;
+
+    poco_information_f3(logger, "libclamav %s engine loaded %u signatures from %s",
+        string(cl_retver()), signatures, database);
+    return true;
+}
+
+void ClamEngine::reload() {
+    Logger& logger = Logger::root();
+    struct cl_stat fresh_stat;
+
+    /* take state of database before loading it, so update done while
+       loading is noticed next time */
+    memset(&fresh_stat, 0, sizeof(fresh_stat));
+    if (cl_statinidir(database.c_str(), &fresh_stat) != CL_SUCCESS)
+        return;
+
+    unsigned int signatures;
+    struct cl_engine* fresh = build(signatures);
+    if (fresh == NULL) {
+        poco_warning(logger, "libclamav: keeping previous engine, reload will be retried");
+        cl_statfree(&fresh_stat);
+        return;
+    }
+
+    struct cl_engine* old;
+    {
+        FastMutex::ScopedLock lock(engineMutex);
+        old = current;
+        current = fresh;
+    }
+    /* freed when last scan using it releases its reference */
+    cl_engine_free(old);
+
+    if (dbstat.dir != NULL)
+        cl_statfree(&dbstat);
+    dbstat = fresh_stat;
+
+    poco_information_f1(logger, "libclamav engine reloaded with %u signatures", signatures);
+}
+
+struct cl_engine* ClamEngine::acquire() {
+    FastMutex::ScopedLock lock(engineMutex);
+    cl_engine_addref(current);
+    return current;
+}
+
+clamd_reply ClamEngine::scan(const char* filename, int fd, off_t size,
+                             const vector<ScanRange>* ranges, ScanProgress* progress,
+                             string& reply) {
+    const char* virname = NULL;
+    unsigned long int scanned = 0;
+    struct cl_scan_options options;
+    cl_error_t ret;
+
+    if (fd < 0) {
+        reply = string(filename) + ": No file descriptor received. ERROR";
+        return reply_failed;
+    }
+
+    memset(&options, 0, sizeof(options));
+    options.parse = ~0u;
+    options.general = CL_SCAN_GENERAL_HEURISTICS;
+
+    /*
+     * Wait for free scan slot
+     */
+    {
+        FastMutex::ScopedLock lock(gateMutex);
+        while (running >= maxScans)
+            gateFree.wait(gateMutex);
+        ++running;
+    }
+
+    struct cl_engine* scanEngine = acquire();
+    if ((ranges == NULL) && (progress == NULL)) {
+        ret = cl_scandesc(fd, filename, &virname, &scanned, scanEngine, &options);
+    } else {
+        /*
+         * Partial scan or scan reporting progress reads file through map
+         */
+        vector<ScanRange> whole(1);
+        whole[0].offset = 0;
+        whole[0].length = size;
+
+        engine_map map;
+        map.fd = fd;
+        map.ranges = (ranges != NULL) ? ranges : &whole;
+        map.progress = progress;
+        map.contiguous = 0;
+
+        off_t length = 0;
+        for (size_t i = 0; i < map.ranges->size(); ++i)
+            length += (*map.ranges)[i].length;
+
+        cl_fmap_t* fmap = cl_fmap_open_handle(&map, 0, (size_t)length, engine_map_pread, 1);
+        if (fmap != NULL) {
+            ret = cl_scanmap_callback(fmap, filename, &virname, &scanned,
+                                      scanEngine, &options, NULL);
+            cl_fmap_close(fmap);
+        } else {
+            ret = CL_EOPEN;
+        }
+    }
+    cl_engine_free(scanEngine); /* release reference */
+
+    {
+        FastMutex::ScopedLock lock(gateMutex);
+        --running;
+        gateFree.signal();
+    }
+
+    if (ret == CL_CLEAN)
+        return reply_clean; /* reply is only logged for infected or failed files */
+    if (ret == CL_VIRUS) {
+        reply = string(filename) + ": " + ((virname != NULL) ? virname : "Unknown") + " FOUND";
+        return reply_infected;
+    }
+    reply = string(filename) + ": " + cl_strerror(ret) + " ERROR";
+    return reply_failed;
+}
+
+unsigned long ClamEngine::version() {
+    int err = CL_SUCCESS;
+
+    struct cl_engine* scanEngine = acquire();
+    long long ver = cl_engine_get_num(scanEngine, CL_ENGINE_DB_VERSION, &err);
+    cl_engine_free(scanEngine); /* release reference */
+
+    return ((err == CL_SUCCESS) && (ver > 0)) ? (unsigned long)ver : 0;
+}
+
+void ClamEngine::start() {
+    if (interval > 0)
+        thread.start(*this);
+}
+
+void ClamEngine::stop() {
+    {
+        FastMutex::ScopedLock lock(threadMutex);
+        if (stopping)
+            return;
+        stopping = true;
+        wakeup.broadcast();
+    }
+    if (thread.isRunning())
+        thread.join();
+}
+
+void ClamEngine::run() {
+    FastMutex::ScopedLock lock(threadMutex);
+    while (!stopping) {
+        wakeup.tryWait(threadMutex, interval);
+        if (stopping)
+            break;
+
+        ScopedUnlock<FastMutex> unlock(threadMutex);
+        /* 1 means database directory changed since engine was built */
+        if ((dbstat.dir == NULL) || (cl_statchkdir(&dbstat) == 1))
+            reload();
+    }
+}
+
+} /* namespace clamfs */
+
+#endif /* HAVE_LIBCLAMAV */
+
+/* EoF */
@@ -0,0 +1,167 @@
+/*!\file clamengine.hxx
+
+   \brief In-process libclamav scan engine (header file)
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef CLAMFS_CLAMENGINE_HXX
+#define CLAMFS_CLAMENGINE_HXX
+
+#include "config.h"
+
+#ifdef HAVE_LIBCLAMAV
+
+#include <string>
+#include <vector>
+#include <clamav.h>
+#include <Poco/Mutex.h>
+#include <Poco/Condition.h>
+#include <Poco/Runnable.h>
+#include <Poco/Thread.h>
+
+#ifdef DMALLOC
+   #include <stdlib.h>
+   #ifdef HAVE_MALLOC_H
+      #include <malloc.h>
+   #endif
+   #include <dmalloc.h>
+#endif
+
+#include "clamav.hxx"
+
+/*!\def ENGINE_DEFAULT_RELOAD
+   \brief Default interval of signature database checks (in seconds)
+*/
+#define ENGINE_DEFAULT_RELOAD 600
+
+namespace clamfs {
+
+using namespace std;
+using namespace Poco;
+
+/*!\class ClamEngine
+   \brief In-process libclamav scan engine (mode="libclamav")
+
+   Scans are done in calling thread (FUSE or background scanner one)
+   with cl_scandesc() on already open descriptor, so no clamd round
+   trip and no reply parsing is needed. All threads share one compiled
+   cl_engine, number of scans running at once is limited. Separate
+   thread checks signature database and compiles new engine when it
+   changes; new engine is swapped in atomically and old one is freed
+   (by libclamav reference counting) after scans using it complete.
+*/
+class ClamEngine: public Runnable {
+    public:
+        /*!\brief Constructor for ClamEngine
+           \param database signature database directory (NULL for libclamav default)
+           \param reload interval of database checks in seconds (0 disables reload)
+           \param threads maximal number of scans running at once
+        */
+        ClamEngine(const char* database, long reload, unsigned int threads);
+        /*!\brief Destructor for ClamEngine */
+        virtual ~ClamEngine();
+
+        /*!\brief Initializes libclamav and loads signature database
+           \returns true on success
+        */
+        bool load();
+        /*!\brief Starts database reload thread */
+        void start();
+        /*!\brief Stops database reload thread */
+        void stop();
+
+        /*!\brief Scans open file
+           \param filename name of file (used in reply)
+           \param fd readable file descriptor of file to scan
+           \param size size of file
+           \param ranges file ranges to scan (partial scan) or NULL to scan whole file
+           \param progress receives end of data already read by engine or NULL
+           \param reply clamd-like reply ("name: Virus FOUND" or "name: error ERROR",
+                        left untouched if file is clean)
+           \returns classification of reply
+        */
+        clamd_reply scan(const char* filename, int fd, off_t size,
+                         const vector<ScanRange>* ranges, ScanProgress* progress,
+                         string& reply);
+
+        /*!\brief Returns version of signature database used (0 if unknown) */
+        unsigned long version();
+
+        /*!\brief Database reload thread main loop */
+        virtual void run();
+
+    private:
+        /*!\brief Forbid usage of copy constructor */
+        ClamEngine(const ClamEngine& aClamEngine);
+        /*!\brief Forbid usage of assignment operator */
+        ClamEngine& operator = (const ClamEngine& aClamEngine);
+
+        /*!\brief Loads and compiles signature database
+           \param signatures number of signatures loaded
+           \returns compiled engine or NULL on error
+        */
+        struct cl_engine* build(unsigned int& signatures);
+        /*!\brief Compiles new engine and swaps it in (keeps old one on error) */
+        void reload();
+        /*!\brief Returns current engine with reference held by caller */
+        struct cl_engine* acquire();
+
+        /*!\brief signature database directory */
+        string database;
+        /*!\brief interval of database checks in ms */
+        long interval;
+        /*!\brief maximal number of scans running at once */
+        unsigned int maxScans;
+
+        /*!\brief current engine */
+        struct cl_engine* current;
+        /*!\brief protects current */
+        FastMutex engineMutex;
+        /*!\brief state of database directory engine was built from */
+        struct cl_stat dbstat;
+
+        /*!\brief number of scans running */
+        unsigned int running;
+        /*!\brief protects running */
+        FastMutex gateMutex;
+        /*!\brief signalled when scan completes */
+        Condition gateFree;
+
+        /*!\brief protects stopping */
+        FastMutex threadMutex;
+        /*!\brief signalled when thread is stopped */
+        Condition wakeup;
+        /*!\brief stop request flag */
+        bool stopping;
+        /*!\brief database reload thread */
+        Thread thread;
+};
+
+/*!\brief extern to access engine pointer (NULL unless mode="libclamav") */
+extern ClamEngine* engine;
+
+} /* namespace clamfs */
+
+#endif /* HAVE_LIBCLAMAV */
+
+#endif /* CLAMFS_CLAMENGINE_HXX */
+
+/* EoF */
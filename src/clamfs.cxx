@@ -55,6 +55,7 @@ extern "C"{
 }
 #endif
 #include <boost/shared_array.hpp>
+#include <Poco/Environment.h>
 
 #include "clamfs.hxx"
 #include "utils.hxx"
@@ -76,14 +77,36 @@ namespace clamfs {
 static int savefd;
 /*!\brief Stores all configuration options names and values */
 config_t config;
+/*!\brief Stores options of each <filesystem> element */
+vector<config_t> filesystems;
 /*!\brief ScanCache instance */
 ScanCache *cache = NULL;
 /*!\brief Stats instance */
 Stats *stats = NULL;
+/*!\brief MailNotifier instance */
+MailNotifier *notifier = NULL;
 /*!\brief Stores whitelisted and blacklisted file extensions */
-extum_t *extensions = NULL;
-/*!\brief Mutex need to serialize access to clamd */
-FastMutex scanMutex;
+ExtensionACL *extensions = NULL;
+/*!\brief Stores path policy rules */
+PathPolicy *policy = NULL;
+/*!\brief AsyncScanner instance (allow-then-verify mode) */
+AsyncScanner *scanner = NULL;
+/*!\brief ScanAhead instance (scan-ahead of listed directories) */
+ScanAhead *scanahead = NULL;
+/*!\brief AccessHistory instance (prediction of next opened files) */
+AccessHistory *history = NULL;
+#ifdef F_OFD_SETLK
+/*!\brief LockOwners instance (POSIX locks kept as OFD locks) */
+LockOwners *locks = NULL;
+#endif
+#ifdef HAVE_LIBCLAMAV
+/*!\brief ClamEngine instance (mode="libclamav") */
+ClamEngine *engine = NULL;
+#endif
+/*!\brief ClamdClient instance (all modes but libclamav) */
+ClamdClient *client = NULL;
+/*!\brief ClamdBreaker instance (all modes but libclamav) */
+ClamdBreaker *breaker = NULL;
 
 extern "C" {
 
@@ -99,14 +122,14 @@ static inline const char* fixpath(const char* path)
 
     if (res < 0)
     {
-        char* username = getusername();
-        char* callername = getcallername();
+        char username[USERNAME_MAX];
+        char callername[CALLERNAME_MAX];
+        getusername(username, sizeof(username));
+        getcallername(callername, sizeof(callername));
         Logger& logger = Logger::root();
         poco_warning_f(logger, "(%s:%d) (%s:%u) %s: fchdir() failed: %s",
                 string(callername), fuse_get_context()->pid, string(username), fuse_get_context()->uid,
                 path, strerror(errno));
-        free(username);
-        free(callername);
     }
 
     strcpy(fixed,".");
@@ -118,7 +141,8 @@ static inline const char* fixpath(const char* path)
 static void *clamfs_init(struct fuse_conn_info *conn,
                          struct fuse_config *cfg)
 {
-    (void) conn;
+    NegotiateConnection(conn, false);
+    ConfigureDirListing();
     cfg->use_ino = 1;
     cfg->nullpath_ok = 1;
 
@@ -133,6 +157,22 @@ static void *clamfs_init(struct fuse_conn_info *conn,
     cfg->attr_timeout = 0;
     cfg->negative_timeout = 0;
 
+    /* Start threads here, as fuse_main() forks before calling init */
+    if (notifier)
+        notifier->start();
+    if (scanner)
+        scanner->start();
+    if (scanahead)
+        scanahead->start();
+    if (client)
+        client->start();
+    if (breaker)
+        breaker->start();
+#ifdef HAVE_LIBCLAMAV
+    if (engine)
+        engine->start();
+#endif
+
     return NULL;
 }
 
@@ -201,12 +241,6 @@ static int clamfs_readlink(const char *path, char *buf, size_t size)
     return 0;
 }
 
-struct clamfs_dirp {
-    DIR *dp;
-    struct dirent *entry;
-    off_t offset;
-};
-
 /*!\brief FUSE opendir() callback
    \param path directory path
    \param fi information about open files
@@ -214,34 +248,23 @@ struct clamfs_dirp {
 */
 static int clamfs_opendir(const char *path, struct fuse_file_info *fi)
 {
-    int res;
-
-    struct clamfs_dirp *d = (clamfs_dirp*)malloc(sizeof(struct clamfs_dirp));
-    if (d == NULL)
-        return -ENOMEM;
-
     const char* fpath = fixpath(path);
-    d->dp = opendir(fpath);
+    int fd = open(fpath, O_RDONLY | O_DIRECTORY);
     delete[] fpath;
-    if (d->dp == NULL) {
-        res = -errno;
-        free(d);
-        return res;
-    }
-    d->offset = 0;
-    d->entry = NULL;
+    if (fd == -1)
+        return -errno;
 
-    fi->fh = (unsigned long) d;
+    fi->fh = (unsigned long) new DirListing(fd);
     return 0;
 }
 
-/*!\brief Returns directory pointer from fuse_file_info
+/*!\brief Returns directory listing from fuse_file_info
    \param fi information about open files
-   \returns pointer to file handle
+   \returns pointer to directory listing
 */
-static inline clamfs_dirp *get_dirp(struct fuse_file_info *fi)
+static inline DirListing *get_dirp(struct fuse_file_info *fi)
 {
-    return (clamfs_dirp *) (uintptr_t) fi->fh;
+    return (DirListing *) (uintptr_t) fi->fh;
 }
 
 /*!\brief FUSE readdir() callback
@@ -251,70 +274,55 @@ static inline clamfs_dirp *get_dirp(struct fuse_file_info *fi)
    \param offset directory pointer offset
    \param fi information about open files
    \param flags flags fuse want to pass to readdir
-   \returns always 0
+   \returns 0 or -errno if directory cannot be read
 */
 static int clamfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
                           off_t offset, struct fuse_file_info *fi,
                           enum fuse_readdir_flags flags)
 {
-    struct clamfs_dirp *d = get_dirp(fi);
+    DirListing *d = get_dirp(fi);
+    off_t first = offset;
+    vector<ahead_entry> files;
+    int res;
 
     (void) path;
-    if (offset != d->offset) {
-#ifndef __FreeBSD__
-        seekdir(d->dp, offset);
-#else
-        /* Subtract the one that we add when calling
-           telldir() below */
-        seekdir(d->dp, offset-1);
-#endif
-        d->entry = NULL;
-        d->offset = offset;
-    }
     while (1) {
         struct stat st;
-        off_t nextoff;
+        dirlist_entry entry;
         int fill_flags = 0;
 
-        if (!d->entry) {
-            d->entry = readdir(d->dp);
-            if (!d->entry)
-                break;
-        }
-#ifdef HAVE_FSTATAT
-        if (flags & FUSE_READDIR_PLUS) {
-            int res;
-
-            res = fstatat(dirfd(d->dp), d->entry->d_name, &st,
-                      AT_SYMLINK_NOFOLLOW);
-            if (res != -1)
-                fill_flags |= FUSE_FILL_DIR_PLUS;
+        res = d->get(offset, entry);
+        if (res <= 0) {
+            /* report error only if nothing has been read yet */
+            if (offset != first)
+                res = 0;
+            break;
         }
-#else
-        (void) flags;
-#endif
+        if ((flags & FUSE_READDIR_PLUS) && (d->attributes(offset, &st) == 0))
+            fill_flags |= FUSE_FILL_DIR_PLUS;
         if (!(fill_flags & FUSE_FILL_DIR_PLUS)) {
             memset(&st, 0, sizeof(st));
-            st.st_ino = d->entry->d_ino;
-            st.st_mode = (unsigned int)d->entry->d_type << 12;
+            st.st_ino = entry.ino;
+            st.st_mode = (unsigned int)entry.type << 12;
         }
-        nextoff = telldir(d->dp);
-#ifdef __FreeBSD__
-        /* Under FreeBSD, telldir() may return 0 the first time
-           it is called. But for libfuse, an offset of zero
-           means that offsets are not supported, so we shift
-           everything by one. */
-        nextoff++;
-#endif
-        if (filler(buf, d->entry->d_name, &st, nextoff,
-                   (fuse_fill_dir_flags)fill_flags))
+        /* offset of entry is its index in listing, so next one is + 1 */
+        if (filler(buf, entry.name, &st, offset + 1,
+                   (fuse_fill_dir_flags)fill_flags)) {
+            res = 0;
             break;
-
-        d->entry = NULL;
-        d->offset = nextoff;
+        }
+        if ((scanahead != NULL) && ((entry.type == DT_REG) || (entry.type == DT_UNKNOWN))) {
+            ahead_entry file;
+            file.name = entry.name;
+            file.ino = entry.ino;
+            files.push_back(file);
+        }
+        ++offset;
     }
 
-    return 0;
+    if (!files.empty())
+        scanahead->listed(d->fd(), files, fuse_get_context());
+    return res;
 }
 
 /*!\brief FUSE releasedir() callback
@@ -324,10 +332,8 @@ static int clamfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
 */
 static int clamfs_releasedir(const char *path, struct fuse_file_info *fi)
 {
-    struct clamfs_dirp *d = get_dirp(fi);
     (void) path;
-    closedir(d->dp);
-    free(d);
+    delete get_dirp(fi);
     return 0;
 }
 
@@ -608,6 +614,7 @@ static int clamfs_create(const char *path, mode_t mode, struct fuse_file_info *f
     int res;
     int fd;
 
+    AdjustOpenFlags(fi);
     const char* fpath = fixpath(path);
     fd = open(fpath, fi->flags, mode);
     if (fd == -1)
@@ -621,55 +628,39 @@ static int clamfs_create(const char *path, mode_t mode, struct fuse_file_info *f
 
     if (res < 0)
     {
-        char* username = getusername();
-        char* callername = getcallername();
+        char username[USERNAME_MAX];
+        char callername[CALLERNAME_MAX];
+        getusername(username, sizeof(username));
+        getcallername(callername, sizeof(callername));
         Logger& logger = Logger::root();
         poco_warning_f(logger, "(%s:%d) (%s:%u) %s: lchown() failed: %s",
                 string(callername), fuse_get_context()->pid, string(username), fuse_get_context()->uid,
                 path, strerror(errno));
-        free(username);
-        free(callername);
     }
 
     fi->fh = (unsigned long) fd;
     return 0;
 }
 
-/*!\brief Opens file and returns it file descriptor by fi->fh
+/*!\brief Opens file relative to saved base directory descriptor
    \param path file path
-   \param fi information about open files
-   \returns 0 if open() returns without error on -errno otherwise
+   \param flags open() flags
+   \returns file descriptor or -1 on error (errno is set)
 */
-static inline int open_backend(const char *path, struct fuse_file_info *fi)
+static inline int open_backend(const char *path, int flags)
 {
-    int fd;
-
-    const char* fpath = fixpath(path);
-    fd = open(fpath, fi->flags);
-    delete[] fpath;
-    if (fd == -1)
-        return -errno;
-
-    fi->fh = (unsigned long) fd;
-    return 0;
+    return openat(savefd, (path[1] == '\0') ? "." : path + 1, flags);
 }
 
 /*!\brief FUSE open() callback
    \param path file path
    \param fi information about open files
-   \returns result of open_backend() call or -EPERM if virus is detected
+   \returns 0 on success, -errno if file cannot be opened or -EPERM if virus is detected
 */
 static int clamfs_open(const char *path, struct fuse_file_info *fi)
 {
-    int ret = 1;
-    bool file_is_blacklisted = false;
-    int scan_result;
-    struct stat file_stat;
-
     INC_STAT_COUNTER(openCalled);
 
-    Logger& logger = Logger::root();
-
     /*
      * Dump stats to log periodically
      */
@@ -678,191 +669,19 @@ static int clamfs_open(const char *path, struct fuse_file_info *fi)
     }
 
     /*
-     * Build file path in real filesystem tree
-     */
-    shared_array<char> real_path(new char[strlen(config["root"])+strlen(path)+1]);
-    strcpy(real_path.get(), config["root"]);
-    strcat(real_path.get(), path);
-
-    /*
-     * Check extension ACL
-     */
-    if (extensions != NULL) {
-        const char *ext = rindex(path, '.'); /* find last dot */
-        if (ext != NULL) {
-            ++ext; /* omit dot */
-            extum_t::const_iterator extumConstIter;
-            extumConstIter = extensions->find(ext);
-            if (extumConstIter != extensions->end()) {
-                switch (extumConstIter->second) {
-                    case whitelisted:
-                        {
-                            INC_STAT_COUNTER(whitelistHit);
-                            char* username = getusername();
-                            char* callername = getcallername();
-                            poco_warning_f(logger, "(%s:%d) (%s:%u) %s: excluded from anti-virus scan because extension whitelisted ",
-                                    string(callername), fuse_get_context()->pid, string(username), fuse_get_context()->uid, string(path));
-                            free(username);
-                            free(callername);
-                            INC_STAT_COUNTER(openAllowed);
-                            return open_backend(path, fi);
-                        }
-                    case blacklisted:
-                        {
-                            INC_STAT_COUNTER(blacklistHit);
-                            file_is_blacklisted = true;
-                            char* username = getusername();
-                            char* callername = getcallername();
-                            poco_warning_f(logger, "(%s:%d) (%s:%u) %s: forced anti-virus scan because extension blacklisted ",
-                                    string(callername), fuse_get_context()->pid, string(username), fuse_get_context()->uid, string(path));
-                            free(username);
-                            free(callername);
-                            break;
-                        }
-                    default:
-                        {
-                           poco_debug(logger, "Extension found in unordered_map, but with unknown ACL type");
-                        }
-                }
-            } else {
-                poco_debug(logger, "Extension not found in unordered_map");
-            }
-        }
-    }
-
-    /*
-     * Check file size (if option defined)
+     * Open backing file once, the same descriptor is scanned and handed
+     * to FUSE (O_TRUNC is applied only after file is allowed, write only
+     * opens get separate read only descriptor for scan)
      */
-    if ((config["maximal-size"] != NULL) && (file_is_blacklisted == false)) {
-        ret = lstat(real_path.get(), &file_stat);
-        if (!ret) { /* got file stat without error */
-            if (file_stat.st_size > atoi(config["maximal-size"])) { /* file too big */
-                INC_STAT_COUNTER(tooBigFile);
-                char* username = getusername();
-                char* callername = getcallername();
-                poco_warning_f(logger, "(%s:%d) (%s:%u) %s: excluded from anti-virus scan because file is too big (file size: %ld bytes)",
-                        string(callername), fuse_get_context()->pid, string(username), fuse_get_context()->uid, path, (long int)file_stat.st_size);
-                free(username);
-                free(callername);
-                INC_STAT_COUNTER(openAllowed);
-                return open_backend(path, fi);
-            }
-        }
-    }
-
-    /*
-     * Check if file is in cache
-     */
-    if (cache != NULL) { /* only if cache initalized */
-        if (ret)
-            ret = lstat(real_path.get(), &file_stat);
-        if (!ret) { /* got file stat without error */
-
-            SharedPtr<CachedResult> ptr_val;
-
-            if ((ptr_val = cache->get(file_stat.st_ino))) {
-                INC_STAT_COUNTER(earlyCacheHit);
-                poco_debug_f1(logger, "early cache hit for inode %lu", (unsigned long)file_stat.st_ino);
-
-                if (ptr_val->scanTimestamp == file_stat.st_mtime) {
-                    INC_STAT_COUNTER(lateCacheHit);
-                    poco_debug_f1(logger, "late cache hit for inode %lu", (unsigned long)file_stat.st_ino);
-
-                    /* file scanned and not changed, was it clean? */
-                    if (ptr_val->isClean) {
-                        INC_STAT_COUNTER(openAllowed);
-                        return open_backend(path, fi); /* Yes, it was */
-                    } else {
-                        INC_STAT_COUNTER(openDenied);
-                        return -EPERM; /* No, that file was infected */
-                    }
-                } else {
-                    INC_STAT_COUNTER(lateCacheMiss);
-                    poco_debug_f1(logger, "late cache miss for inode %lu", (unsigned long)file_stat.st_ino);
-
-                    /*
-                     * Scan file when file it was changed
-                     */
-                    scan_result = ClamavScanFile(real_path.get());
-
-                    /*
-                     * Check for scan results and update cache
-                     */
-                    ptr_val->scanTimestamp = file_stat.st_mtime;
-                    if (scan_result == 1) { /* virus found */
-                        ptr_val->isClean = false;
-                        INC_STAT_COUNTER(openDenied);
-                        return -EPERM;
-                    } else if(scan_result == 0) {
-                        ptr_val->isClean = true;
-                        INC_STAT_COUNTER(openAllowed);
-                        /* file is clean, open it */
-                        return open_backend(path, fi);
-                    } else {
-                        INC_STAT_COUNTER(scanFailed);
-                        INC_STAT_COUNTER(openDenied);
-                        cache->remove(file_stat.st_ino);
-                        return -EPERM;
-                    }
-                }
-
-            } else {
-                INC_STAT_COUNTER(earlyCacheMiss);
-                poco_debug_f1(logger, "early cache miss for inode %lu", (unsigned long)file_stat.st_ino);
-
-                /*
-                 * Scan file when file is not in cache
-                 */
-                scan_result = ClamavScanFile(real_path.get());
-
-                /*
-                 * Check for scan results
-                 */
-                if (scan_result == 1) { /* virus found */
-                    CachedResult result(false, file_stat.st_mtime);
-                    cache->add(file_stat.st_ino, result);
-                    INC_STAT_COUNTER(openDenied);
-                    return -EPERM;
-                } else if(scan_result == 0) {
-                    CachedResult result(true, file_stat.st_mtime);
-                    cache->add(file_stat.st_ino, result);
-                    INC_STAT_COUNTER(openAllowed);
-                    /* file is clean, open it */
-                    return open_backend(path, fi);
-                } else {
-                    INC_STAT_COUNTER(scanFailed);
-                    INC_STAT_COUNTER(openDenied);
-                    cache->remove(file_stat.st_ino);
-                    return -EPERM;
-                }
-
-            }
-
-        }
-    }
-
-    /*
-     * Scan file when cache is not available
-     */
-    scan_result = ClamavScanFile(real_path.get());
-
-    /*
-     * Check for scan results
-     */
-    if (scan_result == 1) { /* return -EPERM error if virus was found */
-        INC_STAT_COUNTER(openDenied);
-        return -EPERM;
-    } else if(scan_result != 0) {
-        INC_STAT_COUNTER(scanFailed);
-        INC_STAT_COUNTER(openDenied);
-        return -EPERM;
-    }
+    AdjustOpenFlags(fi);
+    int fd = open_backend(path, fi->flags & ~O_TRUNC);
+    if (fd == -1)
+        return -errno;
+    int scanfd = fd;
+    if ((fi->flags & O_ACCMODE) == O_WRONLY)
+        scanfd = open_backend(path, O_RDONLY);
 
-    /*
-     * If no virus detected continue as usual
-     */
-    INC_STAT_COUNTER(openAllowed);
-    return open_backend(path, fi);
+    return CheckOpenedFile(config["root"], path, fi, fd, scanfd, fuse_get_context());
 }
 
 /*!\brief FUSE read() callback
@@ -879,6 +698,11 @@ static int clamfs_read(const char *path, char *buf, size_t size, off_t offset,
     ssize_t res;
 
     (void) path;
+    if (scanner) {
+        res = scanner->checkRead((int)fi->fh, offset, size);
+        if (res != 0)
+            return (int)res;
+    }
     res = pread((int)fi->fh, buf, size, offset);
     if (res == -1)
         res = -errno;
@@ -893,6 +717,12 @@ static int clamfs_read_buf(const char *path, struct fuse_bufvec **bufp,
 
     (void) path;
 
+    if (scanner) {
+        int res = scanner->checkRead((int)fi->fh, offset, size);
+        if (res != 0)
+            return res;
+    }
+
     src = (fuse_bufvec*)malloc(sizeof(struct fuse_bufvec));
     if (src == NULL)
         return -ENOMEM;
@@ -905,6 +735,8 @@ static int clamfs_read_buf(const char *path, struct fuse_bufvec **bufp,
 
     *bufp = src;
 
+    /* data is read after return, count requested size */
+    OperationScope::moved(size);
     return 0;
 }
 
@@ -986,6 +818,12 @@ static int clamfs_flush(const char *path, struct fuse_file_info *fi)
 static int clamfs_release(const char *path, struct fuse_file_info *fi)
 {
     (void) path;
+    if (scanner)
+        scanner->release((int)fi->fh);
+#ifdef F_OFD_SETLK
+    if (locks)
+        locks->release((int)fi->fh);
+#endif
     close((int)fi->fh);
 
     return 0;
@@ -1104,14 +942,29 @@ static int clamfs_removexattr(const char *path, const char *name)
 }
 #endif /* HAVE_SETXATTR */
 
-#ifdef HAVE_LIBULOCKMGR
+#if defined(HAVE_LIBULOCKMGR) || defined(F_OFD_SETLK)
+/*!\brief FUSE lock() callback
+   \param path file path
+   \param fi information about open files
+   \param cmd F_GETLK, F_SETLK or F_SETLKW
+   \param lock lock to test or set
+   \returns 0 on success or -errno otherwise
+*/
 static int clamfs_lock(const char *path, struct fuse_file_info *fi, int cmd,
                     struct flock *lock)
 {
     (void) path;
 
+#ifdef F_OFD_SETLK
+    if (locks)
+        return locks->lock((int)fi->fh, fi->lock_owner, cmd, lock, NULL);
+#endif
+#ifdef HAVE_LIBULOCKMGR
     return ulockmgr_op((int)fi->fh, cmd, lock, &fi->lock_owner,
                sizeof(fi->lock_owner));
+#else
+    return -ENOLCK;
+#endif
 }
 #endif
 
@@ -1138,6 +991,13 @@ static ssize_t clamfs_copy_file_range(const char *path_in,
     (void) path_in;
     (void) path_out;
 
+    /* copied data must pass the same verdict check as read */
+    if (scanner) {
+        int err = scanner->checkRead((int)fi_in->fh, off_in, len);
+        if (err != 0)
+            return err;
+    }
+
     res = copy_file_range((int)fi_in->fh, &off_in, (int)fi_out->fh,
                           &off_out, len, (unsigned int)flags);
     if (res == -1)
@@ -1164,6 +1024,66 @@ static off_t clamfs_lseek(const char *path, off_t off, int whence,
 
 } /* extern "C" */
 
+/*!\brief Builds argv for libFUSE
+   \param fs options of file system (mountpoint, public, nonempty, readonly)
+   \param progname program name
+   \param fuse_argc arguments counter
+   \returns arguments array (free with free_fuse_args())
+*/
+static char **build_fuse_args(config_t& fs, const char *progname, int& fuse_argc)
+{
+    char **fuse_argv = new char *[FUSE_MAX_ARGS];
+    memset(fuse_argv, 0, FUSE_MAX_ARGS * sizeof(char *)); /* set pointers to NULL */
+    fuse_argc = 0;
+    fuse_argv[fuse_argc++] = strdup(progname); /* copy program name */
+    fuse_argv[fuse_argc++] = strdup(fs["mountpoint"]); /* set mountpoint */
+
+    if ((fs["public"] != NULL) && /* public */
+        (strncmp(fs["public"], "yes", 3) == 0)) {
+        fuse_argv[fuse_argc++] = strdup("-o");
+        if ((fs["nonempty"] != NULL) && /* public and nonempty */
+            (strncmp(fs["nonempty"], "yes", 3) == 0)) {
+            fuse_argv[fuse_argc++] =
+                strdup("allow_other,default_permissions,nonempty");
+        } else { /* public without nonempty */
+            fuse_argv[fuse_argc++] = strdup("allow_other,default_permissions");
+        }
+    } else if ((fs["nonempty"] != NULL) && /* private and nonempty */
+        (strncmp(fs["nonempty"], "yes", 3) == 0)) {
+        fuse_argv[fuse_argc++] = strdup("-o");
+        fuse_argv[fuse_argc++] = strdup("nonempty");
+    } else {
+        fuse_argv[fuse_argc++] = strdup("-o");
+        fuse_argv[fuse_argc++] = strdup("default_permissions");
+    }
+
+    if ((fs["readonly"] != NULL) &&
+        (strncmp(fs["readonly"], "yes", 3) == 0))
+        fuse_argv[fuse_argc++] = strdup("-r");
+
+    /* debug options are common for all file systems */
+    if ((config["threads"] != NULL) &&
+        (strncmp(config["threads"], "no", 2) == 0))
+        fuse_argv[fuse_argc++] = strdup("-s");
+
+    if ((config["fork"] != NULL) &&
+        (strncmp(config["fork"], "no", 2) == 0))
+        fuse_argv[fuse_argc++] = strdup("-f");
+
+    return fuse_argv;
+}
+
+/*!\brief Frees argv built by build_fuse_args()
+   \param fuse_argv arguments array
+*/
+static void free_fuse_args(char **fuse_argv)
+{
+    for (unsigned int i = 0; i < FUSE_MAX_ARGS; ++i)
+        if (fuse_argv[i])
+            free(fuse_argv[i]);
+    delete[] fuse_argv;
+}
+
 } /* namespace clamfs */
 
 /*!\brief ClamFS main()
@@ -1184,54 +1104,58 @@ int main(int argc, char *argv[])
      */
     memset(&clamfs_oper, 0, sizeof(fuse_operations));
 
+    /*
+     * Callbacks (but init) are wrapped to count their calls, errors,
+     * bytes moved and latency for stats module
+     */
     clamfs_oper.init        = clamfs_init;
-    clamfs_oper.getattr     = clamfs_getattr;
-    clamfs_oper.access      = clamfs_access;
-    clamfs_oper.readlink    = clamfs_readlink;
-    clamfs_oper.opendir     = clamfs_opendir;
-    clamfs_oper.readdir     = clamfs_readdir;
-    clamfs_oper.releasedir  = clamfs_releasedir;
-    clamfs_oper.mknod       = clamfs_mknod;
-    clamfs_oper.mkdir       = clamfs_mkdir;
-    clamfs_oper.symlink     = clamfs_symlink;
-    clamfs_oper.unlink      = clamfs_unlink;
-    clamfs_oper.rmdir       = clamfs_rmdir;
-    clamfs_oper.rename      = clamfs_rename;
-    clamfs_oper.link        = clamfs_link;
-    clamfs_oper.chmod       = clamfs_chmod;
-    clamfs_oper.chown       = clamfs_chown;
-    clamfs_oper.truncate    = clamfs_truncate;
+    clamfs_oper.getattr     = INSTRUMENT(getattr, clamfs_getattr);
+    clamfs_oper.access      = INSTRUMENT(access, clamfs_access);
+    clamfs_oper.readlink    = INSTRUMENT(readlink, clamfs_readlink);
+    clamfs_oper.opendir     = INSTRUMENT(opendir, clamfs_opendir);
+    clamfs_oper.readdir     = INSTRUMENT(readdir, clamfs_readdir);
+    clamfs_oper.releasedir  = INSTRUMENT(releasedir, clamfs_releasedir);
+    clamfs_oper.mknod       = INSTRUMENT(mknod, clamfs_mknod);
+    clamfs_oper.mkdir       = INSTRUMENT(mkdir, clamfs_mkdir);
+    clamfs_oper.symlink     = INSTRUMENT(symlink, clamfs_symlink);
+    clamfs_oper.unlink      = INSTRUMENT(unlink, clamfs_unlink);
+    clamfs_oper.rmdir       = INSTRUMENT(rmdir, clamfs_rmdir);
+    clamfs_oper.rename      = INSTRUMENT(rename, clamfs_rename);
+    clamfs_oper.link        = INSTRUMENT(link, clamfs_link);
+    clamfs_oper.chmod       = INSTRUMENT(chmod, clamfs_chmod);
+    clamfs_oper.chown       = INSTRUMENT(chown, clamfs_chown);
+    clamfs_oper.truncate    = INSTRUMENT(truncate, clamfs_truncate);
 #ifdef HAVE_UTIMENSAT
-    clamfs_oper.utimens     = clamfs_utimens;
+    clamfs_oper.utimens     = INSTRUMENT(utimens, clamfs_utimens);
 #endif
-    clamfs_oper.create      = clamfs_create;
-    clamfs_oper.open        = clamfs_open;
-    clamfs_oper.read        = clamfs_read;
-    clamfs_oper.read_buf    = clamfs_read_buf;
-    clamfs_oper.write       = clamfs_write;
-    clamfs_oper.write_buf   = clamfs_write_buf;
-    clamfs_oper.statfs      = clamfs_statfs;
-    clamfs_oper.flush       = clamfs_flush;
-    clamfs_oper.release     = clamfs_release;
-    clamfs_oper.fsync       = clamfs_fsync;
+    clamfs_oper.create      = INSTRUMENT(create, clamfs_create);
+    clamfs_oper.open        = INSTRUMENT(open, clamfs_open);
+    clamfs_oper.read        = INSTRUMENT(read, clamfs_read);
+    clamfs_oper.read_buf    = INSTRUMENT(read_buf, clamfs_read_buf);
+    clamfs_oper.write       = INSTRUMENT(write, clamfs_write);
+    clamfs_oper.write_buf   = INSTRUMENT(write_buf, clamfs_write_buf);
+    clamfs_oper.statfs      = INSTRUMENT(statfs, clamfs_statfs);
+    clamfs_oper.flush       = INSTRUMENT(flush, clamfs_flush);
+    clamfs_oper.release     = INSTRUMENT(release, clamfs_release);
+    clamfs_oper.fsync       = INSTRUMENT(fsync, clamfs_fsync);
 #ifdef HAVE_POSIX_FALLOCATE
-    clamfs_oper.fallocate   = clamfs_fallocate;
+    clamfs_oper.fallocate   = INSTRUMENT(fallocate, clamfs_fallocate);
 #endif
 #ifdef HAVE_SETXATTR
-    clamfs_oper.setxattr    = clamfs_setxattr;
-    clamfs_oper.getxattr    = clamfs_getxattr;
-    clamfs_oper.listxattr   = clamfs_listxattr;
-    clamfs_oper.removexattr = clamfs_removexattr;
+    clamfs_oper.setxattr    = INSTRUMENT(setxattr, clamfs_setxattr);
+    clamfs_oper.getxattr    = INSTRUMENT(getxattr, clamfs_getxattr);
+    clamfs_oper.listxattr   = INSTRUMENT(listxattr, clamfs_listxattr);
+    clamfs_oper.removexattr = INSTRUMENT(removexattr, clamfs_removexattr);
 #endif
-#ifdef HAVE_LIBULOCKMGR
-    clamfs_oper.lock        = clamfs_lock;
+#if defined(HAVE_LIBULOCKMGR) || defined(F_OFD_SETLK)
+    clamfs_oper.lock        = INSTRUMENT(lock, clamfs_lock);
 #endif
-    clamfs_oper.flock       = clamfs_flock;
+    clamfs_oper.flock       = INSTRUMENT(flock, clamfs_flock);
 #ifdef HAVE_COPY_FILE_RANGE
-    clamfs_oper.copy_file_range = clamfs_copy_file_range;
+    clamfs_oper.copy_file_range = INSTRUMENT(copy_file_range, clamfs_copy_file_range);
 #endif
 #if HAVE_FUSE_LSEEK
-    clamfs_oper.lseek       = clamfs_lseek;
+    clamfs_oper.lseek       = INSTRUMENT(lseek, clamfs_lseek);
 #endif
 
     umask(0);
@@ -1261,6 +1185,10 @@ int main(int argc, char *argv[])
      * Load XML configuration file, parse it and fill in clamfs::config
      */
     ConfigParserXML cp(argv[1]);
+    if (!cp.parsed()) {
+        poco_warning_f1(logger, "Configuration file %s rejected", string(argv[1]));
+        return EXIT_FAILURE;
+    }
     if (config.size() == 0) {
         poco_warning(logger, "No configuration has been loaded");
         return EXIT_FAILURE;
@@ -1282,9 +1210,12 @@ int main(int argc, char *argv[])
 
     /*
      * Check if minimal set of configuration options has been defined
-     * (any other option can be omitted but this three are mandatory)
+     * (any other option can be omitted but this three are mandatory,
+     * socket is not used when files are scanned in process)
      */
-    if ((config["socket"] == NULL) ||
+    bool inprocess = (config["mode"] != NULL) &&
+                     (strncmp(config["mode"], "libclamav", 9) == 0);
+    if (((config["socket"] == NULL) && !inprocess) ||
         (config["root"] == NULL) ||
         (config["mountpoint"] == NULL)) {
         poco_warning(logger, "socket, root and mountpoint must be defined");
@@ -1292,61 +1223,81 @@ int main(int argc, char *argv[])
     }
 
     /*
-     * Build argv for libFUSE
+     * Several <filesystem> elements with root and mountpoint are served
+     * by one daemon (each one by its own FUSE session), otherwise all
+     * <filesystem> elements describe single file system (as before)
      */
-    fuse_argv = new char *[FUSE_MAX_ARGS];
-    memset(fuse_argv, 0, FUSE_MAX_ARGS * sizeof(char *)); /* set pointers to NULL */
-    fuse_argc = 0;
-    fuse_argv[fuse_argc++] = strdup(argv[0]); /* copy program name */
-    fuse_argv[fuse_argc++] = strdup(config["mountpoint"]); /* set mountpoint */
-
-    if ((config["public"] != NULL) && /* public */
-        (strncmp(config["public"], "yes", 3) == 0)) {
-        fuse_argv[fuse_argc++] = strdup("-o");
-        if ((config["nonempty"] != NULL) && /* public and nonempty */
-            (strncmp(config["nonempty"], "yes", 3) == 0)) {
-            fuse_argv[fuse_argc++] =
-                strdup("allow_other,default_permissions,nonempty");
-        } else { /* public without nonempty */
-            fuse_argv[fuse_argc++] = strdup("allow_other,default_permissions");
+    size_t mounts = 0;
+    for (size_t i = 0; i < filesystems.size(); ++i)
+        if ((filesystems[i]["root"] != NULL) && (filesystems[i]["mountpoint"] != NULL))
+            ++mounts;
+    if (mounts > 1) {
+        if (mounts != filesystems.size()) {
+            poco_warning(logger, "each filesystem must define root and mountpoint when several are served");
+            return EXIT_FAILURE;
+        }
+        if ((config["lowlevel"] == NULL) ||
+            (strncmp(config["lowlevel"], "yes", 3) != 0)) {
+            poco_information_f1(logger, "serving %z file systems needs low-level FUSE API, enabling it",
+                mounts);
+            config[strdup("lowlevel")] = strdup("yes");
         }
-    } else if ((config["nonempty"] != NULL) && /* private and nonempty */
-        (strncmp(config["nonempty"], "yes", 3) == 0)) {
-        fuse_argv[fuse_argc++] = strdup("-o");
-        fuse_argv[fuse_argc++] = strdup("nonempty");
-    } else {
-        fuse_argv[fuse_argc++] = strdup("-o");
-        fuse_argv[fuse_argc++] = strdup("default_permissions");
     }
 
-    if ((config["readonly"] != NULL) &&
-        (strncmp(config["readonly"], "yes", 3) == 0))
-        fuse_argv[fuse_argc++] = strdup("-r");
-
-    if ((config["threads"] != NULL) &&
-        (strncmp(config["threads"], "no", 2) == 0))
-        fuse_argv[fuse_argc++] = strdup("-s");
-
-    if ((config["fork"] != NULL) &&
-        (strncmp(config["fork"], "no", 2) == 0))
-        fuse_argv[fuse_argc++] = strdup("-f");
+    /*
+     * Build argv for libFUSE
+     */
+    fuse_argv = build_fuse_args(config, argv[0], fuse_argc);
 
     /*
      * Change our current directory to "root" of our filesystem
+     * (several file systems are served relative to their own roots)
      */
-    poco_information_f1(logger, "chdir to our 'root' (%s)", string(config["root"]));
-    if (chdir(config["root"]) < 0) {
-        int err = errno; /* copy errno to avoid overwriting it */
-        poco_warning_f1(logger, "chdir failed: %s", string(strerror(err)));
-        return err;
+    if (mounts <= 1) {
+        poco_information_f1(logger, "chdir to our 'root' (%s)", string(config["root"]));
+        if (chdir(config["root"]) < 0) {
+            int err = errno; /* copy errno to avoid overwriting it */
+            poco_warning_f1(logger, "chdir failed: %s", string(strerror(err)));
+            return err;
+        }
+        savefd = open(".", 0);
+    }
+
+    /*
+     * Load libclamav engine when files are scanned in process
+     */
+    if (inprocess) {
+#ifdef HAVE_LIBCLAMAV
+        long reload = ENGINE_DEFAULT_RELOAD;
+        if (config["reload"] != NULL)
+            reload = atol(config["reload"]);
+        unsigned int threads = Environment::processorCount();
+        if (config["engine-threads"] != NULL)
+            threads = (unsigned int)atol(config["engine-threads"]);
+        poco_information_f2(logger, "scanning in process with libclamav (%u scans at once, reload check every %ld s)",
+            threads, reload);
+        engine = new ClamEngine(config["database"], reload, threads);
+        if (!engine->load()) {
+            poco_warning(logger, "cannot start without virus database, make sure it is installed");
+            delete engine;
+            engine = NULL;
+            return EXIT_FAILURE;
+        }
+#else
+        poco_warning(logger, "mode=\"libclamav\" not available, ClamFS was built without --with-libclamav");
+        return EXIT_FAILURE;
+#endif
     }
-    savefd = open(".", 0);
 
     /*
      * Check if clamd is available for clamfs only if check option is not "no"
+     * (or "background", which mounts at once and waits for clamd in breaker)
      */
-    if ((config["check"] == NULL) ||
-        (strncmp(config["check"], "no", 2) != 0)) {
+    bool background = (config["check"] != NULL) &&
+                      (strncmp(config["check"], "background", 10) == 0);
+    if (!inprocess && !background &&
+        ((config["check"] == NULL) ||
+         (strncmp(config["check"], "no", 2) != 0))) {
         if ((ret = OpenClamav(config["socket"])) != 0) {
             poco_warning(logger, "cannot start without running clamd, make sure it works");
             return ret;
@@ -1359,6 +1310,60 @@ int main(int argc, char *argv[])
         CloseClamav();
     }
 
+    /*
+     * Initialize clamd client
+     */
+    if (!inprocess) {
+        unsigned int connections = CLAMD_DEFAULT_CONNECTIONS;
+        if (config["connections"] != NULL)
+            connections = (unsigned int)atol(config["connections"]);
+        unsigned int pipeline = CLAMD_DEFAULT_PIPELINE;
+        if (config["pipeline"] != NULL)
+            pipeline = (unsigned int)atol(config["pipeline"]);
+        poco_debug_f2(logger, "clamd client uses up to %u connections with %u requests each",
+            connections, pipeline);
+        client = new ClamdClient(config["socket"], connections, pipeline);
+
+        /*
+         * Bound time spent on single scan
+         */
+        long connectTimeout = (config["connect-timeout"] != NULL) ?
+            atol(config["connect-timeout"]) : CLAMD_DEFAULT_CONNECT_TIMEOUT;
+        long sendTimeout = (config["send-timeout"] != NULL) ?
+            atol(config["send-timeout"]) : CLAMD_DEFAULT_SEND_TIMEOUT;
+        long replyTimeout = (config["reply-timeout"] != NULL) ?
+            atol(config["reply-timeout"]) : CLAMD_DEFAULT_REPLY_TIMEOUT;
+        long replyPerMiB = (config["reply-timeout-per-mib"] != NULL) ?
+            atol(config["reply-timeout-per-mib"]) : CLAMD_DEFAULT_REPLY_PER_MIB;
+        client->setTimeouts(connectTimeout, sendTimeout, replyTimeout, replyPerMiB);
+
+        /*
+         * Stop waiting for clamd after sustained failures
+         */
+        unsigned int failures = BREAKER_DEFAULT_FAILURES;
+        if (config["failures"] != NULL)
+            failures = (unsigned int)atol(config["failures"]);
+        if ((failures == 0) && background) {
+            poco_warning(logger, "check=\"background\" needs circuit breaker, failures=\"0\" ignored");
+            failures = BREAKER_DEFAULT_FAILURES;
+        }
+        if (failures > 0) {
+            long probe = (config["probe"] != NULL) ? atol(config["probe"]) : BREAKER_DEFAULT_PROBE;
+            bool failOpen = (config["on-failure"] != NULL) &&
+                            (strncmp(config["on-failure"], "allow", 5) == 0);
+            long wait = (config["on-failure-wait"] != NULL) ? atol(config["on-failure-wait"]) : 0;
+            if (failOpen)
+                poco_warning(logger, "files will be allowed without scan while clamd is unavailable (on-failure=\"allow\")");
+            if (wait > 0)
+                poco_information_f1(logger, "scans wait up to %ld ms for unavailable clamd", wait);
+            breaker = new ClamdBreaker(config["socket"], failures, probe, failOpen, wait);
+
+            /* clamd is checked by breaker in background, once it runs */
+            if (background)
+                breaker->trip();
+        }
+    }
+
     /*
      * Initialize cache
      */
@@ -1381,6 +1386,33 @@ int main(int argc, char *argv[])
         poco_warning(logger, "ScanCache disabled, expect poor performance");
     }
 
+    /*
+     * Import verdicts of offline pre-scan (clamfs-prescan), but only
+     * if they were made with signatures used now
+     */
+    if ((cache != NULL) && (config["import"] != NULL)) {
+        unsigned long signatures = 0;
+#ifdef HAVE_LIBCLAMAV
+        if (engine != NULL)
+            signatures = engine->version();
+#endif
+        if (!inprocess) {
+            string version;
+            if ((OpenClamav(config["socket"]) == 0) && (VersionClamav(version) == 0))
+                signatures = ClamavSignatureVersion(version);
+            CloseClamav();
+        }
+        if (signatures == 0) {
+            poco_warning_f1(logger, "signatures version unknown, verdict database %s not imported",
+                string(config["import"]));
+        } else {
+            long imported = ImportVerdicts(config["import"], signatures, *cache);
+            if (imported > 0)
+                poco_information_f2(logger, "imported %ld verdicts from %s",
+                    imported, string(config["import"]));
+        }
+    }
+
     /*
      * Initialize stats
      */
@@ -1401,6 +1433,25 @@ int main(int argc, char *argv[])
         stats->enableMemoryStats();
     }
 
+    /*
+     * Initialize mail notifications
+     */
+    if ((config["server"] != NULL) &&
+        (config["to"] != NULL) &&
+        (config["from"] != NULL) &&
+        (config["subject"] != NULL)) {
+        long digest = (config["digest"] != NULL) ? atol(config["digest"]) : 10;
+        int retries = (config["retries"] != NULL) ? atoi(config["retries"]) : 3;
+        if ((digest < 0) || (retries < 0)) {
+            poco_warning(logger, "mail digest and retries values cannot be < 0");
+            return EXIT_FAILURE;
+        }
+        poco_information_f2(logger, "Mail notifications enabled (digest every %ld s, %d retries)",
+            digest, retries);
+        notifier = new MailNotifier(config["server"], config["to"],
+            config["from"], config["subject"], digest * 1000, retries);
+    }
+
     /*
      * Open configured logging target
      */
@@ -1417,6 +1468,103 @@ int main(int argc, char *argv[])
         }
     }
 
+    /*
+     * Compile path policy
+     */
+    if (policy != NULL) {
+        if (!policy->compile()) {
+            poco_warning(logger, "path policy rules are too complex to compile");
+            return EXIT_FAILURE;
+        }
+        poco_information_f2(logger, "path policy has %z rules (%z automaton states)",
+            policy->size(), policy->states());
+    }
+
+    /*
+     * Start background scanner if any path is opened in allow-then-verify mode
+     */
+    if ((policy != NULL) && policy->uses(policy_verify)) {
+        verify_reads mode = reads_serve;
+        if (config["verify-reads"] != NULL) {
+            if (strncmp(config["verify-reads"], "block", 5) == 0)
+                mode = reads_block;
+            else if (strncmp(config["verify-reads"], "stream", 6) == 0)
+                mode = reads_stream;
+        }
+        unsigned int threadCount = (config["verify-threads"] != NULL) ?
+            (unsigned int)atoi(config["verify-threads"]) : ASYNCSCAN_DEFAULT_THREADS;
+        poco_information_f2(logger, "allow-then-verify enabled (%s reads while scan is pending, %u threads)",
+            string((mode == reads_serve) ? "serving" : (mode == reads_block) ? "blocking" : "scan-ahead gated"),
+            threadCount);
+        scanner = new AsyncScanner(mode, threadCount);
+    }
+
+    /*
+     * Start speculative scan of files in listed directories
+     */
+    if ((config["ahead-size"] != NULL) && (atoll(config["ahead-size"]) > 0)) {
+        if (cache == NULL) {
+            poco_warning(logger, "scan-ahead needs scan cache, disabled");
+        } else {
+            size_t entries = (config["ahead-entries"] != NULL) ?
+                strtoul(config["ahead-entries"], NULL, 10) : SCANAHEAD_DEFAULT_ENTRIES;
+            long ttl = (config["ahead-ttl"] != NULL) ?
+                atol(config["ahead-ttl"]) : SCANAHEAD_DEFAULT_TTL;
+            bool listing = (config["ahead-listing"] == NULL) ||
+                (strncmp(config["ahead-listing"], "no", 2) != 0);
+            if (listing)
+                poco_information_f3(logger, "scan-ahead of listed directories enabled (files up to %s bytes, %z waiting, %ld ms TTL)",
+                    string(config["ahead-size"]), entries, ttl);
+            scanahead = new ScanAhead((off_t)atoll(config["ahead-size"]), entries, ttl, listing);
+
+            /*
+             * Predict next opened files from access history
+             */
+            if (config["ahead-history"] != NULL) {
+                size_t history_entries = (config["ahead-history-entries"] != NULL) ?
+                    strtoul(config["ahead-history-entries"], NULL, 10) : HISTORY_DEFAULT_ENTRIES;
+                size_t predict = (config["ahead-predict"] != NULL) ?
+                    strtoul(config["ahead-predict"], NULL, 10) : HISTORY_DEFAULT_PREDICT;
+                history = new AccessHistory(history_entries, predict);
+                long loaded = history->load(config["ahead-history"]);
+                if (loaded >= 0)
+                    poco_information_f3(logger, "predicting up to %z files on open, %ld transitions loaded from %s",
+                        predict, loaded, string(config["ahead-history"]));
+            }
+        }
+    }
+
+    /*
+     * Choose how POSIX record locks are kept: as OFD locks on backing
+     * files (default), by ulockmgr or by kernel for this mount only
+     */
+    const char* locking = (config["locks"] != NULL) ? config["locks"] : "ofd";
+    bool ofd = false;
+#ifdef F_OFD_SETLK
+    if (strncmp(locking, "ofd", 3) == 0) {
+        if (LockOwners::supported()) {
+            locks = new LockOwners();
+            ofd = true;
+        } else {
+            poco_warning(logger, "kernel does not support OFD locks, falling back to other locking");
+        }
+    }
+#endif
+#ifdef HAVE_LIBULOCKMGR
+    /* ulockmgr works with high-level API only */
+    bool ulockmgr = !ofd && (strncmp(locking, "local", 5) != 0) &&
+        ((config["lowlevel"] == NULL) || (strncmp(config["lowlevel"], "yes", 3) != 0));
+#else
+    bool ulockmgr = false;
+#endif
+#if defined(HAVE_LIBULOCKMGR) || defined(F_OFD_SETLK)
+    if (!ofd && !ulockmgr)
+        clamfs_oper.lock = NULL;
+#endif
+    poco_information_f1(logger, "POSIX locks kept %s",
+        string(ofd ? "as OFD locks on backing files" :
+               ulockmgr ? "by ulockmgr" : "by kernel (not visible below mount)"));
+
     /*
      * Print size of extensions ACL
      */
@@ -1427,12 +1575,94 @@ int main(int argc, char *argv[])
     /*
      * Start FUSE
      */
-    ret = fuse_main(fuse_argc, fuse_argv, &clamfs_oper, NULL);
+    if ((config["lowlevel"] != NULL) &&
+        (strncmp(config["lowlevel"], "yes", 3) == 0)) {
+        vector<lowlevel_mount> lowlevel_mounts;
+        vector<char **> mount_argvs;
+        if (mounts > 1) {
+            for (size_t i = 0; i < filesystems.size(); ++i) {
+                lowlevel_mount mount;
+                mount.root = filesystems[i]["root"];
+                mount.argv = build_fuse_args(filesystems[i], argv[0], mount.argc);
+                mount_argvs.push_back(mount.argv);
+                lowlevel_mounts.push_back(mount);
+            }
+        } else {
+            lowlevel_mount mount;
+            mount.root = config["root"];
+            mount.argc = fuse_argc;
+            mount.argv = fuse_argv;
+            lowlevel_mounts.push_back(mount);
+        }
+        poco_information(logger, "using low-level (inode based) FUSE API");
+        ret = LowLevelMain(lowlevel_mounts);
+        for (size_t i = 0; i < mount_argvs.size(); ++i)
+            free_fuse_args(mount_argvs[i]);
+    } else {
+        if ((config["passthrough"] != NULL) &&
+            (strncmp(config["passthrough"], "yes", 3) == 0))
+            poco_warning(logger, "passthrough needs low-level FUSE API (lowlevel=\"yes\"), option ignored");
+        ret = fuse_main(fuse_argc, fuse_argv, &clamfs_oper, NULL);
+    }
 
-    for (unsigned int i = 0; i < FUSE_MAX_ARGS; ++i)
-        if (fuse_argv[i])
-            free(fuse_argv[i]);
-    delete[] fuse_argv;
+    free_fuse_args(fuse_argv);
+
+    if (scanahead) {
+        poco_information(logger, "stopping scan-ahead");
+        scanahead->stop();
+        delete scanahead;
+        scanahead = NULL;
+    }
+
+#ifdef F_OFD_SETLK
+    if (locks) {
+        delete locks;
+        locks = NULL;
+    }
+#endif
+
+    if (history) {
+        poco_information_f1(logger, "saving access history to %s", string(config["ahead-history"]));
+        history->save(config["ahead-history"]);
+        delete history;
+        history = NULL;
+    }
+
+    if (scanner) {
+        poco_information(logger, "stopping background scanner");
+        scanner->stop();
+        delete scanner;
+        scanner = NULL;
+    }
+
+    if (breaker) {
+        breaker->stop();
+        delete breaker;
+        breaker = NULL;
+    }
+
+    if (client) {
+        poco_information(logger, "closing clamd connections");
+        client->stop();
+        delete client;
+        client = NULL;
+    }
+
+#ifdef HAVE_LIBCLAMAV
+    if (engine) {
+        poco_information(logger, "unloading libclamav engine");
+        engine->stop();
+        delete engine;
+        engine = NULL;
+    }
+#endif
+
+    if (notifier) {
+        poco_information(logger, "flushing mail notifications");
+        notifier->stop();
+        delete notifier;
+        notifier = NULL;
+    }
 
     if (cache) {
         poco_information(logger, "deleting cache");
@@ -1459,6 +1689,12 @@ int main(int argc, char *argv[])
         extensions = NULL;
     }
 
+    if (policy != NULL) {
+        poco_information(logger, "deleting path policy");
+        delete policy;
+        policy = NULL;
+    }
+
     poco_information(logger, "closing logging targets");
     poco_warning(logger,"exiting");
 #ifdef DMALLOC
@@ -28,6 +28,7 @@
 #include "config.h"
 
 #include <Poco/Mutex.h>
+#include <Poco/Timestamp.h>
 
 #ifdef DMALLOC
    #include <stdlib.h>
@@ -40,8 +41,21 @@
 #include "logger.hxx"
 #include "config.hxx"
 #include "clamav.hxx"
+#include "clamengine.hxx"
+#include "clamdclient.hxx"
+#include "breaker.hxx"
 #include "scancache.hxx"
+#include "verdictdb.hxx"
 #include "stats.hxx"
+#include "sniff.hxx"
+#include "asyncscan.hxx"
+#include "scanahead.hxx"
+#include "history.hxx"
+#include "openscan.hxx"
+#include "lowlevel.hxx"
+#include "fuseconn.hxx"
+#include "dirlist.hxx"
+#include "ofdlock.hxx"
 
 /*!\def FUSE_MAX_ARGS
    \brief Maximal value of FUSE arguments counter
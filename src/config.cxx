@@ -29,9 +29,11 @@
 namespace clamfs {
 
 extern config_t config;
-extern extum_t* extensions;
+extern vector<config_t> filesystems;
+extern ExtensionACL* extensions;
+extern PathPolicy* policy;
 
-ConfigParserXML::ConfigParserXML(const char *filename) {
+ConfigParserXML::ConfigParserXML(const char *filename): complete(true) {
     ConfigHandler handler;
     SAXParser parser;
 
@@ -51,7 +53,10 @@ ConfigParserXML::ConfigParserXML(const char *filename) {
     } catch (Exception &e) {
        Logger& logger = Logger::get("consoleLogger");
        poco_warning(logger, e.displayText().c_str());
+       complete = false;
     }
+    if (extensions != NULL)
+        extensions->compile();
 #ifndef NDEBUG
     cout << "--- end of xml dump ---" << endl;
 #endif
@@ -67,21 +72,45 @@ void ConfigHandler::startElement(const XMLString& uri, const XMLString& localNam
 #ifndef NDEBUG
     cout << "<" << qname;
 #endif
+    if (qname.compare("rule") == 0) {
+        addPathRule(attributes);
+#ifndef NDEBUG
+        for(int i = 0; i < attributes.getLength(); ++i)
+            cout << " " << attributes.getLocalName(i) << "=" << attributes.getValue(i);
+        cout << ">" << endl;
+#endif
+        return;
+    }
+
+    /* each <filesystem> is also kept apart, as daemon can serve several */
+    bool isFilesystem = (qname.compare("filesystem") == 0);
+    if (isFilesystem)
+        filesystems.push_back(config_t());
+
+    bool isRule = (qname.compare("exclude") == 0) || (qname.compare("include") == 0);
+    acl_item item = (qname.compare("exclude") == 0) ? whitelisted : blacklisted;
+    bool ignoreCase = false;
+    for(int i = 0; i < attributes.getLength(); ++i) {
+        if (attributes.getLocalName(i).compare("ignorecase") == 0)
+            ignoreCase = (attributes.getValue(i).compare(0, 3, "yes") == 0);
+    }
     for(int i = 0; i < attributes.getLength(); ++i) {
         const char *option;
         const char *value;
         option = attributes.getLocalName(i).c_str();
         value = attributes.getValue(i).c_str();
-        if (qname.compare("exclude") == 0) {
+        if (isRule) {
             if (extensions == NULL)
-                extensions = new extum_t;
-            (*extensions)[(const char *)value] = whitelisted;
-        } else if (qname.compare("include") == 0) {
-            if (extensions == NULL)
-                extensions = new extum_t;
-            (*extensions)[(const char *)value] = blacklisted;
-        } else
+                extensions = new ExtensionACL;
+            if (strcmp(option, "filename") == 0)
+                extensions->addFilename(value, item, ignoreCase);
+            else if (strcmp(option, "ignorecase") != 0)
+                extensions->addExtension(value, item, ignoreCase);
+        } else {
             config[strdup((const char *)option)] = strdup((const char *)value);
+            if (isFilesystem)
+                filesystems.back()[strdup((const char *)option)] = strdup((const char *)value);
+        }
 #ifndef NDEBUG
         cout << " " << option;
         cout << "=" << value;
@@ -92,6 +121,56 @@ void ConfigHandler::startElement(const XMLString& uri, const XMLString& localNam
 #endif
 }
 
+/*
+ * Append <rule prefix="" | glob="" action="" maximal-size="" /> to
+ * clamfs::policy
+ */
+void ConfigHandler::addPathRule(const Attributes& attributes) {
+    const char *prefix = NULL;
+    const char *glob = NULL;
+    policy_action action = policy_scan;
+    long long maximalSize = -1;
+
+    /* rule as written, to tell which one was rejected */
+    string rule = "<rule";
+    for(int i = 0; i < attributes.getLength(); ++i)
+        rule += " " + attributes.getLocalName(i) + "=\"" + attributes.getValue(i) + "\"";
+    rule += " />";
+
+    for(int i = 0; i < attributes.getLength(); ++i) {
+        const XMLString& option = attributes.getLocalName(i);
+        const XMLString& value = attributes.getValue(i);
+        if (option.compare("prefix") == 0) {
+            prefix = value.c_str();
+        } else if (option.compare("glob") == 0) {
+            glob = value.c_str();
+        } else if (option.compare("maximal-size") == 0) {
+            maximalSize = atoll(value.c_str());
+        } else if (option.compare("action") == 0) {
+            if (value.compare("scan") == 0)
+                action = policy_scan;
+            else if (value.compare("skip") == 0)
+                action = policy_skip;
+            else if (value.compare("force") == 0)
+                action = policy_force;
+            else if (value.compare("verify") == 0)
+                action = policy_verify;
+            else
+                throw Exception("unknown path rule action " + value + " in " + rule);
+        }
+    }
+
+    if ((prefix == NULL) == (glob == NULL))
+        throw Exception("path rule needs exactly one of prefix or glob: " + rule);
+
+    if (policy == NULL)
+        policy = new PathPolicy;
+    if (prefix != NULL)
+        policy->addPrefix(prefix, action, maximalSize);
+    else
+        policy->addGlob(glob, action, maximalSize);
+}
+
 /*
  * As long as our configuration file have no nested elements
  * we do not need to catch any element's end.
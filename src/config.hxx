@@ -28,8 +28,8 @@
 #include "config.h"
 
 #include <map>
+#include <vector>
 #include <cstring>
-#include <unordered_map>
 #include <Poco/SAX/SAXParser.h>
 #include <Poco/SAX/ContentHandler.h>
 #include <Poco/SAX/LexicalHandler.h>
@@ -47,6 +47,8 @@
 
 #include "logger.hxx"
 #include "utils.hxx"
+#include "extacl.hxx"
+#include "pathpolicy.hxx"
 
 namespace clamfs {
 
@@ -65,16 +67,6 @@ using Poco::Exception;
 */
 using namespace Poco::XML;
 
-/*!\enum acl_item
-   \brief Enumeration of Access List Items
-*/
-enum acl_item { none = 0, blacklisted, whitelisted };
-
-/*!\typedef extum_t
-   \brief Extension Unordered Map
-*/
-typedef unordered_map <string, acl_item> extum_t;
-
 /*!\typedef config_t
    \brief ClamFS Configuration
 */
@@ -105,6 +97,11 @@ class ConfigHandler: public ContentHandler { //, public LexicalHandler {
         virtual void endPrefixMapping(const Poco::XML::XMLString& prefix) { (void)prefix; }
         /**@}*/
     private:
+        /*!\brief Appends path policy rule to clamfs::policy
+           \param attributes attributes of <rule> element
+        */
+        void addPathRule(const Attributes& attributes);
+
         /*!brief Forbid usage of copy constructor */
         ConfigHandler(const ConfigHandler& aConfigHandler);
         /*!brief Forbid usage of assignment operator */
@@ -122,7 +119,15 @@ class ConfigParserXML {
         ConfigParserXML(const char *filename);
         /*!\brief Destructor for ConfigParserXML */
         virtual ~ConfigParserXML() { };
+
+        /*!\brief Returns true if whole configuration file was parsed
+           (parsing stops at first error, so rest of file is lost)
+        */
+        bool parsed() const { return complete; }
     private:
+        /*!\brief true if configuration file was parsed without error */
+        bool complete;
+
         /*!brief Forbid usage of copy constructor */
         ConfigParserXML(const ConfigParserXML& aConfigParserXML);
         /*!brief Forbid usage of assignment operator */
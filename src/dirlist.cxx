@@ -0,0 +1,295 @@
+/*!\file dirlist.cxx
+
+   \brief Batched directory listing
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "dirlist.hxx"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#endif
+
+#include "config.hxx"
+
+namespace clamfs {
+
+extern config_t config;
+
+/*!\brief Size of getdents64() buffer (in bytes) */
+static size_t batchSize = DIRLIST_DEFAULT_BATCH;
+/*!\brief true if readdirplus attributes are fetched with statx() */
+static bool useStatx = true;
+/*!\brief true if listing is reused when started over */
+static bool keepListing = true;
+
+#ifdef __linux__
+/*!\struct linux_dirent64
+   \brief Directory entry as returned by getdents64()
+*/
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/*!\def DIRLIST_MIN_BATCH
+   \brief Minimal size of getdents64() buffer (must fit any entry)
+*/
+#define DIRLIST_MIN_BATCH 4096
+#else
+/*!\def DIRLIST_READDIR_BATCH
+   \brief Number of entries read with readdir() at once
+*/
+#define DIRLIST_READDIR_BATCH 1024
+#endif
+
+/*!\brief Returns true if directory was not modified since snapshot */
+static inline bool unchanged(const struct stat& now, const struct stat& then)
+{
+    return (now.st_ino == then.st_ino) &&
+           (now.st_mtim.tv_sec == then.st_mtim.tv_sec) &&
+           (now.st_mtim.tv_nsec == then.st_mtim.tv_nsec) &&
+           (now.st_ctim.tv_sec == then.st_ctim.tv_sec) &&
+           (now.st_ctim.tv_nsec == then.st_ctim.tv_nsec);
+}
+
+/*!\brief Stats directory entry
+   \param dirfd descriptor of directory
+   \param name entry name
+   \param st attributes of entry
+   \returns 0 on success and -errno on error
+*/
+static int stat_entry(int dirfd, const char *name, struct stat *st)
+{
+#ifdef HAVE_STATX
+    if (useStatx) {
+        struct statx stx;
+
+        /* do not wait for network filesystems to revalidate attributes,
+           they are only a hint for the kernel attribute cache */
+        if (statx(dirfd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT | AT_STATX_DONT_SYNC,
+                  STATX_BASIC_STATS, &stx) == 0) {
+            memset(st, 0, sizeof(*st));
+            st->st_dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+            st->st_ino = stx.stx_ino;
+            st->st_mode = stx.stx_mode;
+            st->st_nlink = stx.stx_nlink;
+            st->st_uid = stx.stx_uid;
+            st->st_gid = stx.stx_gid;
+            st->st_rdev = makedev(stx.stx_rdev_major, stx.stx_rdev_minor);
+            st->st_size = stx.stx_size;
+            st->st_blksize = stx.stx_blksize;
+            st->st_blocks = stx.stx_blocks;
+            st->st_atim.tv_sec = stx.stx_atime.tv_sec;
+            st->st_atim.tv_nsec = stx.stx_atime.tv_nsec;
+            st->st_mtim.tv_sec = stx.stx_mtime.tv_sec;
+            st->st_mtim.tv_nsec = stx.stx_mtime.tv_nsec;
+            st->st_ctim.tv_sec = stx.stx_ctime.tv_sec;
+            st->st_ctim.tv_nsec = stx.stx_ctime.tv_nsec;
+            return 0;
+        }
+        if (errno != ENOSYS)
+            return -errno;
+        /* kernel without statx(), fall back to fstatat() */
+    }
+#endif
+#ifdef HAVE_FSTATAT
+    if (fstatat(dirfd, name, st, AT_SYMLINK_NOFOLLOW) == -1)
+        return -errno;
+    return 0;
+#else
+    (void) dirfd;
+    (void) name;
+    (void) st;
+    return -ENOSYS;
+#endif
+}
+
+DirListing::DirListing(int fd):
+    dirFd(fd), complete(false), attrFirst(0) {
+#ifndef __linux__
+    dp = fdopendir(dirFd);
+#endif
+    if (fstat(dirFd, &snapshot) == -1)
+        memset(&snapshot, 0, sizeof(snapshot));
+}
+
+DirListing::~DirListing() {
+#ifndef __linux__
+    if (dp != NULL) {
+        closedir(dp); /* closes dirFd too */
+        return;
+    }
+#endif
+    close(dirFd);
+}
+
+int DirListing::fd() const {
+    return dirFd;
+}
+
+void DirListing::append(const char *name, ino_t ino, unsigned char type) {
+    Entry entry;
+    entry.name = names.size();
+    entry.ino = ino;
+    entry.type = type;
+    names.insert(names.end(), name, name + strlen(name) + 1);
+    entries.push_back(entry);
+}
+
+int DirListing::readBatch() {
+#ifdef __linux__
+    if (buffer.empty())
+        buffer.resize((batchSize < DIRLIST_MIN_BATCH) ? DIRLIST_MIN_BATCH : batchSize);
+
+    long res = syscall(SYS_getdents64, dirFd, &buffer[0], buffer.size());
+    if (res < 0)
+        return -errno;
+
+    int count = 0;
+    for (long pos = 0; pos < res; ++count) {
+        struct linux_dirent64 *d = (struct linux_dirent64 *) (&buffer[0] + pos);
+        append(d->d_name, (ino_t) d->d_ino, d->d_type);
+        pos += d->d_reclen;
+    }
+    return count;
+#else
+    if (dp == NULL)
+        return -ENOMEM;
+
+    int count;
+    for (count = 0; count < DIRLIST_READDIR_BATCH; ++count) {
+        errno = 0;
+        struct dirent *d = readdir(dp);
+        if (d == NULL) {
+            if (errno != 0 && count == 0)
+                return -errno;
+            break;
+        }
+        append(d->d_name, d->d_ino, d->d_type);
+    }
+    return count;
+#endif
+}
+
+void DirListing::restart() {
+    struct stat now;
+
+    attrs.clear();
+    attrErrors.clear();
+    attrFirst = 0;
+
+    if (keepListing && (fstat(dirFd, &now) == 0) && unchanged(now, snapshot))
+        return;
+
+    entries.clear();
+    names.clear();
+    complete = false;
+#ifdef __linux__
+    lseek(dirFd, 0, SEEK_SET);
+#else
+    if (dp != NULL)
+        rewinddir(dp);
+#endif
+    if (fstat(dirFd, &snapshot) == -1)
+        memset(&snapshot, 0, sizeof(snapshot));
+}
+
+int DirListing::get(off_t offset, dirlist_entry& entry) {
+    if (offset < 0)
+        return -EINVAL;
+
+    /* start over (rewinddir() or new listing on the same handle) */
+    if (offset == 0 && (complete || !entries.empty()))
+        restart();
+
+    while ((size_t)offset >= entries.size()) {
+        if (complete)
+            return 0;
+        int res = readBatch();
+        if (res < 0)
+            return res;
+        if (res == 0) {
+            complete = true;
+#ifdef __linux__
+            /* listing is kept, buffer is not needed anymore */
+            std::vector<char>().swap(buffer);
+#endif
+        }
+    }
+
+    const Entry& e = entries[offset];
+    entry.name = &names[e.name];
+    entry.ino = e.ino;
+    entry.type = e.type;
+    return 1;
+}
+
+int DirListing::attributes(off_t offset, struct stat *st) {
+    if (offset < 0 || (size_t)offset >= entries.size())
+        return -EINVAL;
+
+    if (offset < attrFirst || (size_t)(offset - attrFirst) >= attrs.size()) {
+        /* stat run of entries, next readdirplus requests will need them */
+        size_t count = entries.size() - (size_t)offset;
+        if (count > DIRLIST_STAT_BATCH)
+            count = DIRLIST_STAT_BATCH;
+
+        attrFirst = offset;
+        attrs.resize(count);
+        attrErrors.resize(count);
+        for (size_t i = 0; i < count; ++i)
+            attrErrors[i] = stat_entry(dirFd, &names[entries[offset + i].name], &attrs[i]);
+    }
+
+    *st = attrs[offset - attrFirst];
+    return attrErrors[offset - attrFirst];
+}
+
+/*!\brief Returns value of yes/no option (or default if option is not set) */
+static inline bool option_enabled(const char *name, bool fallback)
+{
+    if (config[name] == NULL)
+        return fallback;
+    return strncmp(config[name], "yes", 3) == 0;
+}
+
+void ConfigureDirListing()
+{
+    if (config["batch-size"] != NULL)
+        batchSize = strtoul(config["batch-size"], NULL, 10);
+    useStatx = option_enabled("statx", true);
+    keepListing = option_enabled("keep-listing", true);
+}
+
+} /* namespace clamfs */
+
+/* EoF */
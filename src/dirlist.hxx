@@ -0,0 +1,162 @@
+/*!\file dirlist.hxx
+
+   \brief Batched directory listing (header file)
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef CLAMFS_DIRLIST_HXX
+#define CLAMFS_DIRLIST_HXX
+
+#include "config.h"
+
+#include <vector>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef DMALLOC
+   #include <stdlib.h>
+   #ifdef HAVE_MALLOC_H
+      #include <malloc.h>
+   #endif
+   #include <dmalloc.h>
+#endif
+
+/*!\def DIRLIST_DEFAULT_BATCH
+   \brief Default size of getdents64() buffer (in bytes)
+*/
+#define DIRLIST_DEFAULT_BATCH 262144
+
+/*!\def DIRLIST_STAT_BATCH
+   \brief Number of entries stat'ed ahead for readdirplus
+*/
+#define DIRLIST_STAT_BATCH 64
+
+namespace clamfs {
+
+/*!\struct dirlist_entry
+   \brief Directory entry returned by DirListing
+*/
+struct dirlist_entry {
+    /*!\brief entry name (valid until next call of DirListing::get()) */
+    const char *name;
+    /*!\brief inode number */
+    ino_t ino;
+    /*!\brief file type (DT_* value) */
+    unsigned char type;
+};
+
+/*!\class DirListing
+   \brief Listing of open directory handle
+
+   Entries are read in large batches (with getdents64() on Linux)
+   and kept for the life of the handle, so offset of each entry is
+   simply its index and stays valid across seeks. When listing is
+   started over (offset 0) it is served from memory as long as the
+   directory has not been modified. Attributes for readdirplus are
+   fetched for a run of entries at once and dropped on restart.
+   Like a DIR stream, handle is not meant to be used by concurrent
+   threads (the kernel serializes readdir on an open directory).
+*/
+class DirListing {
+    public:
+        /*!\brief Constructor for DirListing
+           \param fd descriptor of open directory (closed by destructor)
+        */
+        explicit DirListing(int fd);
+        /*!\brief Destructor for DirListing */
+        ~DirListing();
+
+        /*!\brief Returns descriptor of directory */
+        int fd() const;
+
+        /*!\brief Gets entry at given offset
+           \param offset offset of entry (0 starts listing over)
+           \param entry entry found
+           \returns 1 if entry was found, 0 at end of directory and -errno on error
+        */
+        int get(off_t offset, dirlist_entry& entry);
+
+        /*!\brief Gets attributes of entry at given offset
+           \param offset offset of entry (already returned by get())
+           \param st attributes of entry
+           \returns 0 on success and -errno on error
+        */
+        int attributes(off_t offset, struct stat *st);
+
+    private:
+        /*!\brief Forbid usage of copy constructor */
+        DirListing(const DirListing& aListing);
+        /*!\brief Forbid usage of assignment operator */
+        DirListing& operator = (const DirListing& aListing);
+
+        /*!\brief Drops entries and rewinds directory if it was modified */
+        void restart();
+        /*!\brief Reads next batch of entries
+           \returns number of entries read, 0 at end of directory and -errno on error
+        */
+        int readBatch();
+        /*!\brief Appends entry to listing */
+        void append(const char *name, ino_t ino, unsigned char type);
+
+        /*!\brief Single cached entry (name is kept in names) */
+        struct Entry {
+            /*!\brief offset of name in names */
+            size_t name;
+            /*!\brief inode number */
+            ino_t ino;
+            /*!\brief file type (DT_* value) */
+            unsigned char type;
+        };
+
+        /*!\brief directory descriptor */
+        int dirFd;
+#ifdef __linux__
+        /*!\brief getdents64() buffer (freed once whole directory is read) */
+        std::vector<char> buffer;
+#else
+        /*!\brief directory stream */
+        DIR *dp;
+#endif
+        /*!\brief entries read so far */
+        std::vector<Entry> entries;
+        /*!\brief NUL terminated names of entries */
+        std::vector<char> names;
+        /*!\brief true if whole directory has been read */
+        bool complete;
+        /*!\brief directory attributes at start of listing */
+        struct stat snapshot;
+        /*!\brief offset of first entry in attrs */
+        off_t attrFirst;
+        /*!\brief attributes of run of entries starting at attrFirst */
+        std::vector<struct stat> attrs;
+        /*!\brief result of stat for each of attrs (0 or -errno) */
+        std::vector<int> attrErrors;
+};
+
+/*!\brief Reads readdir settings from configuration */
+void ConfigureDirListing();
+
+} /* namespace clamfs */
+
+#endif /* CLAMFS_DIRLIST_HXX */
+
+/* EoF */
@@ -0,0 +1,194 @@
+/*!\file extacl.cxx
+
+   \brief File extension access list routines
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "extacl.hxx"
+
+#include <cstring>
+#include <map>
+#include <algorithm>
+
+namespace clamfs {
+
+/*!\brief Folds ASCII upper case letters to lower case */
+static inline unsigned char fold(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c + ('a' - 'A')) : c;
+}
+
+ExtensionACL::ExtensionACL() {
+    compile();
+}
+
+ExtensionACL::~ExtensionACL() {
+}
+
+void ExtensionACL::addExtension(const string& extension, acl_item item, bool ignoreCase) {
+    add(extension, item, ignoreCase, false);
+}
+
+void ExtensionACL::addFilename(const string& filename, acl_item item, bool ignoreCase) {
+    add(filename, item, ignoreCase, true);
+}
+
+void ExtensionACL::add(const string& pattern, acl_item item, bool ignoreCase, bool filename) {
+    if (pattern.empty())
+        return;
+
+    /* later definition overrides earlier one (as with former map) */
+    for (vector<Rule>::iterator it = rules.begin(); it != rules.end(); ++it) {
+        if (it->pattern == pattern && it->ignoreCase == ignoreCase &&
+            it->filename == filename) {
+            it->item = item;
+            return;
+        }
+    }
+
+    Rule rule;
+    rule.pattern = pattern;
+    rule.item = item;
+    rule.ignoreCase = ignoreCase;
+    rule.filename = filename;
+    rules.push_back(rule);
+}
+
+void ExtensionACL::compile() {
+    /*
+     * Build trie of reversed patterns with std::map children first...
+     */
+    vector< map<unsigned char, unsigned int> > children(1);
+    vector< vector<unsigned int> > ending(1);
+
+    for (unsigned int r = 0; r < rules.size(); ++r) {
+        const string& pattern = rules[r].pattern;
+        unsigned int node = 0;
+        for (string::const_reverse_iterator c = pattern.rbegin(); c != pattern.rend(); ++c) {
+            unsigned char label = fold((unsigned char)*c);
+            map<unsigned char, unsigned int>::iterator child = children[node].find(label);
+            if (child == children[node].end()) {
+                children[node][label] = (unsigned int)children.size();
+                node = (unsigned int)children.size();
+                children.push_back(map<unsigned char, unsigned int>());
+                ending.push_back(vector<unsigned int>());
+            } else {
+                node = child->second;
+            }
+        }
+        ending[node].push_back(r);
+    }
+
+    /*
+     * ...then flatten it into arrays used for lookup
+     */
+    nodes.clear();
+    edges.clear();
+    nodeRules.clear();
+    nodes.resize(children.size());
+    for (unsigned int n = 0; n < children.size(); ++n) {
+        nodes[n].firstEdge = (unsigned int)edges.size();
+        nodes[n].edgeCount = (unsigned int)children[n].size();
+        for (map<unsigned char, unsigned int>::const_iterator it = children[n].begin();
+             it != children[n].end(); ++it) {
+            Edge edge;
+            edge.label = it->first;
+            edge.child = it->second;
+            edges.push_back(edge);
+        }
+        nodes[n].firstRule = (unsigned int)nodeRules.size();
+        nodes[n].ruleCount = (unsigned int)ending[n].size();
+        nodeRules.insert(nodeRules.end(), ending[n].begin(), ending[n].end());
+    }
+
+    /* root is visited on every lookup, so give it direct table */
+    memset(rootChildren, 0, sizeof(rootChildren));
+    for (map<unsigned char, unsigned int>::const_iterator it = children[0].begin();
+         it != children[0].end(); ++it)
+        rootChildren[it->first] = it->second;
+}
+
+/*!\brief Compares edge label with character (for binary search) */
+struct EdgeLess {
+    template<typename E> bool operator()(const E& edge, unsigned char label) const {
+        return edge.label < label;
+    }
+};
+
+acl_item ExtensionACL::match(const char* path) const {
+    const char* name = strrchr(path, '/');
+    name = (name == NULL) ? path : name + 1;
+    size_t length = strlen(name);
+
+    acl_item result = none;
+    unsigned int node = 0;
+
+    for (size_t i = length; i > 0; --i) {
+        /*
+         * Follow edge for next character (from the end of name)
+         */
+        unsigned char label = fold((unsigned char)name[i - 1]);
+        if (node == 0) {
+            node = rootChildren[label];
+            if (node == 0)
+                break;
+        } else {
+            const Node& current = nodes[node];
+            vector<Edge>::const_iterator first = edges.begin() + current.firstEdge;
+            vector<Edge>::const_iterator last = first + current.edgeCount;
+            vector<Edge>::const_iterator edge = lower_bound(first, last, label, EdgeLess());
+            if (edge == last || edge->label != label)
+                break;
+            node = edge->child;
+        }
+
+        /*
+         * Check rules which end here, suffix name[i-1 .. length) matches
+         * folded pattern; extension must be preceded by dot and file name
+         * must cover whole base name
+         */
+        const Node& next = nodes[node];
+        bool atDot = (i > 1) && (name[i - 2] == '.');
+        bool atStart = (i == 1);
+        if (!atDot && !atStart)
+            continue;
+        acl_item folded = none;
+        acl_item exact = none;
+        for (unsigned int r = 0; r < next.ruleCount; ++r) {
+            const Rule& rule = rules[nodeRules[next.firstRule + r]];
+            if (rule.filename ? !atStart : !atDot)
+                continue;
+            if (rule.ignoreCase)
+                folded = rule.item;
+            else if (memcmp(rule.pattern.data(), name + i - 1, rule.pattern.size()) == 0)
+                exact = rule.item;
+        }
+        acl_item found = (exact != none) ? exact : folded;
+        if (found == none)
+            continue;
+        result = found; /* longer suffix (or whole name) beats shorter one */
+    }
+
+    return result;
+}
+
+} /* namespace clamfs */
+
+/* EoF */
@@ -0,0 +1,150 @@
+/*!\file extacl.hxx
+
+   \brief File extension access list routines (header file)
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef CLAMFS_EXTACL_HXX
+#define CLAMFS_EXTACL_HXX
+
+#include "config.h"
+
+#include <string>
+#include <vector>
+
+#ifdef DMALLOC
+   #include <stdlib.h>
+   #ifdef HAVE_MALLOC_H
+      #include <malloc.h>
+   #endif
+   #include <dmalloc.h>
+#endif
+
+namespace clamfs {
+
+using namespace std;
+
+/*!\enum acl_item
+   \brief Enumeration of Access List Items
+*/
+enum acl_item { none = 0, blacklisted, whitelisted };
+
+/*!\class ExtensionACL
+   \brief Whitelist and blacklist of file extensions and file names
+
+   Rules are compiled into trie of reversed (and case folded) suffixes,
+   so lookup walks file name once from its end and does not allocate
+   memory. Extension rules can contain dots (like "tar.gz") and match
+   the longest extension. Filename rules match whole base name and take
+   precedence over extension rules. Each rule can be case sensitive or
+   case insensitive; case sensitive rule wins if both match.
+*/
+class ExtensionACL {
+    public:
+        /*!\brief Constructor for ExtensionACL */
+        ExtensionACL();
+        /*!\brief Destructor for ExtensionACL */
+        ~ExtensionACL();
+
+        /*!\brief Adds extension rule
+           \param extension extension without leading dot (e.g. "tar.gz")
+           \param item ACL type
+           \param ignoreCase match extension case insensitively
+        */
+        void addExtension(const string& extension, acl_item item, bool ignoreCase);
+
+        /*!\brief Adds file name rule
+           \param filename base name of file (e.g. "Thumbs.db")
+           \param item ACL type
+           \param ignoreCase match file name case insensitively
+        */
+        void addFilename(const string& filename, acl_item item, bool ignoreCase);
+
+        /*!\brief Compiles rules into lookup trie (call once after adding rules) */
+        void compile();
+
+        /*!\brief Looks up ACL type for file
+           \param path file path (only base name is considered)
+           \returns ACL type of best matching rule or none
+        */
+        acl_item match(const char* path) const;
+
+        /*!\brief Returns number of rules */
+        size_t size() const { return rules.size(); }
+
+    private:
+        /*!\brief Forbid usage of copy constructor */
+        ExtensionACL(const ExtensionACL& aExtensionACL);
+        /*!\brief Forbid usage of assignment operator */
+        ExtensionACL& operator = (const ExtensionACL& aExtensionACL);
+
+        /*!\brief Adds rule replacing previous rule for the same pattern */
+        void add(const string& pattern, acl_item item, bool ignoreCase, bool filename);
+
+        /*!\brief Single ACL rule */
+        struct Rule {
+            /*!\brief extension or file name */
+            string pattern;
+            /*!\brief ACL type */
+            acl_item item;
+            /*!\brief case insensitive rule flag */
+            bool ignoreCase;
+            /*!\brief rule matches whole base name */
+            bool filename;
+        };
+
+        /*!\brief Compiled trie node */
+        struct Node {
+            /*!\brief index of first edge in edges */
+            unsigned int firstEdge;
+            /*!\brief number of edges */
+            unsigned int edgeCount;
+            /*!\brief index of first rule index in nodeRules */
+            unsigned int firstRule;
+            /*!\brief number of rules ending in this node */
+            unsigned int ruleCount;
+        };
+
+        /*!\brief Compiled trie edge */
+        struct Edge {
+            /*!\brief case folded character */
+            unsigned char label;
+            /*!\brief index of child node */
+            unsigned int child;
+        };
+
+        /*!\brief rules in order of definition */
+        vector<Rule> rules;
+        /*!\brief trie nodes, root is first */
+        vector<Node> nodes;
+        /*!\brief trie edges, sorted by label within node */
+        vector<Edge> edges;
+        /*!\brief indexes of rules ending in nodes */
+        vector<unsigned int> nodeRules;
+        /*!\brief direct lookup table for root node edges (0 if none) */
+        unsigned int rootChildren[256];
+};
+
+} /* namespace clamfs */
+
+#endif /* CLAMFS_EXTACL_HXX */
+
+/* EoF */
@@ -0,0 +1,111 @@
+/*!\file fuseconn.cxx
+
+   \brief FUSE connection capabilities negotiation
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "fuseconn.hxx"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.hxx"
+
+namespace clamfs {
+
+extern config_t config;
+
+/*!\brief true if kernel writeback cache was negotiated */
+static bool writeback = false;
+
+/*!\brief Returns value of yes/no option (or default if option is not set) */
+static inline bool option_enabled(const char *name, bool fallback)
+{
+    if (config[name] == NULL)
+        return fallback;
+    return strncmp(config[name], "yes", 3) == 0;
+}
+
+void NegotiateConnection(struct fuse_conn_info *conn, bool passthrough)
+{
+    Logger& logger = Logger::root();
+    const unsigned int splice = FUSE_CAP_SPLICE_READ | FUSE_CAP_SPLICE_WRITE | FUSE_CAP_SPLICE_MOVE;
+
+    /*
+     * Splice data between /dev/fuse and backing files instead of copying
+     */
+    if (option_enabled("splice", true))
+        conn->want |= conn->capable & splice;
+    else
+        conn->want &= ~splice;
+
+    /*
+     * Let the kernel merge small writes in page cache (off by default, as
+     * changes made to lower filesystem behind ClamFS back are not noticed
+     * while dirty pages are cached)
+     */
+    if (option_enabled("writeback", false)) {
+        if (passthrough)
+            poco_warning(logger, "writeback cache conflicts with FUSE passthrough, not enabled");
+        else if ((conn->capable & FUSE_CAP_WRITEBACK_CACHE) == 0)
+            poco_warning(logger, "kernel does not support writeback cache, not enabled");
+        else {
+            conn->want |= FUSE_CAP_WRITEBACK_CACHE;
+            writeback = true;
+        }
+    }
+
+    /*
+     * Request sizes (kernel readahead can only be lowered, not raised)
+     */
+    conn->max_write = (config["max-write"] != NULL) ?
+        (unsigned int)strtoul(config["max-write"], NULL, 10) : FUSE_DEFAULT_MAX_WRITE;
+    if (config["max-readahead"] != NULL) {
+        unsigned int readahead = (unsigned int)strtoul(config["max-readahead"], NULL, 10);
+        if (readahead < conn->max_readahead)
+            conn->max_readahead = readahead;
+    }
+    conn->max_background = (config["max-background"] != NULL) ?
+        (unsigned int)strtoul(config["max-background"], NULL, 10) : FUSE_DEFAULT_MAX_BACKGROUND;
+
+    poco_information_f4(logger, "FUSE connection: max_write %u, max_readahead %u, max_background %u, %s",
+        conn->max_write, conn->max_readahead, conn->max_background,
+        string(writeback ? "writeback cache" : "write through"));
+    poco_information_f1(logger, "FUSE connection: splice %s",
+        string(((conn->want & splice) != 0) ? "enabled" : "disabled"));
+}
+
+void AdjustOpenFlags(struct fuse_file_info *fi)
+{
+    if (!writeback)
+        return;
+
+    if ((fi->flags & O_ACCMODE) == O_WRONLY) {
+        fi->flags &= ~O_ACCMODE;
+        fi->flags |= O_RDWR;
+    }
+    fi->flags &= ~O_APPEND;
+}
+
+} /* namespace clamfs */
+
+/* EoF */
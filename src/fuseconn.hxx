@@ -0,0 +1,73 @@
+/*!\file fuseconn.hxx
+
+   \brief FUSE connection capabilities negotiation (header file)
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef CLAMFS_FUSECONN_HXX
+#define CLAMFS_FUSECONN_HXX
+
+#include "config.h"
+
+#include <fuse.h>
+
+#ifdef DMALLOC
+   #include <stdlib.h>
+   #ifdef HAVE_MALLOC_H
+      #include <malloc.h>
+   #endif
+   #include <dmalloc.h>
+#endif
+
+/*!\def FUSE_DEFAULT_MAX_WRITE
+   \brief Default maximal size of write request (in bytes)
+
+   libFUSE lowers it to its buffer size and derives max_pages from it.
+*/
+#define FUSE_DEFAULT_MAX_WRITE 1048576
+
+/*!\def FUSE_DEFAULT_MAX_BACKGROUND
+   \brief Default maximal number of pending background (readahead) requests
+*/
+#define FUSE_DEFAULT_MAX_BACKGROUND 64
+
+namespace clamfs {
+
+/*!\brief Requests capabilities and limits configured in fuse element
+   \param conn connection information passed to init() callback
+   \param passthrough true if FUSE passthrough is used (conflicts with writeback cache)
+*/
+void NegotiateConnection(struct fuse_conn_info *conn, bool passthrough);
+
+/*!\brief Adjusts open() flags for kernel writeback cache (if enabled)
+   \param fi information about open files
+
+   With writeback cache the kernel reads pages of files opened write
+   only and handles O_APPEND itself, so backing file is opened for
+   reading and writing and without O_APPEND.
+*/
+void AdjustOpenFlags(struct fuse_file_info *fi);
+
+} /* namespace clamfs */
+
+#endif /* CLAMFS_FUSECONN_HXX */
+
+/* EoF */
@@ -0,0 +1,242 @@
+/*!\file history.cxx
+
+   \brief Access history predicting next opened files
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "history.hxx"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+
+#include "logger.hxx"
+#include "stats.hxx"
+
+namespace clamfs {
+
+AccessHistory::AccessHistory(size_t entries, size_t predict):
+    maximalEntries((entries > 0) ? entries : 1), maximalPredict(predict) {
+}
+
+AccessHistory::~AccessHistory() {
+}
+
+long AccessHistory::load(const char* filename) {
+    Logger& logger = Logger::root();
+
+    ifstream file(filename);
+    if (!file) {
+        if (errno == ENOENT) {
+            poco_information_f1(logger, "access history %s not found, starting with empty one",
+                string(filename));
+            return 0;
+        }
+        poco_warning_f2(logger, "cannot open access history %s: %s",
+            string(filename), string(strerror(errno)));
+        return -1;
+    }
+
+    string line;
+    if (!getline(file, line) || (line != HISTORY_MAGIC)) {
+        poco_warning_f1(logger, "%s is not an access history", string(filename));
+        return -1;
+    }
+
+    FastMutex::ScopedLock lock(mutex);
+    long loaded = 0;
+    while (getline(file, line)) {
+        size_t first = line.find('\t');
+        size_t second = (first == string::npos) ? string::npos : line.find('\t', first + 1);
+        if (second == string::npos)
+            continue; /* malformed line */
+        unsigned long count = strtoul(line.c_str(), NULL, 10);
+        if ((count == 0) || (count > HISTORY_MAX_COUNT))
+            continue;
+        learn(line.substr(first + 1, second - first - 1), line.substr(second + 1),
+              (unsigned int)count);
+        ++loaded;
+    }
+
+    return loaded;
+}
+
+bool AccessHistory::save(const char* filename) {
+    Logger& logger = Logger::root();
+    string temporary = string(filename) + ".tmp";
+
+    FILE* file = fopen(temporary.c_str(), "w");
+    if (file == NULL) {
+        poco_warning_f2(logger, "cannot create access history %s: %s",
+            temporary, string(strerror(errno)));
+        return false;
+    }
+
+    bool written = (fprintf(file, "%s\n", HISTORY_MAGIC) > 0);
+    {
+        FastMutex::ScopedLock lock(mutex);
+        for (map<string, vector<Successor> >::const_iterator it = model.begin();
+             written && (it != model.end()); ++it) {
+            for (size_t i = 0; written && (i < it->second.size()); ++i) {
+                const Successor& next = it->second[i];
+                written = (fprintf(file, "%u\t%s\t%s\n", next.count,
+                                   it->first.c_str(), next.path.c_str()) > 0);
+            }
+        }
+    }
+
+    /* history has to be on disk before it replaces previous one */
+    written = written && (fflush(file) == 0) && (fsync(fileno(file)) == 0);
+    written = (fclose(file) == 0) && written;
+    if (!written || (rename(temporary.c_str(), filename) != 0)) {
+        poco_warning_f2(logger, "cannot write access history %s: %s",
+            string(filename), string(strerror(errno)));
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+void AccessHistory::learn(const string& from, const string& to, unsigned int count) {
+    if (from == to)
+        return;
+    /* such names would break history file */
+    if ((to.find_first_of("\t\n") != string::npos) ||
+        (from.find_first_of("\t\n") != string::npos))
+        return;
+
+    map<string, vector<Successor> >::iterator it = model.find(from);
+    if (it == model.end()) {
+        if (model.size() >= maximalEntries)
+            return; /* keep what was learned so far */
+        it = model.insert(make_pair(from, vector<Successor>())).first;
+    }
+    vector<Successor>& successors = it->second;
+
+    size_t i = 0;
+    while ((i < successors.size()) && (successors[i].path != to))
+        ++i;
+    if (i < successors.size()) {
+        successors[i].count += count;
+        if (successors[i].count >= HISTORY_MAX_COUNT) {
+            /* age counts, so changed order is learned again */
+            for (size_t j = 0; j < successors.size(); ++j)
+                successors[j].count = (successors[j].count + 1) / 2;
+        }
+    } else if (successors.size() < HISTORY_SUCCESSORS) {
+        Successor next;
+        next.path = to;
+        next.count = count;
+        successors.push_back(next);
+        i = successors.size() - 1;
+    } else {
+        /* least frequent successor gives way to one seen often enough */
+        i = successors.size() - 1;
+        if (successors[i].count > count) {
+            successors[i].count -= count;
+            return;
+        }
+        successors[i].path = to;
+        successors[i].count = count;
+    }
+
+    /* keep successors sorted (most frequent first) */
+    while ((i > 0) && (successors[i - 1].count < successors[i].count)) {
+        swap(successors[i - 1], successors[i]);
+        --i;
+    }
+}
+
+void AccessHistory::predict(const string& path, vector<string>& next) {
+    /* breadth first, so most direct successors are scanned first */
+    size_t visited = next.size();
+    const string* current = &path;
+    while (next.size() < maximalPredict) {
+        map<string, vector<Successor> >::const_iterator it = model.find(*current);
+        if (it != model.end()) {
+            for (size_t i = 0; (i < it->second.size()) && (next.size() < maximalPredict); ++i) {
+                const Successor& successor = it->second[i];
+                if (successor.count < HISTORY_MIN_COUNT)
+                    break;
+                if ((successor.path != path) &&
+                    (find(next.begin(), next.end(), successor.path) == next.end()))
+                    next.push_back(successor.path);
+            }
+        }
+        if (visited >= next.size())
+            break;
+        current = &next[visited++];
+    }
+}
+
+void AccessHistory::opened(const string& path, pid_t pid, vector<string>& next) {
+    FastMutex::ScopedLock lock(mutex);
+
+    INC_STAT_COUNTER(historyOpens);
+    set<string>::iterator used = predicted.find(path);
+    if (used != predicted.end()) {
+        INC_STAT_COUNTER(historyUsed);
+        predicted.erase(used);
+    }
+
+    /*
+     * Learn transition from file opened before by the same process
+     */
+    map<pid_t, string>::iterator it = last.find(pid);
+    if (it != last.end()) {
+        learn(it->second, path, 1);
+        it->second = path;
+    } else {
+        if (last.size() >= HISTORY_PROCESSES)
+            last.clear(); /* most of them have exited already */
+        last[pid] = path;
+    }
+
+    /*
+     * Predict next files (files predicted before are scheduled already)
+     */
+    vector<string> likely;
+    predict(path, likely);
+    for (size_t i = 0; i < likely.size(); ++i) {
+        if (!predicted.insert(likely[i]).second)
+            continue;
+        predictedOrder.push_back(likely[i]);
+        next.push_back(likely[i]);
+        INC_STAT_COUNTER(historyPredicted);
+    }
+    while (predictedOrder.size() > maximalEntries) {
+        predicted.erase(predictedOrder.front());
+        predictedOrder.pop_front();
+    }
+}
+
+size_t AccessHistory::size() {
+    FastMutex::ScopedLock lock(mutex);
+    return model.size();
+}
+
+} /* namespace clamfs */
+
+/* EoF */
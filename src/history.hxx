@@ -0,0 +1,176 @@
+/*!\file history.hxx
+
+   \brief Access history predicting next opened files (header file)
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef CLAMFS_HISTORY_HXX
+#define CLAMFS_HISTORY_HXX
+
+#include "config.h"
+
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <Poco/Mutex.h>
+
+#ifdef DMALLOC
+   #include <stdlib.h>
+   #ifdef HAVE_MALLOC_H
+      #include <malloc.h>
+   #endif
+   #include <dmalloc.h>
+#endif
+
+/*!\def HISTORY_MAGIC
+   \brief First line of access history file
+*/
+#define HISTORY_MAGIC "CLAMFSH1"
+
+/*!\def HISTORY_DEFAULT_ENTRIES
+   \brief Default maximal number of files with remembered successors
+*/
+#define HISTORY_DEFAULT_ENTRIES 65536
+
+/*!\def HISTORY_DEFAULT_PREDICT
+   \brief Default maximal number of files predicted on open
+*/
+#define HISTORY_DEFAULT_PREDICT 4
+
+/*!\def HISTORY_SUCCESSORS
+   \brief Number of successors remembered for each file
+*/
+#define HISTORY_SUCCESSORS 4
+
+/*!\def HISTORY_MIN_COUNT
+   \brief Successor has to be seen this many times to be predicted
+*/
+#define HISTORY_MIN_COUNT 2
+
+/*!\def HISTORY_MAX_COUNT
+   \brief Successor counts are halved when one of them reaches this value
+*/
+#define HISTORY_MAX_COUNT 65535
+
+/*!\def HISTORY_PROCESSES
+   \brief Maximal number of processes whose last opened file is remembered
+*/
+#define HISTORY_PROCESSES 4096
+
+namespace clamfs {
+
+using namespace std;
+using namespace Poco;
+
+/*!\class AccessHistory
+   \brief Learns order in which files are opened and predicts next ones
+
+   For each file a few most frequent successors (files opened next by
+   the same process) are counted. Open of file predicts its successors
+   seen at least HISTORY_MIN_COUNT times, then their successors, and so
+   on, up to given number of files. History is kept across restarts in
+   text file, one "count TAB file TAB successor" line per transition.
+*/
+class AccessHistory {
+    public:
+        /*!\brief Constructor for AccessHistory
+           \param entries maximal number of files with remembered successors
+           \param predict maximal number of files predicted on open
+        */
+        AccessHistory(size_t entries, size_t predict);
+        /*!\brief Destructor for AccessHistory */
+        ~AccessHistory();
+
+        /*!\brief Loads history saved before
+           \param filename history file name
+           \returns number of loaded transitions or -1 on error
+        */
+        long load(const char* filename);
+        /*!\brief Saves history (replacing file atomically)
+           \param filename history file name
+           \returns true on success
+        */
+        bool save(const char* filename);
+
+        /*!\brief Learns file open and predicts next files
+           \param path opened file path in real filesystem tree
+           \param pid process which opened file
+           \param next files predicted now (and not predicted before)
+        */
+        void opened(const string& path, pid_t pid, vector<string>& next);
+
+        /*!\brief Returns number of files with remembered successors */
+        size_t size();
+
+    private:
+        /*!\brief Forbid usage of copy constructor */
+        AccessHistory(const AccessHistory& aHistory);
+        /*!\brief Forbid usage of assignment operator */
+        AccessHistory& operator = (const AccessHistory& aHistory);
+
+        /*!\brief File opened after other one */
+        struct Successor {
+            /*!\brief file path */
+            string path;
+            /*!\brief how many times it was opened next */
+            unsigned int count;
+        };
+
+        /*!\brief Counts transition between two files
+           \param from file opened first
+           \param to file opened next
+           \param count number of times transition was seen
+        */
+        void learn(const string& from, const string& to, unsigned int count);
+        /*!\brief Collects files likely opened after given one
+           \param path opened file
+           \param next collected files
+        */
+        void predict(const string& path, vector<string>& next);
+
+        /*!\brief maximal number of files with remembered successors */
+        size_t maximalEntries;
+        /*!\brief maximal number of files predicted on open */
+        size_t maximalPredict;
+
+        /*!\brief protects state below */
+        FastMutex mutex;
+        /*!\brief successors by file (most frequent first) */
+        map<string, vector<Successor> > model;
+        /*!\brief last file opened by process */
+        map<pid_t, string> last;
+        /*!\brief files predicted and not opened yet */
+        set<string> predicted;
+        /*!\brief order of predicted (oldest first, to forget wrong ones) */
+        deque<string> predictedOrder;
+};
+
+/*!\brief extern to access access history pointer (NULL if disabled) */
+extern AccessHistory* history;
+
+} /* namespace clamfs */
+
+#endif /* CLAMFS_HISTORY_HXX */
+
+/* EoF */
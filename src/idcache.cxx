@@ -0,0 +1,196 @@
+/*!\file idcache.cxx
+
+   \brief Process and user identity caching routines
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "idcache.hxx"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pwd.h>
+
+namespace clamfs {
+
+ProcessNameCache processNameCache;
+UserNameCache userNameCache;
+
+/*!\brief Returns monotonic time in ms */
+static inline long monotonicTime() {
+    struct timespec ts;
+#ifdef CLOCK_MONOTONIC_COARSE
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return (long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*!\brief Reads small /proc file into buffer
+   \param pid process id
+   \param file name of file in /proc/<pid>/ directory
+   \param buf data buffer
+   \param size buffer size
+   \returns number of bytes read (buffer is always NUL terminated)
+*/
+static size_t readProcFile(pid_t pid, const char* file, char* buf, size_t size) {
+    char filename[64];
+    ssize_t res = 0;
+
+    buf[0] = '\0';
+    snprintf(filename, sizeof(filename), "/proc/%d/%s", (int)pid, file);
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+    res = read(fd, buf, size - 1);
+    close(fd);
+    if (res < 0)
+        res = 0;
+    buf[res] = '\0';
+    return (size_t)res;
+}
+
+/*!\brief Reads process start time and command name from /proc/<pid>/stat
+   \param pid process id
+   \param comm buffer for command name
+   \param size size of comm buffer
+   \returns process start time or 0 if not available
+*/
+static unsigned long long readProcessStat(pid_t pid, char* comm, size_t size) {
+    char stat[1024];
+
+    comm[0] = '\0';
+    if (readProcFile(pid, "stat", stat, sizeof(stat)) == 0)
+        return 0;
+
+    /* comm is enclosed in parentheses and may contain spaces */
+    char* begin = strchr(stat, '(');
+    char* end = strrchr(stat, ')');
+    if (begin == NULL || end == NULL || end < begin)
+        return 0;
+    size_t len = (size_t)(end - begin - 1);
+    if (len >= size)
+        len = size - 1;
+    memcpy(comm, begin + 1, len);
+    comm[len] = '\0';
+
+    /* starttime is field 22, skip state (3) to field 21 */
+    char* p = end + 1;
+    for (int field = 3; field <= 21 && p != NULL; ++field)
+        p = strchr(p + 1, ' ');
+    if (p == NULL)
+        return 0;
+    return strtoull(p + 1, NULL, 10);
+}
+
+/*!\brief Copies string to buffer truncating it if needed */
+static inline const char* copyName(const char* name, char* buf, size_t size) {
+    if (size == 0)
+        return buf;
+    strncpy(buf, name, size - 1);
+    buf[size - 1] = '\0';
+    return buf;
+}
+
+ProcessNameCache::ProcessNameCache(long ttl) {
+    timeToLive = ttl;
+    for (unsigned int i = 0; i < IDCACHE_SLOTS; ++i) {
+        slots[i].pid = 0;
+        slots[i].startTime = 0;
+        slots[i].expires = 0;
+        slots[i].comm[0] = '\0';
+        slots[i].name[0] = '\0';
+    }
+}
+
+ProcessNameCache::~ProcessNameCache() {
+}
+
+const char* ProcessNameCache::lookup(pid_t pid, char* buf, size_t size) {
+    Entry& entry = slots[(unsigned int)pid & (IDCACHE_SLOTS - 1)];
+    long now = monotonicTime();
+
+    FastMutex::ScopedLock lock(entry.mutex);
+    if (entry.pid != pid || now >= entry.expires) {
+        char comm[sizeof(entry.comm)];
+        unsigned long long startTime = readProcessStat(pid, comm, sizeof(comm));
+
+        /*
+         * Re-read cmdline only if pid was recycled or process called exec()
+         */
+        if (entry.pid != pid || startTime == 0 ||
+            startTime != entry.startTime ||
+            strcmp(comm, entry.comm) != 0) {
+            if (readProcFile(pid, "cmdline", entry.name, sizeof(entry.name)) == 0 ||
+                entry.name[0] == '\0')
+                copyName("< unknown >", entry.name, sizeof(entry.name));
+            entry.pid = pid;
+            entry.startTime = startTime;
+            memcpy(entry.comm, comm, sizeof(entry.comm));
+        }
+        entry.expires = now + timeToLive;
+    }
+
+    return copyName(entry.name, buf, size);
+}
+
+UserNameCache::UserNameCache(long ttl) {
+    timeToLive = ttl;
+    for (unsigned int i = 0; i < IDCACHE_SLOTS; ++i) {
+        slots[i].uid = 0;
+        slots[i].used = false;
+        slots[i].expires = 0;
+        slots[i].name[0] = '\0';
+    }
+}
+
+UserNameCache::~UserNameCache() {
+}
+
+const char* UserNameCache::lookup(uid_t uid, char* buf, size_t size) {
+    Entry& entry = slots[(unsigned int)uid & (IDCACHE_SLOTS - 1)];
+    long now = monotonicTime();
+
+    FastMutex::ScopedLock lock(entry.mutex);
+    if (!entry.used || entry.uid != uid || now >= entry.expires) {
+        struct passwd pwd;
+        struct passwd* result = NULL;
+        char pwbuf[4096];
+
+        if (getpwuid_r(uid, &pwd, pwbuf, sizeof(pwbuf), &result) == 0 &&
+            result != NULL)
+            copyName(result->pw_name, entry.name, sizeof(entry.name));
+        else
+            snprintf(entry.name, sizeof(entry.name), "%u", (unsigned int)uid);
+        entry.uid = uid;
+        entry.used = true;
+        entry.expires = now + timeToLive;
+    }
+
+    return copyName(entry.name, buf, size);
+}
+
+} /* namespace clamfs */
+
+/* EoF */
@@ -0,0 +1,182 @@
+/*!\file idcache.hxx
+
+   \brief Process and user identity caching routines (header file)
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef CLAMFS_IDCACHE_HXX
+#define CLAMFS_IDCACHE_HXX
+
+#include "config.h"
+
+#include <cstring>
+#include <sys/types.h>
+#include <Poco/Mutex.h>
+
+#ifdef DMALLOC
+   #include <stdlib.h>
+   #ifdef HAVE_MALLOC_H
+      #include <malloc.h>
+   #endif
+   #include <dmalloc.h>
+#endif
+
+/*!\def CALLERNAME_MAX
+   \brief Size of buffer for process name (including terminating NUL)
+*/
+#define CALLERNAME_MAX 256
+
+/*!\def USERNAME_MAX
+   \brief Size of buffer for user name (including terminating NUL)
+*/
+#define USERNAME_MAX 64
+
+/*!\def IDCACHE_SLOTS
+   \brief Number of slots in each identity cache (must be power of two)
+*/
+#define IDCACHE_SLOTS 64
+
+/*!\def IDCACHE_PROCESS_TTL
+   \brief Time in ms process name is considered valid without revalidation
+*/
+#define IDCACHE_PROCESS_TTL 1000
+
+/*!\def IDCACHE_USER_TTL
+   \brief Time in ms user name is considered valid without lookup
+*/
+#define IDCACHE_USER_TTL 60000
+
+namespace clamfs {
+
+using namespace Poco;
+
+/*!\class ProcessNameCache
+   \brief Thread-safe pid to process name (/proc/<pid>/cmdline) cache
+
+   Entries live in a fixed size, direct-mapped table. Each entry keeps
+   the process start time and command name (from /proc/<pid>/stat), so
+   after TTL expires cached name is only reused if the pid still belongs
+   to the same process image. No heap allocation is done on lookup.
+*/
+class ProcessNameCache {
+    public:
+        /*!\brief Constructor for ProcessNameCache
+           \param ttl time in ms entries are served without revalidation
+        */
+        ProcessNameCache(long ttl = IDCACHE_PROCESS_TTL);
+        /*!\brief Destructor for ProcessNameCache */
+        ~ProcessNameCache();
+
+        /*!\brief Copies name of process into caller supplied buffer
+           \param pid process id
+           \param buf buffer for process name
+           \param size size of buffer
+           \returns buf
+        */
+        const char* lookup(pid_t pid, char* buf, size_t size);
+
+    private:
+        /*!\brief Forbid usage of copy constructor */
+        ProcessNameCache(const ProcessNameCache& aCache);
+        /*!\brief Forbid usage of assignment operator */
+        ProcessNameCache& operator = (const ProcessNameCache& aCache);
+
+        /*!\brief Single cache entry */
+        struct Entry {
+            /*!\brief entry lock */
+            FastMutex mutex;
+            /*!\brief process id (0 for unused entry) */
+            pid_t pid;
+            /*!\brief process start time (in clock ticks since boot) */
+            unsigned long long startTime;
+            /*!\brief command name (changes on exec()) */
+            char comm[16];
+            /*!\brief expiration time (monotonic, in ms) */
+            long expires;
+            /*!\brief process name */
+            char name[CALLERNAME_MAX];
+        };
+
+        /*!\brief TTL for entries (in ms) */
+        long timeToLive;
+        /*!\brief cache entries */
+        Entry slots[IDCACHE_SLOTS];
+};
+
+/*!\class UserNameCache
+   \brief Thread-safe uid to user name cache
+
+   Uses reentrant getpwuid_r() with on-stack buffer to resolve
+   user names. No heap allocation is done on lookup.
+*/
+class UserNameCache {
+    public:
+        /*!\brief Constructor for UserNameCache
+           \param ttl time in ms entries are served without lookup
+        */
+        UserNameCache(long ttl = IDCACHE_USER_TTL);
+        /*!\brief Destructor for UserNameCache */
+        ~UserNameCache();
+
+        /*!\brief Copies name of user into caller supplied buffer
+           \param uid user id
+           \param buf buffer for user name
+           \param size size of buffer
+           \returns buf
+        */
+        const char* lookup(uid_t uid, char* buf, size_t size);
+
+    private:
+        /*!\brief Forbid usage of copy constructor */
+        UserNameCache(const UserNameCache& aCache);
+        /*!\brief Forbid usage of assignment operator */
+        UserNameCache& operator = (const UserNameCache& aCache);
+
+        /*!\brief Single cache entry */
+        struct Entry {
+            /*!\brief entry lock */
+            FastMutex mutex;
+            /*!\brief user id */
+            uid_t uid;
+            /*!\brief true if entry holds valid data */
+            bool used;
+            /*!\brief expiration time (monotonic, in ms) */
+            long expires;
+            /*!\brief user name */
+            char name[USERNAME_MAX];
+        };
+
+        /*!\brief TTL for entries (in ms) */
+        long timeToLive;
+        /*!\brief cache entries */
+        Entry slots[IDCACHE_SLOTS];
+};
+
+/*!\brief Process name cache shared by all threads */
+extern ProcessNameCache processNameCache;
+/*!\brief User name cache shared by all threads */
+extern UserNameCache userNameCache;
+
+} /* namespace clamfs */
+
+#endif /* CLAMFS_IDCACHE_HXX */
+
+/* EoF */
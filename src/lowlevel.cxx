@@ -0,0 +1,1318 @@
+/*!\file lowlevel.cxx
+
+   \brief Low-level (inode based) FUSE backend
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+    Inode handling follows passthrough_ll.c example from FUSE source code.
+
+    FUSE: Filesystem in Userspace
+    Copyright (C) 2001-2007  Miklos Szeredi <miklos@szeredi.hu>
+
+    This program can be distributed under the terms of the GNU GPL.
+    See the file COPYING.
+*/
+
+#include "lowlevel.hxx"
+
+#include <fuse_lowlevel.h>
+#include <map>
+#include <string>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <sys/file.h>
+#ifdef HAVE_SETXATTR
+#include <sys/xattr.h>
+#endif
+#include <Poco/AtomicCounter.h>
+#include <Poco/Runnable.h>
+#include <Poco/Thread.h>
+
+#include "clamfs.hxx"
+#include "utils.hxx"
+
+namespace clamfs {
+
+extern config_t config;
+
+/*!\struct clamfs_inode
+   \brief Backing file of inode known to the kernel
+*/
+struct clamfs_inode {
+    /*!\brief O_PATH descriptor of backing file */
+    int fd;
+    /*!\brief device of backing file */
+    dev_t dev;
+    /*!\brief inode of backing file */
+    ino_t ino;
+    /*!\brief lookup count (inode is freed when kernel forgets it) */
+    uint64_t nlookup;
+};
+
+/*!\typedef inode_map
+   \brief Inodes known to the kernel by backing device and inode number
+*/
+typedef map<pair<dev_t, ino_t>, clamfs_inode*> inode_map;
+
+/*!\class clamfs_mount
+   \brief File system served by its own FUSE session
+
+   All mounts share inodes below (inode pointers are FUSE inode numbers
+   in every session and lookup counts of all sessions are summed), only
+   root directory (FUSE_ROOT_ID) is per mount. Passed to the session as
+   userdata, so callbacks find it with fuse_req_userdata().
+*/
+class clamfs_mount: public Runnable {
+    public:
+        /*!\brief Constructor for clamfs_mount */
+        clamfs_mount(): se(NULL), ret(1) {
+            memset(&root, 0, sizeof(root));
+            root.fd = -1;
+            memset(&args, 0, sizeof(args));
+            memset(&opts, 0, sizeof(opts));
+        }
+        /*!\brief Serves requests until session exits */
+        virtual void run();
+
+        /*!\brief root directory of mount */
+        clamfs_inode root;
+        /*!\brief canonical path of root directory (to build paths for scan policy) */
+        string rootPath;
+        /*!\brief FUSE arguments of mount */
+        struct fuse_args args;
+        /*!\brief parsed FUSE command line */
+        struct fuse_cmdline_opts opts;
+        /*!\brief FUSE session (NULL until created) */
+        struct fuse_session *se;
+        /*!\brief result of session loop */
+        int ret;
+        /*!\brief thread serving session (all but first mount) */
+        Thread thread;
+};
+
+/*!\brief Inodes known to the kernel */
+static inode_map inodes;
+/*!\brief Protects inodes and lookup counts */
+static FastMutex inodesMutex;
+/*!\brief Number of sessions initialized so far */
+static AtomicCounter sessionsStarted;
+
+#ifdef HAVE_FUSE_PASSTHROUGH
+/*!\brief Non-zero if clean files are opened with FUSE passthrough */
+static AtomicCounter passthrough;
+/*!\brief Backing ids registered for open file handles */
+static map<int, int> backings;
+/*!\brief Protects backings */
+static FastMutex backingsMutex;
+#endif
+
+/*!\brief Replies with error (or success) counting error for stats module */
+static inline int reply_err(fuse_req_t req, int err)
+{
+    if (err != 0)
+        OperationScope::failed(err);
+    return fuse_reply_err(req, err);
+}
+
+/*!\brief Returns mount request was sent to */
+static inline clamfs_mount *get_mount(fuse_req_t req)
+{
+    return (clamfs_mount *) fuse_req_userdata(req);
+}
+
+/*!\brief Returns inode of FUSE inode number */
+static inline clamfs_inode *get_inode(fuse_req_t req, fuse_ino_t ino)
+{
+    if (ino == FUSE_ROOT_ID)
+        return &get_mount(req)->root;
+    return (clamfs_inode *) (uintptr_t) ino;
+}
+
+/*!\brief Returns O_PATH descriptor of FUSE inode number */
+static inline int inode_fd(fuse_req_t req, fuse_ino_t ino)
+{
+    return get_inode(req, ino)->fd;
+}
+
+/*!\brief Builds /proc path of descriptor (to reopen O_PATH descriptors) */
+static inline void proc_path(int fd, char *buf, size_t size)
+{
+    snprintf(buf, size, "/proc/self/fd/%d", fd);
+}
+
+/*!\brief Builds path relative to mount point of opened inode
+   \param req request (to find mount)
+   \param procname /proc path of inode descriptor
+   \param buf buffer to store path in
+   \param size size of buffer
+   \returns path or NULL on error (errno is set)
+*/
+static const char *inode_path(fuse_req_t req, const char *procname, char *buf, size_t size)
+{
+    ssize_t res = readlink(procname, buf, size - 1);
+    if (res == -1)
+        return NULL;
+    buf[res] = '\0';
+
+    const string& root_path = get_mount(req)->rootPath;
+    size_t length = root_path.size();
+    if (length == 1) /* root is "/" */
+        return buf;
+    if (strncmp(buf, root_path.c_str(), length) == 0) {
+        if (buf[length] == '\0')
+            return "/";
+        if (buf[length] == '/')
+            return buf + length;
+    }
+    return buf; /* not below root any more (e.g. deleted file) */
+}
+
+/*!\brief Fills fuse_context for CheckOpenedFile() and ClamavScanFile() */
+static inline void get_context(fuse_req_t req, struct fuse_context *context)
+{
+    const struct fuse_ctx *ctx = fuse_req_ctx(req);
+    memset(context, 0, sizeof(*context));
+    context->uid = ctx->uid;
+    context->gid = ctx->gid;
+    context->pid = ctx->pid;
+    context->umask = ctx->umask;
+}
+
+/*!\brief Looks up directory entry and increments lookup count of its inode
+   \param req request (to find mount)
+   \param parent parent directory inode
+   \param name entry name
+   \param e entry to fill in
+   \returns 0 on success or errno otherwise
+*/
+static int do_lookup(fuse_req_t req, fuse_ino_t parent, const char *name, struct fuse_entry_param *e)
+{
+    memset(e, 0, sizeof(*e));
+    /* pick up changes from lower filesystem right away (as clamfs_init() does) */
+    e->attr_timeout = 0.0;
+    e->entry_timeout = 0.0;
+
+    int fd = openat(inode_fd(req, parent), name, O_PATH | O_NOFOLLOW);
+    if (fd == -1)
+        return errno;
+    if (fstatat(fd, "", &e->attr, AT_EMPTY_PATH | AT_SYMLINK_NOFOLLOW) == -1) {
+        int err = errno;
+        close(fd);
+        return err;
+    }
+
+    clamfs_inode *inode;
+    FastMutex::ScopedLock lock(inodesMutex);
+    inode_map::iterator it = inodes.find(make_pair(e->attr.st_dev, e->attr.st_ino));
+    if (it != inodes.end()) {
+        inode = it->second;
+        ++inode->nlookup;
+        close(fd);
+    } else {
+        inode = new clamfs_inode;
+        inode->fd = fd;
+        inode->dev = e->attr.st_dev;
+        inode->ino = e->attr.st_ino;
+        inode->nlookup = 1;
+        inodes[make_pair(inode->dev, inode->ino)] = inode;
+    }
+    e->ino = (fuse_ino_t) (uintptr_t) inode;
+    return 0;
+}
+
+/*!\brief Decrements lookup count of inode and frees it when it drops to zero */
+static void forget_one(fuse_ino_t ino, uint64_t nlookup)
+{
+    if (ino == FUSE_ROOT_ID) /* root of mount is never freed */
+        return;
+
+    clamfs_inode *inode = (clamfs_inode *) (uintptr_t) ino;
+
+    FastMutex::ScopedLock lock(inodesMutex);
+    if (inode->nlookup > nlookup) {
+        inode->nlookup -= nlookup;
+        return;
+    }
+    inodes.erase(make_pair(inode->dev, inode->ino));
+    close(inode->fd);
+    delete inode;
+}
+
+/*!\brief Gives newly created node to calling user (like high-level backend does) */
+static inline void chown_node(fuse_req_t req, int dirfd, const char *name)
+{
+    const struct fuse_ctx *ctx = fuse_req_ctx(req);
+    if (fchownat(dirfd, name, ctx->uid, ctx->gid, AT_SYMLINK_NOFOLLOW) == -1) {
+        Logger& logger = Logger::root();
+        poco_debug_f2(logger, "%s: fchownat() failed: %s", string(name), string(strerror(errno)));
+    }
+}
+
+#ifdef HAVE_FUSE_PASSTHROUGH
+/*!\brief Registers backing file, so reads and writes of handle bypass ClamFS
+   \param req FUSE request
+   \param fi information about open file (backing_id is set on success)
+
+   Handle stays served by ClamFS if passthrough cannot be set up. When
+   the kernel refuses to register backing files (ClamFS is not
+   privileged enough) passthrough is not tried again.
+*/
+static void open_passthrough(fuse_req_t req, struct fuse_file_info *fi)
+{
+    if (passthrough == 0)
+        return;
+
+    /* reads of files verified in background have to be checked */
+    if ((scanner != NULL) && scanner->verifies((int)fi->fh))
+        return;
+
+    int backing_id = fuse_passthrough_open(req, (int)fi->fh);
+    if (backing_id <= 0) {
+        if ((errno == EPERM) && (passthrough.value() != 0)) {
+            passthrough = 0;
+            Logger& logger = Logger::root();
+            poco_warning(logger, "kernel refused FUSE passthrough (not privileged?), disabling it");
+        }
+        return;
+    }
+
+    fi->backing_id = backing_id;
+    INC_STAT_COUNTER(passthroughOpen);
+
+    FastMutex::ScopedLock lock(backingsMutex);
+    backings[(int)fi->fh] = backing_id;
+}
+
+/*!\brief Unregisters backing file of handle (if any)
+   \param req FUSE request
+   \param fi information about open file
+*/
+static void release_passthrough(fuse_req_t req, struct fuse_file_info *fi)
+{
+    int backing_id;
+    {
+        FastMutex::ScopedLock lock(backingsMutex);
+        map<int, int>::iterator it = backings.find((int)fi->fh);
+        if (it == backings.end())
+            return;
+        backing_id = it->second;
+        backings.erase(it);
+    }
+    fuse_passthrough_close(req, backing_id);
+}
+#endif
+
+/*!\brief Returns directory listing from fuse_file_info */
+static inline DirListing *get_dirp(struct fuse_file_info *fi)
+{
+    return (DirListing *) (uintptr_t) fi->fh;
+}
+
+extern "C" {
+
+static void clamfs_ll_init(void *userdata, struct fuse_conn_info *conn)
+{
+    (void) userdata;
+
+    if (conn->capable & FUSE_CAP_FLOCK_LOCKS)
+        conn->want |= FUSE_CAP_FLOCK_LOCKS;
+
+#ifdef HAVE_FUSE_PASSTHROUGH
+    if (passthrough != 0) {
+        Logger& logger = Logger::root();
+        if (conn->capable & FUSE_CAP_PASSTHROUGH) {
+            conn->want |= FUSE_CAP_PASSTHROUGH;
+            poco_information(logger, "FUSE passthrough enabled for clean files");
+        } else {
+            passthrough = 0;
+            poco_warning(logger, "kernel does not support FUSE passthrough, disabling it");
+        }
+    }
+    NegotiateConnection(conn, passthrough != 0);
+#else
+    NegotiateConnection(conn, false);
+#endif
+    ConfigureDirListing();
+
+    /* Start threads here, as session is daemonized before init
+       (once, init is called by session of each mount) */
+    if (sessionsStarted++ != 0)
+        return;
+    if (notifier)
+        notifier->start();
+    if (scanner)
+        scanner->start();
+    if (scanahead)
+        scanahead->start();
+    if (client)
+        client->start();
+    if (breaker)
+        breaker->start();
+#ifdef HAVE_LIBCLAMAV
+    if (engine)
+        engine->start();
+#endif
+}
+
+static void clamfs_ll_lookup(fuse_req_t req, fuse_ino_t parent, const char *name)
+{
+    struct fuse_entry_param e;
+    int err = do_lookup(req, parent, name, &e);
+    if (err)
+        reply_err(req, err);
+    else
+        fuse_reply_entry(req, &e);
+}
+
+static void clamfs_ll_forget(fuse_req_t req, fuse_ino_t ino, uint64_t nlookup)
+{
+    forget_one(ino, nlookup);
+    fuse_reply_none(req);
+}
+
+static void clamfs_ll_forget_multi(fuse_req_t req, size_t count,
+                                   struct fuse_forget_data *forgets)
+{
+    for (size_t i = 0; i < count; ++i)
+        forget_one(forgets[i].ino, forgets[i].nlookup);
+    fuse_reply_none(req);
+}
+
+static void clamfs_ll_getattr(fuse_req_t req, fuse_ino_t ino,
+                              struct fuse_file_info *fi)
+{
+    int res;
+    struct stat st;
+
+    if (fi != NULL)
+        res = fstat((int)fi->fh, &st);
+    else
+        res = fstatat(inode_fd(req, ino), "", &st, AT_EMPTY_PATH | AT_SYMLINK_NOFOLLOW);
+    if (res == -1)
+        reply_err(req, errno);
+    else
+        fuse_reply_attr(req, &st, 0.0);
+}
+
+static void clamfs_ll_setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr,
+                              int valid, struct fuse_file_info *fi)
+{
+    int res;
+    int ifd = inode_fd(req, ino);
+    char procname[64];
+    proc_path(ifd, procname, sizeof(procname));
+
+    if (valid & FUSE_SET_ATTR_MODE) {
+        if (fi != NULL)
+            res = fchmod((int)fi->fh, attr->st_mode);
+        else
+            res = chmod(procname, attr->st_mode);
+        if (res == -1)
+            goto out_err;
+    }
+    if (valid & (FUSE_SET_ATTR_UID | FUSE_SET_ATTR_GID)) {
+        uid_t uid = (valid & FUSE_SET_ATTR_UID) ? attr->st_uid : (uid_t) -1;
+        gid_t gid = (valid & FUSE_SET_ATTR_GID) ? attr->st_gid : (gid_t) -1;
+        res = fchownat(ifd, "", uid, gid, AT_EMPTY_PATH | AT_SYMLINK_NOFOLLOW);
+        if (res == -1)
+            goto out_err;
+    }
+    if (valid & FUSE_SET_ATTR_SIZE) {
+        if (fi != NULL)
+            res = ftruncate((int)fi->fh, attr->st_size);
+        else
+            res = truncate(procname, attr->st_size);
+        if (res == -1)
+            goto out_err;
+    }
+    if (valid & (FUSE_SET_ATTR_ATIME | FUSE_SET_ATTR_MTIME)) {
+        struct timespec tv[2];
+
+        tv[0].tv_sec = 0;
+        tv[1].tv_sec = 0;
+        tv[0].tv_nsec = UTIME_OMIT;
+        tv[1].tv_nsec = UTIME_OMIT;
+
+        if (valid & FUSE_SET_ATTR_ATIME_NOW)
+            tv[0].tv_nsec = UTIME_NOW;
+        else if (valid & FUSE_SET_ATTR_ATIME)
+            tv[0] = attr->st_atim;
+
+        if (valid & FUSE_SET_ATTR_MTIME_NOW)
+            tv[1].tv_nsec = UTIME_NOW;
+        else if (valid & FUSE_SET_ATTR_MTIME)
+            tv[1] = attr->st_mtim;
+
+        if (fi != NULL)
+            res = futimens((int)fi->fh, tv);
+        else
+            res = utimensat(AT_FDCWD, procname, tv, 0);
+        if (res == -1)
+            goto out_err;
+    }
+
+    clamfs_ll_getattr(req, ino, fi);
+    return;
+
+out_err:
+    reply_err(req, errno);
+}
+
+static void clamfs_ll_readlink(fuse_req_t req, fuse_ino_t ino)
+{
+    char buf[PATH_MAX + 1];
+
+    ssize_t res = readlinkat(inode_fd(req, ino), "", buf, sizeof(buf));
+    if (res == -1)
+        reply_err(req, errno);
+    else if (res == sizeof(buf))
+        reply_err(req, ENAMETOOLONG);
+    else {
+        buf[res] = '\0';
+        fuse_reply_readlink(req, buf);
+    }
+}
+
+/*!\brief Creates directory, special file or symlink and replies with its entry */
+static void make_node(fuse_req_t req, fuse_ino_t parent, const char *name,
+                      mode_t mode, dev_t rdev, const char *link)
+{
+    int res;
+    int dirfd = inode_fd(req, parent);
+
+    if (S_ISDIR(mode))
+        res = mkdirat(dirfd, name, mode);
+    else if (S_ISLNK(mode))
+        res = symlinkat(link, dirfd, name);
+    else
+        res = mknodat(dirfd, name, mode, rdev);
+    if (res == -1) {
+        reply_err(req, errno);
+        return;
+    }
+    chown_node(req, dirfd, name);
+
+    clamfs_ll_lookup(req, parent, name);
+}
+
+static void clamfs_ll_mknod(fuse_req_t req, fuse_ino_t parent, const char *name,
+                            mode_t mode, dev_t rdev)
+{
+    make_node(req, parent, name, mode, rdev, NULL);
+}
+
+static void clamfs_ll_mkdir(fuse_req_t req, fuse_ino_t parent, const char *name,
+                            mode_t mode)
+{
+    make_node(req, parent, name, S_IFDIR | mode, 0, NULL);
+}
+
+static void clamfs_ll_symlink(fuse_req_t req, const char *link,
+                              fuse_ino_t parent, const char *name)
+{
+    make_node(req, parent, name, S_IFLNK, 0, link);
+}
+
+static void clamfs_ll_link(fuse_req_t req, fuse_ino_t ino, fuse_ino_t parent,
+                           const char *name)
+{
+    char procname[64];
+    proc_path(inode_fd(req, ino), procname, sizeof(procname));
+
+    if (linkat(AT_FDCWD, procname, inode_fd(req, parent), name, AT_SYMLINK_FOLLOW) == -1)
+        reply_err(req, errno);
+    else
+        clamfs_ll_lookup(req, parent, name);
+}
+
+static void clamfs_ll_unlink(fuse_req_t req, fuse_ino_t parent, const char *name)
+{
+    int res = unlinkat(inode_fd(req, parent), name, 0);
+    reply_err(req, (res == -1) ? errno : 0);
+}
+
+static void clamfs_ll_rmdir(fuse_req_t req, fuse_ino_t parent, const char *name)
+{
+    int res = unlinkat(inode_fd(req, parent), name, AT_REMOVEDIR);
+    reply_err(req, (res == -1) ? errno : 0);
+}
+
+static void clamfs_ll_rename(fuse_req_t req, fuse_ino_t parent, const char *name,
+                             fuse_ino_t newparent, const char *newname,
+                             unsigned int flags)
+{
+    /* When we have renameat2() in libc, then we can implement flags */
+    if (flags) {
+        reply_err(req, EINVAL);
+        return;
+    }
+
+    int res = renameat(inode_fd(req, parent), name, inode_fd(req, newparent), newname);
+    reply_err(req, (res == -1) ? errno : 0);
+}
+
+static void clamfs_ll_access(fuse_req_t req, fuse_ino_t ino, int mask)
+{
+    char procname[64];
+    proc_path(inode_fd(req, ino), procname, sizeof(procname));
+
+    int res = access(procname, mask);
+    reply_err(req, (res == -1) ? errno : 0);
+}
+
+static void clamfs_ll_opendir(fuse_req_t req, fuse_ino_t ino,
+                              struct fuse_file_info *fi)
+{
+    int fd = openat(inode_fd(req, ino), ".", O_RDONLY | O_DIRECTORY);
+    if (fd == -1) {
+        reply_err(req, errno);
+        return;
+    }
+
+    fi->fh = (unsigned long) new DirListing(fd);
+    fuse_reply_open(req, fi);
+}
+
+/*!\brief Common part of readdir() and readdirplus() callbacks */
+static void do_readdir(fuse_req_t req, fuse_ino_t ino, size_t size,
+                       off_t offset, struct fuse_file_info *fi, bool plus)
+{
+    DirListing *d = get_dirp(fi);
+    vector<ahead_entry> files;
+    int err = 0;
+
+    char *buf = (char*)malloc(size);
+    if (buf == NULL) {
+        reply_err(req, ENOMEM);
+        return;
+    }
+    char *p = buf;
+    size_t rem = size;
+
+    while (1) {
+        size_t entsize;
+        dirlist_entry entry;
+
+        int res = d->get(offset, entry);
+        if (res <= 0) {
+            err = -res;
+            break;
+        }
+
+        /* offset of entry is its index in listing, so next one is + 1 */
+        if (plus) {
+            struct fuse_entry_param e;
+
+            if ((strcmp(entry.name, ".") == 0) || (strcmp(entry.name, "..") == 0)) {
+                memset(&e, 0, sizeof(e));
+                e.attr.st_ino = entry.ino;
+                e.attr.st_mode = (unsigned int)entry.type << 12;
+            } else {
+                err = do_lookup(req, ino, entry.name, &e);
+                if (err == ENOENT) {
+                    /* removed since listing was read */
+                    err = 0;
+                    ++offset;
+                    continue;
+                }
+                if (err)
+                    break;
+            }
+
+            entsize = fuse_add_direntry_plus(req, p, rem, entry.name, &e, offset + 1);
+            if (entsize > rem) {
+                if (e.ino)
+                    forget_one(e.ino, 1);
+                break;
+            }
+        } else {
+            struct stat st;
+
+            memset(&st, 0, sizeof(st));
+            st.st_ino = entry.ino;
+            st.st_mode = (unsigned int)entry.type << 12;
+
+            entsize = fuse_add_direntry(req, p, rem, entry.name, &st, offset + 1);
+            if (entsize > rem)
+                break;
+        }
+        p += entsize;
+        rem -= entsize;
+        if ((scanahead != NULL) && ((entry.type == DT_REG) || (entry.type == DT_UNKNOWN))) {
+            ahead_entry file;
+            file.name = entry.name;
+            file.ino = entry.ino;
+            files.push_back(file);
+        }
+        ++offset;
+    }
+
+    if (!files.empty()) {
+        struct fuse_context context;
+        get_context(req, &context);
+        scanahead->listed(d->fd(), files, &context);
+    }
+
+    /* report error only if nothing has been read yet */
+    if (err && (rem == size))
+        reply_err(req, err);
+    else
+        fuse_reply_buf(req, buf, size - rem);
+    free(buf);
+}
+
+static void clamfs_ll_readdir(fuse_req_t req, fuse_ino_t ino, size_t size,
+                              off_t offset, struct fuse_file_info *fi)
+{
+    do_readdir(req, ino, size, offset, fi, false);
+}
+
+static void clamfs_ll_readdirplus(fuse_req_t req, fuse_ino_t ino, size_t size,
+                                  off_t offset, struct fuse_file_info *fi)
+{
+    do_readdir(req, ino, size, offset, fi, true);
+}
+
+static void clamfs_ll_releasedir(fuse_req_t req, fuse_ino_t ino,
+                                 struct fuse_file_info *fi)
+{
+    (void) ino;
+    delete get_dirp(fi);
+    reply_err(req, 0);
+}
+
+static void clamfs_ll_fsyncdir(fuse_req_t req, fuse_ino_t ino, int isdatasync,
+                               struct fuse_file_info *fi)
+{
+    int res;
+    int fd = get_dirp(fi)->fd();
+    (void) ino;
+
+#ifndef HAVE_FDATASYNC
+    (void) isdatasync;
+#else
+    if (isdatasync)
+        res = fdatasync(fd);
+    else
+#endif
+        res = fsync(fd);
+    reply_err(req, (res == -1) ? errno : 0);
+}
+
+/*!\brief Checks opened file with CheckOpenedFile()
+   \param req FUSE request
+   \param fi information about open files (fh is set if access is allowed)
+   \param fd backing file descriptor opened without O_TRUNC
+   \param scanfd read only descriptor for scan (fd, other descriptor or -1)
+   \returns 0 if file is allowed or -errno (descriptors are closed then)
+*/
+static int check_opened(fuse_req_t req, struct fuse_file_info *fi, int fd, int scanfd)
+{
+    char procname[64];
+    char pathbuf[PATH_MAX];
+
+    /*
+     * Path is needed only for path policy, extension ACL and logs
+     */
+    proc_path(fd, procname, sizeof(procname));
+    const char *path = inode_path(req, procname, pathbuf, sizeof(pathbuf));
+    if (path == NULL) {
+        int err = errno;
+        if (scanfd != fd)
+            close(scanfd);
+        close(fd);
+        return -err;
+    }
+
+    /* path outside of root (or root is "/") is absolute already */
+    const char *root = (path == pathbuf) ? "" : get_mount(req)->rootPath.c_str();
+
+    struct fuse_context context;
+    get_context(req, &context);
+    return CheckOpenedFile(root, path, fi, fd, scanfd, &context);
+}
+
+static void clamfs_ll_create(fuse_req_t req, fuse_ino_t parent, const char *name,
+                             mode_t mode, struct fuse_file_info *fi)
+{
+    struct fuse_entry_param e;
+    int dirfd = inode_fd(req, parent);
+
+    AdjustOpenFlags(fi);
+    int fd = openat(dirfd, name, (fi->flags | O_CREAT) & ~(O_NOFOLLOW | O_TRUNC), mode);
+    if (fd == -1) {
+        reply_err(req, errno);
+        return;
+    }
+    chown_node(req, dirfd, name);
+
+    int err = do_lookup(req, parent, name, &e);
+    if (err) {
+        close(fd);
+        reply_err(req, err);
+        return;
+    }
+
+    /*
+     * New file is empty, there is nothing to scan. File created since
+     * lookup of kernel (through other share or in root) may be not,
+     * it is checked like opened one (O_TRUNC is applied after that).
+     */
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        err = errno;
+        close(fd);
+        forget_one(e.ino, 1);
+        reply_err(req, err);
+        return;
+    }
+    if (st.st_size == 0) {
+        fi->fh = (unsigned long) fd;
+    } else {
+        INC_STAT_COUNTER(openCalled);
+        int scanfd = fd;
+        if ((fi->flags & O_ACCMODE) == O_WRONLY) {
+            char procname[64];
+            proc_path(fd, procname, sizeof(procname));
+            scanfd = open(procname, O_RDONLY);
+        }
+        int res = check_opened(req, fi, fd, scanfd);
+        if (res != 0) {
+            forget_one(e.ino, 1);
+            reply_err(req, -res);
+            return;
+        }
+    }
+
+#ifdef HAVE_FUSE_PASSTHROUGH
+    open_passthrough(req, fi);
+#endif
+    fuse_reply_create(req, &e, fi);
+}
+
+static void clamfs_ll_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+    char procname[64];
+
+    INC_STAT_COUNTER(openCalled);
+
+    /*
+     * Dump stats to log periodically
+     */
+    if (stats) {
+        stats->periodicDumpToLog();
+    }
+
+    /*
+     * Reopen O_PATH descriptor, the same way clamfs_open() opens path
+     * (O_TRUNC is applied only after file is allowed, write only opens
+     * get separate read only descriptor for scan)
+     */
+    AdjustOpenFlags(fi);
+    proc_path(inode_fd(req, ino), procname, sizeof(procname));
+    int fd = open(procname, fi->flags & ~(O_NOFOLLOW | O_TRUNC));
+    if (fd == -1) {
+        reply_err(req, errno);
+        return;
+    }
+    int scanfd = fd;
+    if ((fi->flags & O_ACCMODE) == O_WRONLY)
+        scanfd = open(procname, O_RDONLY);
+
+    int res = check_opened(req, fi, fd, scanfd);
+    if (res != 0) {
+        reply_err(req, -res);
+        return;
+    }
+
+#ifdef HAVE_FUSE_PASSTHROUGH
+    open_passthrough(req, fi);
+#endif
+    fuse_reply_open(req, fi);
+}
+
+static void clamfs_ll_read(fuse_req_t req, fuse_ino_t ino, size_t size,
+                           off_t offset, struct fuse_file_info *fi)
+{
+    (void) ino;
+
+    if (scanner) {
+        int res = scanner->checkRead((int)fi->fh, offset, size);
+        if (res != 0) {
+            reply_err(req, -res);
+            return;
+        }
+    }
+
+    struct fuse_bufvec buf = FUSE_BUFVEC_INIT(size);
+
+    buf.buf[0].flags = (fuse_buf_flags)(FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK);
+    buf.buf[0].fd = (int)fi->fh;
+    buf.buf[0].pos = offset;
+
+    /* data is spliced by reply, count requested size */
+    OperationScope::moved(size);
+    fuse_reply_data(req, &buf, FUSE_BUF_SPLICE_MOVE);
+}
+
+static void clamfs_ll_write_buf(fuse_req_t req, fuse_ino_t ino,
+                                struct fuse_bufvec *in_buf, off_t offset,
+                                struct fuse_file_info *fi)
+{
+    struct fuse_bufvec dst = FUSE_BUFVEC_INIT(fuse_buf_size(in_buf));
+    (void) ino;
+
+    dst.buf[0].flags = (fuse_buf_flags)(FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK);
+    dst.buf[0].fd = (int)fi->fh;
+    dst.buf[0].pos = offset;
+
+    ssize_t res = fuse_buf_copy(&dst, in_buf, FUSE_BUF_SPLICE_NONBLOCK);
+    if (res < 0) {
+        reply_err(req, (int)-res);
+    } else {
+        OperationScope::moved((size_t)res);
+        fuse_reply_write(req, (size_t)res);
+    }
+}
+
+static void clamfs_ll_statfs(fuse_req_t req, fuse_ino_t ino)
+{
+    struct statvfs stbuf;
+
+    if (fstatvfs(inode_fd(req, ino), &stbuf) == -1)
+        reply_err(req, errno);
+    else
+        fuse_reply_statfs(req, &stbuf);
+}
+
+static void clamfs_ll_flush(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+    (void) ino;
+#ifdef F_OFD_SETLK
+    /* close() drops POSIX locks of process (high-level API does it for us) */
+    if (locks)
+        locks->unlock((int)fi->fh, fi->lock_owner);
+#endif
+    /* see clamfs_flush(), this must not really close the file */
+    int res = close(dup((int)fi->fh));
+    reply_err(req, (res == -1) ? errno : 0);
+}
+
+static void clamfs_ll_release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+    (void) ino;
+#ifdef HAVE_FUSE_PASSTHROUGH
+    release_passthrough(req, fi);
+#endif
+    if (scanner)
+        scanner->release((int)fi->fh);
+#ifdef F_OFD_SETLK
+    if (locks)
+        locks->release((int)fi->fh);
+#endif
+    close((int)fi->fh);
+    reply_err(req, 0);
+}
+
+static void clamfs_ll_fsync(fuse_req_t req, fuse_ino_t ino, int isdatasync,
+                            struct fuse_file_info *fi)
+{
+    int res;
+    (void) ino;
+
+#ifndef HAVE_FDATASYNC
+    (void) isdatasync;
+#else
+    if (isdatasync)
+        res = fdatasync((int)fi->fh);
+    else
+#endif
+        res = fsync((int)fi->fh);
+    reply_err(req, (res == -1) ? errno : 0);
+}
+
+#ifdef HAVE_POSIX_FALLOCATE
+static void clamfs_ll_fallocate(fuse_req_t req, fuse_ino_t ino, int mode,
+                                off_t offset, off_t length, struct fuse_file_info *fi)
+{
+    (void) ino;
+
+    if (mode) {
+        reply_err(req, EOPNOTSUPP);
+        return;
+    }
+
+    reply_err(req, posix_fallocate((int)fi->fh, offset, length));
+}
+#endif
+
+static void clamfs_ll_flock(fuse_req_t req, fuse_ino_t ino,
+                            struct fuse_file_info *fi, int op)
+{
+    (void) ino;
+    int res = flock((int)fi->fh, op);
+    reply_err(req, (res == -1) ? errno : 0);
+}
+
+#ifdef F_OFD_SETLK
+static void clamfs_ll_getlk(fuse_req_t req, fuse_ino_t ino,
+                            struct fuse_file_info *fi, struct flock *lock)
+{
+    (void) ino;
+    int res = locks->lock((int)fi->fh, fi->lock_owner, F_GETLK, lock, req);
+    if (res == 0)
+        fuse_reply_lock(req, lock);
+    else
+        reply_err(req, -res);
+}
+
+static void clamfs_ll_setlk(fuse_req_t req, fuse_ino_t ino,
+                            struct fuse_file_info *fi, struct flock *lock, int sleep)
+{
+    (void) ino;
+    int res = locks->lock((int)fi->fh, fi->lock_owner, sleep ? F_SETLKW : F_SETLK, lock, req);
+    reply_err(req, -res);
+}
+#endif
+
+#ifdef HAVE_SETXATTR
+static void clamfs_ll_setxattr(fuse_req_t req, fuse_ino_t ino, const char *name,
+                               const char *value, size_t size, int flags)
+{
+    char procname[64];
+    proc_path(inode_fd(req, ino), procname, sizeof(procname));
+
+    int res = setxattr(procname, name, value, size, flags);
+    reply_err(req, (res == -1) ? errno : 0);
+}
+
+static void clamfs_ll_getxattr(fuse_req_t req, fuse_ino_t ino, const char *name,
+                               size_t size)
+{
+    char procname[64];
+    proc_path(inode_fd(req, ino), procname, sizeof(procname));
+
+    if (size == 0) {
+        ssize_t res = getxattr(procname, name, NULL, 0);
+        if (res == -1)
+            reply_err(req, errno);
+        else
+            fuse_reply_xattr(req, (size_t)res);
+        return;
+    }
+
+    char *value = (char*)malloc(size);
+    if (value == NULL) {
+        reply_err(req, ENOMEM);
+        return;
+    }
+    ssize_t res = getxattr(procname, name, value, size);
+    if (res == -1)
+        reply_err(req, errno);
+    else
+        fuse_reply_buf(req, value, (size_t)res);
+    free(value);
+}
+
+static void clamfs_ll_listxattr(fuse_req_t req, fuse_ino_t ino, size_t size)
+{
+    char procname[64];
+    proc_path(inode_fd(req, ino), procname, sizeof(procname));
+
+    if (size == 0) {
+        ssize_t res = listxattr(procname, NULL, 0);
+        if (res == -1)
+            reply_err(req, errno);
+        else
+            fuse_reply_xattr(req, (size_t)res);
+        return;
+    }
+
+    char *list = (char*)malloc(size);
+    if (list == NULL) {
+        reply_err(req, ENOMEM);
+        return;
+    }
+    ssize_t res = listxattr(procname, list, size);
+    if (res == -1)
+        reply_err(req, errno);
+    else
+        fuse_reply_buf(req, list, (size_t)res);
+    free(list);
+}
+
+static void clamfs_ll_removexattr(fuse_req_t req, fuse_ino_t ino, const char *name)
+{
+    char procname[64];
+    proc_path(inode_fd(req, ino), procname, sizeof(procname));
+
+    int res = removexattr(procname, name);
+    reply_err(req, (res == -1) ? errno : 0);
+}
+#endif /* HAVE_SETXATTR */
+
+#ifdef HAVE_COPY_FILE_RANGE
+static void clamfs_ll_copy_file_range(fuse_req_t req, fuse_ino_t ino_in, off_t off_in,
+                                      struct fuse_file_info *fi_in,
+                                      fuse_ino_t ino_out, off_t off_out,
+                                      struct fuse_file_info *fi_out, size_t len,
+                                      int flags)
+{
+    (void) ino_in;
+    (void) ino_out;
+
+    /* copied data must pass the same verdict check as read */
+    if (scanner) {
+        int err = scanner->checkRead((int)fi_in->fh, off_in, len);
+        if (err != 0) {
+            reply_err(req, -err);
+            return;
+        }
+    }
+
+    ssize_t res = copy_file_range((int)fi_in->fh, &off_in, (int)fi_out->fh,
+                                  &off_out, len, (unsigned int)flags);
+    if (res == -1) {
+        reply_err(req, errno);
+    } else {
+        OperationScope::moved((size_t)res);
+        fuse_reply_write(req, (size_t)res);
+    }
+}
+#endif
+
+#ifdef HAVE_FUSE_LSEEK
+static void clamfs_ll_lseek(fuse_req_t req, fuse_ino_t ino, off_t off, int whence,
+                            struct fuse_file_info *fi)
+{
+    (void) ino;
+
+    off_t res = lseek((int)fi->fh, off, whence);
+    if (res == -1)
+        reply_err(req, errno);
+    else
+        fuse_reply_lseek(req, res);
+}
+#endif
+
+} /* extern "C" */
+
+void clamfs_mount::run()
+{
+    if (opts.singlethread)
+        ret = fuse_session_loop(se);
+    else
+        ret = fuse_session_loop_mt(se, opts.clone_fd);
+}
+
+/*!\brief Opens root directory of mount, creates its session and mounts it
+   \param m mount to set up
+   \param mount root and FUSE arguments of mount
+   \param oper low-level operations
+   \returns true on success
+*/
+static bool open_mount(clamfs_mount *m, const lowlevel_mount& mount,
+                       const struct fuse_lowlevel_ops *oper)
+{
+    Logger& logger = Logger::root();
+
+    /*
+     * Open root directory and remember its canonical path
+     */
+    char *canonical = realpath(mount.root, NULL);
+    m->root.fd = open(mount.root, O_PATH);
+    if ((canonical == NULL) || (m->root.fd == -1)) {
+        poco_warning_f2(logger, "cannot open root directory %s: %s",
+            string(mount.root), string(strerror(errno)));
+        free(canonical);
+        return false;
+    }
+    m->rootPath = canonical;
+    free(canonical);
+    m->root.nlookup = 2; /* never freed */
+
+    struct fuse_args args = FUSE_ARGS_INIT(mount.argc, mount.argv);
+    m->args = args;
+    if (fuse_parse_cmdline(&m->args, &m->opts) != 0)
+        return false;
+
+    m->se = fuse_session_new(&m->args, oper, sizeof(*oper), m);
+    if (m->se == NULL)
+        return false;
+    if (fuse_session_mount(m->se, m->opts.mountpoint) != 0) {
+        fuse_session_destroy(m->se);
+        m->se = NULL;
+        return false;
+    }
+    poco_information_f2(logger, "serving %s on %s",
+        string(m->rootPath), string(m->opts.mountpoint));
+    return true;
+}
+
+/*!\brief Unmounts mount (if mounted) and frees its resources */
+static void close_mount(clamfs_mount *m)
+{
+    if (m->se != NULL) {
+        fuse_session_unmount(m->se);
+        fuse_session_destroy(m->se);
+    }
+    free(m->opts.mountpoint);
+    fuse_opt_free_args(&m->args);
+    if (m->root.fd != -1)
+        close(m->root.fd);
+    delete m;
+}
+
+int LowLevelMain(const vector<lowlevel_mount>& mounts)
+{
+    struct fuse_lowlevel_ops clamfs_ll_oper;
+    vector<clamfs_mount*> sessions;
+    int ret = 1;
+
+    Logger& logger = Logger::root();
+
+    /*
+     * Make sure all pointers are initialy set to NULL
+     */
+    memset(&clamfs_ll_oper, 0, sizeof(fuse_lowlevel_ops));
+
+    /*
+     * Callbacks (but init) are wrapped for stats module, errors and
+     * bytes moved are counted by reply_err() and OperationScope::moved()
+     */
+    clamfs_ll_oper.init         = clamfs_ll_init;
+    clamfs_ll_oper.lookup       = INSTRUMENT(lookup, clamfs_ll_lookup);
+    clamfs_ll_oper.forget       = INSTRUMENT(forget, clamfs_ll_forget);
+    clamfs_ll_oper.forget_multi = INSTRUMENT(forget, clamfs_ll_forget_multi);
+    clamfs_ll_oper.getattr      = INSTRUMENT(getattr, clamfs_ll_getattr);
+    clamfs_ll_oper.setattr      = INSTRUMENT(setattr, clamfs_ll_setattr);
+    clamfs_ll_oper.readlink     = INSTRUMENT(readlink, clamfs_ll_readlink);
+    clamfs_ll_oper.mknod        = INSTRUMENT(mknod, clamfs_ll_mknod);
+    clamfs_ll_oper.mkdir        = INSTRUMENT(mkdir, clamfs_ll_mkdir);
+    clamfs_ll_oper.symlink      = INSTRUMENT(symlink, clamfs_ll_symlink);
+    clamfs_ll_oper.link         = INSTRUMENT(link, clamfs_ll_link);
+    clamfs_ll_oper.unlink       = INSTRUMENT(unlink, clamfs_ll_unlink);
+    clamfs_ll_oper.rmdir        = INSTRUMENT(rmdir, clamfs_ll_rmdir);
+    clamfs_ll_oper.rename       = INSTRUMENT(rename, clamfs_ll_rename);
+    clamfs_ll_oper.access       = INSTRUMENT(access, clamfs_ll_access);
+    clamfs_ll_oper.opendir      = INSTRUMENT(opendir, clamfs_ll_opendir);
+    clamfs_ll_oper.readdir      = INSTRUMENT(readdir, clamfs_ll_readdir);
+    clamfs_ll_oper.readdirplus  = INSTRUMENT(readdirplus, clamfs_ll_readdirplus);
+    clamfs_ll_oper.releasedir   = INSTRUMENT(releasedir, clamfs_ll_releasedir);
+    clamfs_ll_oper.fsyncdir     = INSTRUMENT(fsyncdir, clamfs_ll_fsyncdir);
+    clamfs_ll_oper.create       = INSTRUMENT(create, clamfs_ll_create);
+    clamfs_ll_oper.open         = INSTRUMENT(open, clamfs_ll_open);
+    clamfs_ll_oper.read         = INSTRUMENT(read, clamfs_ll_read);
+    clamfs_ll_oper.write_buf    = INSTRUMENT(write_buf, clamfs_ll_write_buf);
+    clamfs_ll_oper.statfs       = INSTRUMENT(statfs, clamfs_ll_statfs);
+    clamfs_ll_oper.flush        = INSTRUMENT(flush, clamfs_ll_flush);
+    clamfs_ll_oper.release      = INSTRUMENT(release, clamfs_ll_release);
+    clamfs_ll_oper.fsync        = INSTRUMENT(fsync, clamfs_ll_fsync);
+#ifdef HAVE_POSIX_FALLOCATE
+    clamfs_ll_oper.fallocate    = INSTRUMENT(fallocate, clamfs_ll_fallocate);
+#endif
+    clamfs_ll_oper.flock        = INSTRUMENT(flock, clamfs_ll_flock);
+#ifdef F_OFD_SETLK
+    if (locks) {
+        clamfs_ll_oper.getlk    = INSTRUMENT(getlk, clamfs_ll_getlk);
+        clamfs_ll_oper.setlk    = INSTRUMENT(setlk, clamfs_ll_setlk);
+    }
+#endif
+#ifdef HAVE_SETXATTR
+    clamfs_ll_oper.setxattr     = INSTRUMENT(setxattr, clamfs_ll_setxattr);
+    clamfs_ll_oper.getxattr     = INSTRUMENT(getxattr, clamfs_ll_getxattr);
+    clamfs_ll_oper.listxattr    = INSTRUMENT(listxattr, clamfs_ll_listxattr);
+    clamfs_ll_oper.removexattr  = INSTRUMENT(removexattr, clamfs_ll_removexattr);
+#endif
+#ifdef HAVE_COPY_FILE_RANGE
+    clamfs_ll_oper.copy_file_range = INSTRUMENT(copy_file_range, clamfs_ll_copy_file_range);
+#endif
+#ifdef HAVE_FUSE_LSEEK
+    clamfs_ll_oper.lseek        = INSTRUMENT(lseek, clamfs_ll_lseek);
+#endif
+
+    if ((config["passthrough"] != NULL) &&
+        (strncmp(config["passthrough"], "yes", 3) == 0)) {
+#ifdef HAVE_FUSE_PASSTHROUGH
+        passthrough = 1;
+#else
+        poco_warning(logger, "FUSE library does not support passthrough, option ignored");
+#endif
+    }
+
+    /*
+     * Mount all file systems before daemonizing (so errors are reported)
+     */
+    poco_information_f1(logger, "low-level FUSE API serving %z file system(s)", mounts.size());
+    bool ready = !mounts.empty();
+    for (size_t i = 0; ready && (i < mounts.size()); ++i) {
+        sessions.push_back(new clamfs_mount);
+        ready = open_mount(sessions.back(), mounts[i], &clamfs_ll_oper);
+    }
+
+    /*
+     * First mount is served by this thread and gets signal handlers,
+     * all other mounts by their own threads. When first session ends
+     * (signal or unmount) other mounts are unmounted, so their session
+     * loops end too.
+     */
+    if (ready && (fuse_set_signal_handlers(sessions[0]->se) == 0)) {
+        fuse_daemonize(sessions[0]->opts.foreground);
+        for (size_t i = 1; i < sessions.size(); ++i)
+            sessions[i]->thread.start(*sessions[i]);
+        sessions[0]->run();
+        for (size_t i = 1; i < sessions.size(); ++i) {
+            fuse_session_exit(sessions[i]->se);
+            fuse_session_unmount(sessions[i]->se);
+            sessions[i]->thread.join();
+        }
+        fuse_remove_signal_handlers(sessions[0]->se);
+
+        ret = 0;
+        for (size_t i = 0; i < sessions.size(); ++i)
+            if (sessions[i]->ret != 0)
+                ret = 1;
+    }
+
+    for (size_t i = 0; i < sessions.size(); ++i)
+        close_mount(sessions[i]);
+
+    /*
+     * Free inodes kernel has not forgotten before unmount
+     */
+    for (inode_map::iterator it = inodes.begin(); it != inodes.end(); ++it) {
+        close(it->second->fd);
+        delete it->second;
+    }
+    inodes.clear();
+
+    return ret;
+}
+
+} /* namespace clamfs */
+
+/* EoF */
@@ -0,0 +1,71 @@
+/*!\file lowlevel.hxx
+
+   \brief Low-level (inode based) FUSE backend (header file)
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef CLAMFS_LOWLEVEL_HXX
+#define CLAMFS_LOWLEVEL_HXX
+
+#include "config.h"
+
+#include <vector>
+
+#ifdef DMALLOC
+   #include <stdlib.h>
+   #ifdef HAVE_MALLOC_H
+      #include <malloc.h>
+   #endif
+   #include <dmalloc.h>
+#endif
+
+namespace clamfs {
+
+/*!\struct lowlevel_mount
+   \brief File system served by LowLevelMain()
+*/
+struct lowlevel_mount {
+    /*!\brief backing directory */
+    const char *root;
+    /*!\brief FUSE arguments counter */
+    int argc;
+    /*!\brief FUSE arguments (the same as passed to fuse_main()) */
+    char **argv;
+};
+
+/*!\brief Mounts file systems with low-level FUSE API and serves requests
+   \param mounts file systems to serve (first one gets signal handlers)
+   \returns 0 on success, 1 on error (like fuse_main())
+
+   Each inode known to the kernel keeps O_PATH descriptor of backing
+   file and all operations are done with *at() calls relative to it,
+   so paths are never rebuilt nor resolved again from root. Opened
+   files are checked with CheckOpenedFile(), like with high-level API.
+   Every mount has its own FUSE session (and thread), while scan
+   engine, ScanCache and Stats are shared by all of them.
+*/
+int LowLevelMain(const std::vector<lowlevel_mount>& mounts);
+
+} /* namespace clamfs */
+
+#endif /* CLAMFS_LOWLEVEL_HXX */
+
+/* EoF */
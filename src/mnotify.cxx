@@ -33,50 +33,32 @@ static const char* crlf = "\r\n";
    \param recipient To: address
    \param sender From: address
    \param subject Subject: header
-   \param scanresult message from clamd
-   \returns 0 on success or -1 on smtp error and -2 on insufficient parameters
+   \param body message body
+   \returns 0 on success or 1 on smtp error and -2 on insufficient parameters
 */
 int SendMailNotification(const char* mx, const char* recipient,
                          const char* sender, const char* subject,
-                         const char* scanresult)
+                         const string& body)
 {
-    char* username;
-    char* callername;
-
     /*
      * Check if all parameters are defined
      */
     if ((mx == NULL) ||
         (recipient == NULL) ||
         (sender == NULL) ||
-        (subject == NULL) ||
-        (scanresult == NULL))
+        (subject == NULL))
         return -2;
 
-    username = getusername();
-    callername = getcallername();
-
     /*
      * Try to send message
      */
     try {
         MailMessage mmsg;
-        stringstream body;
 
         mmsg.setSender(sender);
         mmsg.addRecipient(MailRecipient(MailRecipient::PRIMARY_RECIPIENT, recipient));
         mmsg.setSubject(subject);
-
-        body << "Hello ClamFS User," << crlf << crlf;
-        body << "This is an automatic notification about virus found." << crlf << crlf;
-        body << "Executable name: " << callername << crlf;
-        body << "            PID: " << fuse_get_context()->pid << crlf << crlf;
-        body << "       Username: " << username << crlf;
-        body << "            UID: " << fuse_get_context()->uid << crlf << crlf;
-        body << "ClamAV reported malicious file:" << crlf;
-        body << scanresult << crlf;
-
-        mmsg.setContent(body.str());
+        mmsg.setContent(body);
 
         SMTPClientSession session(mx);
         session.login();
@@ -86,18 +68,127 @@ int SendMailNotification(const char* mx, const char* recipient,
         Logger& logger = Logger::root();
         poco_information_f1(logger, "Got exception when sending mail notification: %s", exc.displayText());
 
-        free(username);
-        free(callername);
-
         return 1;
     }
 
-    free(username);
-    free(callername);
-
     return 0;
 }
 
+MailNotifier::MailNotifier(const char* mx, const char* recipient,
+                           const char* sender, const char* subject,
+                           long digestDelay, int maxRetries):
+    mailServer(mx), mailRecipient(recipient),
+    mailSender(sender), mailSubject(subject),
+    delay(digestDelay), retries(maxRetries),
+    dropped(0), stopping(false), thread("mnotify") {
+}
+
+MailNotifier::~MailNotifier() {
+    stop();
+}
+
+void MailNotifier::start() {
+    thread.start(*this);
+}
+
+void MailNotifier::stop() {
+    {
+        Mutex::ScopedLock lock(mutex);
+        if (stopping)
+            return;
+        stopping = true;
+        queued.broadcast();
+    }
+    stopped.set();
+    if (thread.isRunning())
+        thread.join();
+}
+
+void MailNotifier::enqueue(const MailAlert& alert) {
+    Mutex::ScopedLock lock(mutex);
+    if (queue.size() >= MAIL_QUEUE_MAX) {
+        ++dropped;
+        return;
+    }
+    queue.push_back(alert);
+    queued.signal();
+}
+
+void MailNotifier::run() {
+    Mutex::ScopedLock lock(mutex);
+    while (true) {
+        while (queue.empty() && !stopping)
+            queued.wait(mutex);
+        if (queue.empty() && dropped == 0)
+            break; /* stopping and nothing left to deliver */
+
+        /*
+         * Collect more alerts for the digest
+         */
+        Timestamp first;
+        while (!stopping && !first.isElapsed(delay * 1000)) {
+            long remaining = delay - (long)(first.elapsed() / 1000);
+            if (remaining > 0)
+                queued.tryWait(mutex, remaining);
+        }
+
+        vector<MailAlert> batch(queue.begin(), queue.end());
+        size_t lost = dropped;
+        queue.clear();
+        dropped = 0;
+
+        ScopedUnlock<Mutex> unlock(mutex);
+        deliver(batch, lost);
+    }
+}
+
+void MailNotifier::deliver(const vector<MailAlert>& batch, size_t lost) {
+    Logger& logger = Logger::root();
+    stringstream body;
+    string subject = mailSubject;
+
+    body << "Hello ClamFS User," << crlf << crlf;
+    if (batch.size() == 1 && lost == 0) {
+        body << "This is an automatic notification about virus found." << crlf << crlf;
+    } else {
+        body << "This is an automatic notification about " << batch.size() + lost
+             << " viruses found." << crlf << crlf;
+        subject += " (" + to_string(batch.size() + lost) + " detections)";
+    }
+
+    for (vector<MailAlert>::const_iterator it = batch.begin(); it != batch.end(); ++it) {
+        body << "Executable name: " << it->callername << crlf;
+        body << "            PID: " << it->pid << crlf << crlf;
+        body << "       Username: " << it->username << crlf;
+        body << "            UID: " << it->uid << crlf << crlf;
+        body << "ClamAV reported malicious file:" << crlf;
+        body << it->scanresult << crlf << crlf;
+    }
+    if (lost)
+        body << lost << " more detections not listed (mail queue was full)." << crlf;
+
+    /*
+     * Try to deliver, wait longer after each failure
+     */
+    long backoff = 1000;
+    int limit = retries;
+    for (int attempt = 0; attempt <= limit; ++attempt) {
+        if (SendMailNotification(mailServer.c_str(), mailRecipient.c_str(),
+                mailSender.c_str(), subject.c_str(), body.str()) == 0)
+            return;
+        if (attempt == limit)
+            break;
+        poco_information_f2(logger, "mail notification failed, retry %d in %ld ms", attempt + 1, backoff);
+        if (stopped.tryWait(backoff)) {
+            stopped.set(); /* keep stop request visible for next batch */
+            limit = attempt + 1; /* one last attempt before exit */
+        }
+        backoff = (backoff * 2 > MAIL_BACKOFF_MAX) ? MAIL_BACKOFF_MAX : backoff * 2;
+    }
+
+    poco_warning_f1(logger, "giving up mail notification about %z detections", batch.size() + lost);
+}
+
 } /* namespace clamfs */
 
 /* EoF */
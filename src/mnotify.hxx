@@ -28,7 +28,16 @@
 #include "config.h"
 
 #include <sstream>
+#include <deque>
+#include <vector>
 #include <Poco/Exception.h>
+#include <Poco/Mutex.h>
+#include <Poco/Condition.h>
+#include <Poco/Event.h>
+#include <Poco/Runnable.h>
+#include <Poco/Thread.h>
+#include <Poco/Timestamp.h>
+#include <Poco/ScopedUnlock.h>
 #include <Poco/Net/MailMessage.h>
 #include <Poco/Net/MailRecipient.h>
 #include <Poco/Net/SMTPClientSession.h>
@@ -56,9 +65,119 @@ using namespace Poco;
 */
 using namespace Poco::Net;
 
+/*!\def MAIL_QUEUE_MAX
+   \brief Maximal number of alerts waiting in mail queue
+
+   Alerts reported while queue is full are dropped (but counted
+   and reported in next digest).
+*/
+#define MAIL_QUEUE_MAX 1024
+
+/*!\def MAIL_BACKOFF_MAX
+   \brief Maximal delay (in ms) between retries of failed mail delivery
+*/
+#define MAIL_BACKOFF_MAX 60000
+
+/*!\struct MailAlert
+   \brief Single virus detection waiting for mail notification
+*/
+struct MailAlert {
+    /*!\brief name of process which accessed infected file */
+    string callername;
+    /*!\brief pid of process which accessed infected file */
+    pid_t pid;
+    /*!\brief name of user who accessed infected file */
+    string username;
+    /*!\brief uid of user who accessed infected file */
+    uid_t uid;
+    /*!\brief message from clamd */
+    string scanresult;
+};
+
+/*!\class MailNotifier
+   \brief Background mail notification queue
+
+   Virus detections are queued by scanning threads and delivered by
+   separate thread, so SMTP session never blocks scanning. Detections
+   reported within digest period are coalesced into single mail.
+   Failed deliveries are retried with exponential backoff.
+*/
+class MailNotifier: public Runnable {
+    public:
+        /*!\brief Constructor for MailNotifier
+           \param mx mail exchanger (server)
+           \param recipient To: address
+           \param sender From: address
+           \param subject Subject: header
+           \param digestDelay time in ms to collect alerts before sending mail
+           \param maxRetries how many times failed delivery is retried
+        */
+        MailNotifier(const char* mx, const char* recipient,
+                     const char* sender, const char* subject,
+                     long digestDelay, int maxRetries);
+        /*!\brief Destructor for MailNotifier */
+        virtual ~MailNotifier();
+
+        /*!\brief Starts delivery thread */
+        void start();
+        /*!\brief Delivers pending alerts and stops delivery thread */
+        void stop();
+
+        /*!\brief Queues alert for delivery (never blocks on SMTP)
+           \param alert detection to report
+        */
+        void enqueue(const MailAlert& alert);
+
+        /*!\brief Delivery thread main loop */
+        virtual void run();
+
+    private:
+        /*!\brief Forbid usage of copy constructor */
+        MailNotifier(const MailNotifier& aMailNotifier);
+        /*!\brief Forbid usage of assignment operator */
+        MailNotifier& operator = (const MailNotifier& aMailNotifier);
+
+        /*!\brief Sends digest of alerts, retrying on failure
+           \param batch alerts to report
+           \param lost number of alerts dropped due to full queue
+        */
+        void deliver(const vector<MailAlert>& batch, size_t lost);
+
+        /*!\brief mail exchanger (server) */
+        string mailServer;
+        /*!\brief To: address */
+        string mailRecipient;
+        /*!\brief From: address */
+        string mailSender;
+        /*!\brief Subject: header */
+        string mailSubject;
+        /*!\brief time in ms to collect alerts before sending mail */
+        long delay;
+        /*!\brief how many times failed delivery is retried */
+        int retries;
+
+        /*!\brief protects queue, dropped and stopping */
+        Mutex mutex;
+        /*!\brief signalled when alert is queued or thread is stopped */
+        Condition queued;
+        /*!\brief set when thread is stopped (interrupts backoff) */
+        Event stopped;
+        /*!\brief alerts waiting for delivery */
+        deque<MailAlert> queue;
+        /*!\brief alerts dropped since last digest */
+        size_t dropped;
+        /*!\brief stop request flag */
+        bool stopping;
+        /*!\brief delivery thread */
+        Thread thread;
+};
+
+/*!\brief extern to access mail notifier pointer from clamfs.cxx */
+extern MailNotifier* notifier;
+
 int SendMailNotification(const char* mx, const char* recipient,
                          const char* sender, const char* subject,
-                         const char* scanresult);
+                         const string& body);
 
 } /* namespace clamfs */
 
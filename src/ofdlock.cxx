@@ -0,0 +1,164 @@
+/*!\file ofdlock.cxx
+
+   \brief POSIX record locks kept as open file description locks
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "ofdlock.hxx"
+
+#ifdef F_OFD_SETLK
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fuse.h>
+
+namespace clamfs {
+
+LockOwners::LockOwners() {
+}
+
+LockOwners::~LockOwners() {
+}
+
+LockOwners::Descriptor::~Descriptor() {
+    close(fd);
+}
+
+bool LockOwners::supported() {
+    struct flock lock;
+
+    FILE* file = tmpfile();
+    if (file == NULL)
+        return false;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_RDLCK;
+    lock.l_whence = SEEK_SET;
+    bool works = (fcntl(fileno(file), F_OFD_GETLK, &lock) == 0);
+    fclose(file);
+    return works;
+}
+
+int LockOwners::descriptor(int fd, uint64_t owner, bool create, SharedPtr<Descriptor>& entry) {
+    struct stat st;
+
+    if (fstat(fd, &st) != 0)
+        return -errno;
+    owner_key_t key = make_pair(make_pair(st.st_dev, st.st_ino), owner);
+
+    FastMutex::ScopedLock lock(mutex);
+    map<owner_key_t, SharedPtr<Descriptor> >::iterator it = owners.find(key);
+    if (it != owners.end()) {
+        entry = it->second;
+        return 0;
+    }
+    if (!create)
+        return 0;
+
+    /*
+     * Lock descriptor has to be open file description of its own (dup
+     * of backing descriptor would share locks with every other owner
+     * using the same handle, e.g. after fork()) and has to take both
+     * read and write locks if file can be opened for both
+     */
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1)
+        return -errno;
+    char procname[64];
+    snprintf(procname, sizeof(procname), "/proc/self/fd/%d", fd);
+    int lockfd = open(procname, O_RDWR | O_CLOEXEC | O_NOCTTY | O_NONBLOCK);
+    if ((lockfd == -1) && ((flags & O_ACCMODE) != O_RDWR))
+        lockfd = open(procname, (flags & O_ACCMODE) | O_CLOEXEC | O_NOCTTY | O_NONBLOCK);
+    if (lockfd == -1)
+        return -errno;
+
+    entry = new Descriptor(lockfd);
+    owners[key] = entry;
+    origins[fd].push_back(key);
+    return 0;
+}
+
+int LockOwners::lock(int fd, uint64_t owner, int cmd, struct flock* lock, fuse_req_t req) {
+    /* test of lock owner has no locks yet needs no lock descriptor */
+    bool unlocking = (cmd != F_GETLK) && (lock->l_type == F_UNLCK);
+    SharedPtr<Descriptor> owned;
+    int err = descriptor(fd, owner, !unlocking && (cmd != F_GETLK), owned);
+    if (err != 0)
+        return err;
+    if (owned.isNull() && unlocking)
+        return 0; /* owner never locked file */
+    /* backing descriptor itself holds no locks, so it sees locks of all owners */
+    int lockfd = owned.isNull() ? fd : owned->fd;
+
+    /* OFD locks have no pid (it has to be zero) */
+    lock->l_pid = 0;
+    if (cmd == F_GETLK)
+        return (fcntl(lockfd, F_OFD_GETLK, lock) == -1) ? -errno : 0;
+    if (cmd == F_SETLK)
+        return (fcntl(lockfd, F_OFD_SETLK, lock) == -1) ? -errno : 0;
+
+    /*
+     * Wait for contended lock (F_SETLKW) checking for interrupt
+     */
+    useconds_t delay = 100;
+    while (fcntl(lockfd, F_OFD_SETLK, lock) == -1) {
+        if ((errno != EAGAIN) && (errno != EACCES))
+            return -errno;
+        if ((req != NULL) ? fuse_req_interrupted(req) : fuse_interrupted())
+            return -EINTR;
+        usleep(delay);
+        if (delay < LOCK_MAX_DELAY)
+            delay *= 2;
+    }
+    return 0;
+}
+
+void LockOwners::unlock(int fd, uint64_t owner) {
+    struct flock lock;
+
+    SharedPtr<Descriptor> owned;
+    if ((descriptor(fd, owner, false, owned) != 0) || owned.isNull())
+        return;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_UNLCK;
+    lock.l_whence = SEEK_SET;
+    fcntl(owned->fd, F_OFD_SETLK, &lock);
+}
+
+void LockOwners::release(int fd) {
+    FastMutex::ScopedLock lock(mutex);
+    map<int, vector<owner_key_t> >::iterator origin = origins.find(fd);
+    if (origin == origins.end())
+        return;
+
+    /* descriptors still used by lock requests are closed by them */
+    for (size_t i = 0; i < origin->second.size(); ++i)
+        owners.erase(origin->second[i]);
+    origins.erase(origin);
+}
+
+} /* namespace clamfs */
+
+#endif /* F_OFD_SETLK */
+
+/* EoF */
@@ -0,0 +1,157 @@
+/*!\file ofdlock.hxx
+
+   \brief POSIX record locks kept as open file description locks (header file)
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef CLAMFS_OFDLOCK_HXX
+#define CLAMFS_OFDLOCK_HXX
+
+#include "config.h"
+
+#include <map>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <fuse_lowlevel.h>
+#include <Poco/Mutex.h>
+#include <Poco/SharedPtr.h>
+
+#ifdef DMALLOC
+   #include <stdlib.h>
+   #ifdef HAVE_MALLOC_H
+      #include <malloc.h>
+   #endif
+   #include <dmalloc.h>
+#endif
+
+/*!\def LOCK_MAX_DELAY
+   \brief Maximal delay between attempts to take contended lock (in us)
+*/
+#define LOCK_MAX_DELAY 10000
+
+namespace clamfs {
+
+using namespace std;
+using namespace Poco;
+
+#ifdef F_OFD_SETLK
+
+/*!\class LockOwners
+   \brief POSIX record locks of FUSE lock owners kept as OFD locks
+
+   POSIX locks belong to process (FUSE lock owner), open file
+   description (OFD) locks to open file. Each lock owner gets one lock
+   descriptor per file: backing descriptor it locked the file with
+   first opened again through /proc/self/fd (read-write if possible,
+   otherwise with access mode of backing descriptor). Owner gets open
+   file description of its own even if it shares handle with another
+   owner (e.g. after fork()), so locks of owners conflict, while its
+   locks taken through different descriptors of the file do not. Lock descriptor is closed when backing descriptor it came
+   from is released, flush of every descriptor has dropped locks of
+   its owner already (like close() does for POSIX locks).
+
+   Waiting for contended lock is done by polling, so interrupted
+   request does not leave FUSE thread blocked (and lock taken later
+   for process which gave up).
+*/
+class LockOwners {
+    public:
+        /*!\brief Constructor for LockOwners */
+        LockOwners();
+        /*!\brief Destructor for LockOwners */
+        ~LockOwners();
+
+        /*!\brief Checks if kernel supports OFD locks
+           \returns true if F_OFD_GETLK works
+        */
+        static bool supported();
+
+        /*!\brief Tests, takes or releases lock
+           \param fd backing file descriptor
+           \param owner FUSE lock owner
+           \param cmd F_GETLK, F_SETLK or F_SETLKW
+           \param lock lock to set (or test, conflicting lock is returned)
+           \param req FUSE request (to check for interrupt) or NULL for
+                      high-level API request
+           \returns 0 on success or -errno
+        */
+        int lock(int fd, uint64_t owner, int cmd, struct flock* lock, fuse_req_t req);
+        /*!\brief Releases all locks of owner on file (flush)
+           \param fd backing file descriptor
+           \param owner FUSE lock owner
+        */
+        void unlock(int fd, uint64_t owner);
+        /*!\brief Forgets lock descriptors taken from backing descriptor
+           \param fd backing file descriptor being closed
+        */
+        void release(int fd);
+
+    private:
+        /*!\brief Forbid usage of copy constructor */
+        LockOwners(const LockOwners& aLockOwners);
+        /*!\brief Forbid usage of assignment operator */
+        LockOwners& operator = (const LockOwners& aLockOwners);
+
+        /*!\brief File (device and inode) and lock owner */
+        typedef pair<pair<dev_t, ino_t>, uint64_t> owner_key_t;
+
+        /*!\brief Lock descriptor of owner (closed when last user drops it) */
+        struct Descriptor {
+            /*!\brief Constructor for Descriptor
+               \param lockfd descriptor locks are set on (owned)
+            */
+            Descriptor(int lockfd): fd(lockfd) {}
+            /*!\brief Destructor for Descriptor (closes descriptor) */
+            ~Descriptor();
+            /*!\brief descriptor locks are set on */
+            int fd;
+        };
+
+        /*!\brief Finds (or creates) lock descriptor of owner
+           \param fd backing file descriptor
+           \param owner FUSE lock owner
+           \param create false to leave entry NULL if owner has no descriptor
+           \param entry lock descriptor (left NULL if not found)
+           \returns 0 on success or -errno
+        */
+        int descriptor(int fd, uint64_t owner, bool create, SharedPtr<Descriptor>& entry);
+
+        /*!\brief protects state below */
+        FastMutex mutex;
+        /*!\brief lock descriptors by file and owner */
+        map<owner_key_t, SharedPtr<Descriptor> > owners;
+        /*!\brief keys of lock descriptors by backing descriptor */
+        map<int, vector<owner_key_t> > origins;
+};
+
+/*!\brief extern to access lock owners pointer (NULL if OFD locks are not used) */
+extern LockOwners* locks;
+
+#endif /* F_OFD_SETLK */
+
+} /* namespace clamfs */
+
+#endif /* CLAMFS_OFDLOCK_HXX */
+
+/* EoF */
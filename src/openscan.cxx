@@ -0,0 +1,407 @@
+/*!\file openscan.cxx
+
+   \brief Access control of opened files
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "openscan.hxx"
+
+#include <errno.h>
+#include <unistd.h>
+#include <boost/shared_array.hpp>
+
+#include "idcache.hxx"
+
+using namespace boost;
+
+namespace clamfs {
+
+extern config_t config;
+extern ScanCache* cache;
+extern ExtensionACL* extensions;
+extern PathPolicy* policy;
+
+/*!\brief Completes open() of allowed file
+   \param fi information about open files
+   \param fd backing file descriptor handed to FUSE
+   \param scanfd read only descriptor used for scan (if other than fd) or -1
+   \returns 0 on success or -errno otherwise
+*/
+static inline int open_allowed(struct fuse_file_info *fi, int fd, int scanfd)
+{
+    if ((scanfd >= 0) && (scanfd != fd))
+        close(scanfd);
+
+    /* truncate only now, file must not be modified before scan */
+    if ((fi->flags & O_TRUNC) && (ftruncate(fd, 0) == -1)) {
+        int err = errno;
+        if (scanner != NULL)
+            scanner->release(fd); /* ticket must not outlive descriptor */
+        close(fd);
+        INC_STAT_COUNTER(openDenied);
+        return -err;
+    }
+
+    INC_STAT_COUNTER(openAllowed);
+    fi->fh = (unsigned long) fd;
+    return 0;
+}
+
+/*!\brief Completes open() of denied file
+   \param fd backing file descriptor
+   \param scanfd read only descriptor used for scan (if other than fd) or -1
+   \returns -EPERM
+*/
+static inline int open_denied(int fd, int scanfd)
+{
+    if ((scanfd >= 0) && (scanfd != fd))
+        close(scanfd);
+    close(fd);
+    INC_STAT_COUNTER(openDenied);
+    return -EPERM;
+}
+
+/*!\brief Scans file (whole or selected ranges) and updates stats
+   \param real_path file path in real filesystem tree
+   \param scanfd readable file descriptor
+   \param size file size
+   \param ranges ranges for partial scan or NULL
+   \param context process which opened file
+   \returns result of ClamavScanFile() call
+*/
+static inline int scan_file(const char *real_path, int scanfd, off_t size, const vector<ScanRange>* ranges,
+                            const struct fuse_context *context)
+{
+    if (ranges != NULL) {
+        INC_STAT_COUNTER(partialScan);
+        for (size_t i = 0; i < ranges->size(); ++i)
+            ADD_STAT_COUNTER(partialScanBytes, (size_t)(*ranges)[i].length);
+    }
+    return ClamavScanFile(real_path, scanfd, size, ranges, context);
+}
+
+int CheckOpenedFile(const char *root, const char *path, struct fuse_file_info *fi,
+                    int fd, int scanfd, const struct fuse_context *context)
+{
+    bool file_is_blacklisted = false;
+    bool verify = false;
+    int scan_result;
+    struct stat file_stat;
+
+    Logger& logger = Logger::root();
+
+    /*
+     * Build file path in real filesystem tree
+     */
+    shared_array<char> real_path(new char[strlen(root)+strlen(path)+1]);
+    strcpy(real_path.get(), root);
+    strcat(real_path.get(), path);
+
+    if (fstat(fd, &file_stat) == -1) {
+        int err = errno;
+        if (scanfd != fd)
+            close(scanfd);
+        close(fd);
+        return -err;
+    }
+
+    /*
+     * Arm scan-ahead of directory file was listed in
+     */
+    bool scanned_ahead = (scanahead != NULL) && scanahead->opened(ScanCacheKey(file_stat));
+
+    /*
+     * Learn order of opens and scan files likely opened next
+     */
+    if (history != NULL) {
+        vector<string> next;
+        history->opened(real_path.get(), context->pid, next);
+        if ((scanahead != NULL) && !next.empty())
+            scanahead->predicted(next, context);
+    }
+
+    /*
+     * Check path policy (first matching rule decides)
+     */
+    long long maximal_size = (config["maximal-size"] != NULL) ? atoll(config["maximal-size"]) : -1;
+    if (policy != NULL) {
+        const PathRule* rule = policy->match(path);
+        if (rule != NULL) {
+            switch (rule->action) {
+                case policy_skip:
+                    {
+                        INC_STAT_COUNTER(policySkipHit);
+                        char username[USERNAME_MAX];
+                        char callername[CALLERNAME_MAX];
+                        userNameCache.lookup(context->uid, username, sizeof(username));
+                        processNameCache.lookup(context->pid, callername, sizeof(callername));
+                        poco_warning_f(logger, "(%s:%d) (%s:%u) %s: excluded from anti-virus scan by path rule '%s'",
+                                string(callername), context->pid, string(username), context->uid, string(path), rule->pattern);
+                        return open_allowed(fi, fd, scanfd);
+                    }
+                case policy_force:
+                    {
+                        INC_STAT_COUNTER(policyForceHit);
+                        file_is_blacklisted = true;
+                        char username[USERNAME_MAX];
+                        char callername[CALLERNAME_MAX];
+                        userNameCache.lookup(context->uid, username, sizeof(username));
+                        processNameCache.lookup(context->pid, callername, sizeof(callername));
+                        poco_warning_f(logger, "(%s:%d) (%s:%u) %s: forced anti-virus scan by path rule '%s'",
+                                string(callername), context->pid, string(username), context->uid, string(path), rule->pattern);
+                        break;
+                    }
+                case policy_verify:
+                    verify = true;
+                    /* fall through */
+                default:
+                    {
+                        if (rule->maximalSize >= 0)
+                            maximal_size = rule->maximalSize;
+                        poco_debug_f1(logger, "path rule '%s' matched", rule->pattern);
+                    }
+            }
+        }
+    }
+
+    /*
+     * Check extension blacklist first, so sniffing cannot skip scan it forces
+     */
+    acl_item extension = none;
+    if ((extensions != NULL) && (file_is_blacklisted == false)) {
+        extension = extensions->match(path);
+        if (extension == blacklisted) {
+            INC_STAT_COUNTER(blacklistHit);
+            file_is_blacklisted = true;
+            char username[USERNAME_MAX];
+            char callername[CALLERNAME_MAX];
+            userNameCache.lookup(context->uid, username, sizeof(username));
+            processNameCache.lookup(context->pid, callername, sizeof(callername));
+            poco_warning_f(logger, "(%s:%d) (%s:%u) %s: forced anti-virus scan because extension blacklisted ",
+                    string(callername), context->pid, string(username), context->uid, string(path));
+        }
+    }
+
+    /*
+     * Sniff file content (unless scan was forced by path policy or extension)
+     */
+    content_class content = content_unknown;
+    if ((config["sniff"] != NULL) &&
+        (strncmp(config["sniff"], "yes", 3) == 0) &&
+        (scanfd >= 0) && ((fi->flags & O_TRUNC) == 0) &&
+        (file_is_blacklisted == false)) {
+        const char* type = NULL;
+        Timestamp sniffStart;
+        content = SniffContent(scanfd, &type);
+        ADD_STAT_COUNTER(sniffTime, (size_t)sniffStart.elapsed());
+        INC_STAT_COUNTER(sniffCalled);
+        switch (content) {
+            case content_inert:
+                {
+                    INC_STAT_COUNTER(sniffInert);
+                    poco_debug_f2(logger, "%s: content sniffed as %s, only head and tail are scanned", string(path), string(type));
+                    break;
+                }
+            case content_dangerous:
+                {
+                    INC_STAT_COUNTER(sniffDangerous);
+                    poco_debug_f2(logger, "%s: content sniffed as %s, extension whitelist ignored", string(path), string(type));
+                    break;
+                }
+            default:
+                {
+                    poco_debug_f1(logger, "%s: content type not recognised", string(path));
+                }
+        }
+    }
+
+    /*
+     * Check extension whitelist (unless scan was forced)
+     */
+    if ((extensions != NULL) && (file_is_blacklisted == false)) {
+        switch (extension) {
+            case whitelisted:
+                {
+                    if (content == content_dangerous) /* whitelisted extension does not match content */
+                        break;
+                    INC_STAT_COUNTER(whitelistHit);
+                    char username[USERNAME_MAX];
+                    char callername[CALLERNAME_MAX];
+                    userNameCache.lookup(context->uid, username, sizeof(username));
+                    processNameCache.lookup(context->pid, callername, sizeof(callername));
+                    poco_warning_f(logger, "(%s:%d) (%s:%u) %s: excluded from anti-virus scan because extension whitelisted ",
+                            string(callername), context->pid, string(username), context->uid, string(path));
+                    return open_allowed(fi, fd, scanfd);
+                }
+            default:
+                {
+                    poco_debug(logger, "Extension not found in ACL");
+                }
+        }
+    }
+
+    /*
+     * Check file size (if option defined)
+     */
+    vector<ScanRange> partial_ranges;
+    vector<ScanRange>* ranges = NULL;
+    if ((maximal_size >= 0) && (file_is_blacklisted == false)) {
+        if (file_stat.st_size > maximal_size) { /* file too big */
+            INC_STAT_COUNTER(tooBigFile);
+            char username[USERNAME_MAX];
+            char callername[CALLERNAME_MAX];
+            userNameCache.lookup(context->uid, username, sizeof(username));
+            processNameCache.lookup(context->pid, callername, sizeof(callername));
+
+            /*
+             * Scan only head, tail and samples of file (if option defined)
+             */
+            long long head = (config["partial-head"] != NULL) ? atoll(config["partial-head"]) : 0;
+            long long tail = (config["partial-tail"] != NULL) ? atoll(config["partial-tail"]) : 0;
+            if ((head > 0) || (tail > 0)) {
+                unsigned int samples = (config["partial-samples"] != NULL) ? atoi(config["partial-samples"]) : 0;
+                long long sample_size = (config["partial-sample-size"] != NULL) ? atoll(config["partial-sample-size"]) : 65536;
+                PartialScanRanges(file_stat.st_size, head, tail, samples, sample_size, partial_ranges);
+                ranges = &partial_ranges;
+
+                off_t bytes = 0;
+                for (size_t i = 0; i < partial_ranges.size(); ++i)
+                    bytes += partial_ranges[i].length;
+                poco_warning_f(logger, "(%s:%d) (%s:%u) %s: scanned partially because file is too big (file size: %ld bytes, scanned: %ld bytes)",
+                        string(callername), context->pid, string(username), context->uid, string(path),
+                        (long int)file_stat.st_size, (long int)bytes);
+            } else {
+                poco_warning_f(logger, "(%s:%d) (%s:%u) %s: excluded from anti-virus scan because file is too big (file size: %ld bytes)",
+                        string(callername), context->pid, string(username), context->uid, path, (long int)file_stat.st_size);
+                return open_allowed(fi, fd, scanfd);
+            }
+        }
+    }
+
+    /*
+     * Scan only head and tail of media container (appended payload is
+     * still found in tail, decoder exploits in the middle are not)
+     */
+    if ((content == content_inert) && (ranges == NULL)) {
+        long long head = (config["sniff-head"] != NULL) ? atoll(config["sniff-head"]) : SNIFF_DEFAULT_HEAD;
+        long long tail = (config["sniff-tail"] != NULL) ? atoll(config["sniff-tail"]) : SNIFF_DEFAULT_TAIL;
+        if (file_stat.st_size > head + tail) {
+            PartialScanRanges(file_stat.st_size, head, tail, 0, 0, partial_ranges);
+            ranges = &partial_ranges;
+        }
+    }
+
+    /*
+     * Check if file is in cache
+     */
+    if (cache != NULL) { /* only if cache initalized */
+        SharedPtr<CachedResult> ptr_val;
+
+        if ((ptr_val = cache->get(ScanCacheKey(file_stat)))) {
+            INC_STAT_COUNTER(earlyCacheHit);
+            poco_debug_f1(logger, "early cache hit for inode %lu", (unsigned long)file_stat.st_ino);
+
+            /* partial verdict is not enough when whole file has to be scanned */
+            if ((ptr_val->scanTimestamp == file_stat.st_mtime) &&
+                (ptr_val->fileSize < 0 || ptr_val->fileSize == file_stat.st_size) &&
+                (ptr_val->isPartial == false || ranges != NULL)) {
+                INC_STAT_COUNTER(lateCacheHit);
+                poco_debug_f1(logger, "late cache hit for inode %lu", (unsigned long)file_stat.st_ino);
+                if (ptr_val->isPartial)
+                    INC_STAT_COUNTER(partialCacheHit);
+                if (scanned_ahead)
+                    INC_STAT_COUNTER(aheadHit);
+
+                /* file scanned and not changed, was it clean? */
+                if (ptr_val->isClean) {
+                    return open_allowed(fi, fd, scanfd); /* Yes, it was */
+                } else {
+                    return open_denied(fd, scanfd); /* No, that file was infected */
+                }
+            } else {
+                INC_STAT_COUNTER(lateCacheMiss);
+                poco_debug_f1(logger, "late cache miss for inode %lu", (unsigned long)file_stat.st_ino);
+            }
+        } else {
+            INC_STAT_COUNTER(earlyCacheMiss);
+            poco_debug_f1(logger, "early cache miss for inode %lu", (unsigned long)file_stat.st_ino);
+        }
+    }
+
+    /*
+     * Open file at once and scan it in background (allow-then-verify),
+     * unless it is truncated (that must not happen under running scan)
+     */
+    if (verify && (scanner != NULL) && (scanfd >= 0) && !(fi->flags & O_TRUNC)) {
+        int ticketfd = dup(scanfd); /* owned by ticket */
+        if (ticketfd >= 0) {
+            SharedPtr<ScanTicket> ticket(new ScanTicket(real_path.get(), ticketfd,
+                file_stat, ranges, context));
+            if (scanner->submit(fd, ticket)) {
+                INC_STAT_COUNTER(asyncScan);
+                poco_debug_f1(logger, "%s: opened before scan, verifying in background", string(path));
+                /* bypass page cache, so no read (or mmap) is served after access is revoked */
+                fi->direct_io = 1;
+                fi->keep_cache = 0;
+                return open_allowed(fi, fd, scanfd);
+            }
+            poco_debug(logger, "background scan queue is full, scanning at once");
+        }
+    }
+
+    /*
+     * Scan file
+     */
+    scan_result = scan_file(real_path.get(), scanfd, file_stat.st_size, ranges, context);
+
+    /*
+     * Check for scan results and update cache
+     */
+    if (scan_result == 1) { /* return -EPERM error if virus was found */
+        if (cache != NULL) {
+            CachedResult result(false, file_stat.st_mtime, ranges != NULL);
+            cache->add(ScanCacheKey(file_stat), result);
+        }
+        return open_denied(fd, scanfd);
+    } else if (scan_result == 2) { /* not scanned, allowed by policy (never cached) */
+        return open_allowed(fi, fd, scanfd);
+    } else if(scan_result != 0) {
+        INC_STAT_COUNTER(scanFailed);
+        if (cache != NULL)
+            cache->remove(ScanCacheKey(file_stat));
+        return open_denied(fd, scanfd);
+    }
+
+    if (cache != NULL) {
+        CachedResult result(true, file_stat.st_mtime, ranges != NULL);
+        cache->add(ScanCacheKey(file_stat), result);
+    }
+
+    /*
+     * If no virus detected continue as usual
+     */
+    return open_allowed(fi, fd, scanfd);
+}
+
+
+} /* namespace clamfs */
+
+/* EoF */
@@ -0,0 +1,80 @@
+/*!\file openscan.hxx
+
+   \brief Access control of opened files (header file)
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef CLAMFS_OPENSCAN_HXX
+#define CLAMFS_OPENSCAN_HXX
+
+#include "config.h"
+
+#include <fuse.h>
+#include <Poco/Timestamp.h>
+
+#ifdef DMALLOC
+   #include <stdlib.h>
+   #ifdef HAVE_MALLOC_H
+      #include <malloc.h>
+   #endif
+   #include <dmalloc.h>
+#endif
+
+#include "logger.hxx"
+#include "config.hxx"
+#include "clamav.hxx"
+#include "scancache.hxx"
+#include "stats.hxx"
+#include "sniff.hxx"
+#include "asyncscan.hxx"
+#include "scanahead.hxx"
+#include "history.hxx"
+
+namespace clamfs {
+
+using namespace std;
+using namespace Poco;
+
+/*!\brief Decides if opened file can be accessed, scans it if needed
+   \param root root directory of mount file was opened on (path is
+               relative to it)
+   \param path file path (relative to mount point, starting with "/")
+   \param fi information about open files (fh is set if access is allowed)
+   \param fd backing file descriptor opened without O_TRUNC
+   \param scanfd read only descriptor for scan (fd, other descriptor or -1)
+   \param context process which opened file
+   \returns 0 if file is allowed, -errno on error or -EPERM if virus is detected
+
+   Path policy, extension blacklist, content sniffing, extension
+   whitelist, size limit, scan cache and clamd are consulted in that
+   order. Both descriptors are closed if access is denied, scanfd is
+   closed also if it differs from fd.
+   Shared by high-level and low-level FUSE backends, so it never calls
+   fuse_get_context().
+*/
+int CheckOpenedFile(const char *root, const char *path, struct fuse_file_info *fi,
+                    int fd, int scanfd, const struct fuse_context *context);
+
+} /* namespace clamfs */
+
+#endif /* CLAMFS_OPENSCAN_HXX */
+
+/* EoF */
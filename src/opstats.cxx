@@ -0,0 +1,110 @@
+/*!\file opstats.cxx
+
+   \brief Per FUSE operation statistics
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "opstats.hxx"
+
+#include "stats.hxx"
+
+namespace clamfs {
+
+/*!\brief Names of operations (in fuse_operation order) */
+static const char* const operationNames[] = {
+    "lookup", "forget", "getattr", "setattr", "chmod", "chown", "truncate",
+    "utimens", "access", "readlink", "mknod", "mkdir", "symlink", "unlink",
+    "rmdir", "rename", "link", "opendir", "readdir", "readdirplus",
+    "releasedir", "fsyncdir", "create", "open", "read", "read_buf", "write",
+    "write_buf", "statfs", "flush", "release", "fsync", "fallocate",
+    "setxattr", "getxattr", "listxattr", "removexattr", "lock", "getlk",
+    "setlk", "flock", "copy_file_range", "lseek"
+};
+
+static_assert(sizeof(operationNames) / sizeof(operationNames[0]) == op_count,
+              "operationNames does not match fuse_operation");
+
+thread_local OperationScope* OperationScope::current = NULL;
+
+const char* operationName(fuse_operation operation) {
+    return operationNames[operation];
+}
+
+OperationScope::OperationScope(fuse_operation op):
+    operation(op), error(0), bytes(0) {
+    if (stats == NULL)
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    current = this;
+}
+
+OperationScope::~OperationScope() {
+    if (stats == NULL)
+        return;
+    current = NULL;
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    size_t elapsed = (size_t)((end.tv_sec - start.tv_sec) * 1000000 +
+                              (end.tv_nsec - start.tv_nsec) / 1000);
+
+    /* bucket is number of significant bits of latency */
+    size_t bucket = 0;
+    while ((bucket < OPERATION_LATENCY_BUCKETS - 1) && (elapsed >> bucket))
+        ++bucket;
+
+    operation_stats& counters = stats->operations[operation];
+    ++counters.calls;
+    counters.time += elapsed;
+    if (elapsed > counters.longest)
+        counters.longest = elapsed;
+    ++counters.latency[bucket];
+    counters.bytes += bytes;
+    if (error != 0) {
+        ++counters.errors;
+        ++counters.errnos[(error < OPERATION_ERRNOS) ? error : 0];
+    }
+}
+
+void OperationScope::result(long ret) {
+    if (ret < 0) {
+        error = (int)-ret;
+        return;
+    }
+    /* read_buf moves data after return, it is counted by callback */
+    if ((operation == op_read) || (operation == op_write) ||
+        (operation == op_write_buf) || (operation == op_copy_file_range))
+        bytes += (size_t)ret;
+}
+
+void OperationScope::failed(int err) {
+    if (current != NULL)
+        current->error = err;
+}
+
+void OperationScope::moved(size_t count) {
+    if (current != NULL)
+        current->bytes += count;
+}
+
+} /* namespace clamfs */
+
+/* EoF */
@@ -0,0 +1,222 @@
+/*!\file opstats.hxx
+
+   \brief Per FUSE operation statistics (header file)
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef CLAMFS_OPSTATS_HXX
+#define CLAMFS_OPSTATS_HXX
+
+#include "config.h"
+
+#include <stddef.h>
+#include <time.h>
+
+#ifdef DMALLOC
+   #include <stdlib.h>
+   #ifdef HAVE_MALLOC_H
+      #include <malloc.h>
+   #endif
+   #include <dmalloc.h>
+#endif
+
+/*!\def OPERATION_LATENCY_BUCKETS
+   \brief Number of latency histogram buckets (bucket i counts calls
+          shorter than 2^i us, the last one all longer calls)
+*/
+#define OPERATION_LATENCY_BUCKETS 24
+
+/*!\def OPERATION_ERRNOS
+   \brief Errors are counted separately for errno values below this
+          (others are counted together in errno 0 slot)
+*/
+#define OPERATION_ERRNOS 134
+
+namespace clamfs {
+
+/*!\enum fuse_operation
+   \brief FUSE callbacks (of both high-level and low-level API)
+*/
+enum fuse_operation {
+    op_lookup = 0,       /*!< lookup() (low-level API) */
+    op_forget,           /*!< forget() and forget_multi() (low-level API) */
+    op_getattr,          /*!< getattr() */
+    op_setattr,          /*!< setattr() (low-level API) */
+    op_chmod,            /*!< chmod() (high-level API) */
+    op_chown,            /*!< chown() (high-level API) */
+    op_truncate,         /*!< truncate() (high-level API) */
+    op_utimens,          /*!< utimens() (high-level API) */
+    op_access,           /*!< access() */
+    op_readlink,         /*!< readlink() */
+    op_mknod,            /*!< mknod() */
+    op_mkdir,            /*!< mkdir() */
+    op_symlink,          /*!< symlink() */
+    op_unlink,           /*!< unlink() */
+    op_rmdir,            /*!< rmdir() */
+    op_rename,           /*!< rename() */
+    op_link,             /*!< link() */
+    op_opendir,          /*!< opendir() */
+    op_readdir,          /*!< readdir() */
+    op_readdirplus,      /*!< readdirplus() (low-level API) */
+    op_releasedir,       /*!< releasedir() */
+    op_fsyncdir,         /*!< fsyncdir() (low-level API) */
+    op_create,           /*!< create() */
+    op_open,             /*!< open() */
+    op_read,             /*!< read() */
+    op_read_buf,         /*!< read_buf() (high-level API) */
+    op_write,            /*!< write() (high-level API) */
+    op_write_buf,        /*!< write_buf() */
+    op_statfs,           /*!< statfs() */
+    op_flush,            /*!< flush() */
+    op_release,          /*!< release() */
+    op_fsync,            /*!< fsync() */
+    op_fallocate,        /*!< fallocate() */
+    op_setxattr,         /*!< setxattr() */
+    op_getxattr,         /*!< getxattr() */
+    op_listxattr,        /*!< listxattr() */
+    op_removexattr,      /*!< removexattr() */
+    op_lock,             /*!< lock() (high-level API) */
+    op_getlk,            /*!< getlk() (low-level API) */
+    op_setlk,            /*!< setlk() (low-level API) */
+    op_flock,            /*!< flock() */
+    op_copy_file_range,  /*!< copy_file_range() */
+    op_lseek,            /*!< lseek() */
+    op_count             /*!< number of operations (not an operation) */
+};
+
+/*!\struct operation_stats
+   \brief Counters of one FUSE operation
+*/
+struct operation_stats {
+    /*!\brief calls counter */
+    size_t calls;
+    /*!\brief failed calls counter */
+    size_t errors;
+    /*!\brief bytes read or written */
+    size_t bytes;
+    /*!\brief total time spent in callback (in microseconds) */
+    size_t time;
+    /*!\brief longest call (in microseconds) */
+    size_t longest;
+    /*!\brief calls by latency (log2 of microseconds) */
+    size_t latency[OPERATION_LATENCY_BUCKETS];
+    /*!\brief failed calls by errno */
+    size_t errnos[OPERATION_ERRNOS];
+};
+
+/*!\brief Returns name of FUSE operation
+   \param operation operation
+   \returns operation name (callback name without prefix)
+*/
+const char* operationName(fuse_operation operation);
+
+/*!\class OperationScope
+   \brief Times single FUSE callback and counts its result
+
+   Scope lives on stack of FUSE thread for the whole callback. Low-level
+   API callbacks report errors and bytes moved with their replies, so
+   failed() and moved() account them to scope of calling thread.
+   Counters are updated without locking, like other counters of Stats.
+*/
+class OperationScope {
+    public:
+        /*!\brief Constructor for OperationScope (starts timer)
+           \param op operation being called
+        */
+        OperationScope(fuse_operation op);
+        /*!\brief Destructor for OperationScope (counts call) */
+        ~OperationScope();
+
+        /*!\brief Counts result of high-level API callback
+           \param ret value returned by callback (-errno on error, number
+                      of bytes for read and write operations)
+        */
+        void result(long ret);
+
+        /*!\brief Counts error of operation called by this thread
+           \param err errno value
+        */
+        static void failed(int err);
+        /*!\brief Counts bytes moved by operation called by this thread
+           \param count number of bytes read or written
+        */
+        static void moved(size_t count);
+
+    private:
+        /*!\brief Forbid usage of copy constructor */
+        OperationScope(const OperationScope& aOperationScope);
+        /*!\brief Forbid usage of assignment operator */
+        OperationScope& operator = (const OperationScope& aOperationScope);
+
+        /*!\brief operation being called */
+        fuse_operation operation;
+        /*!\brief time callback was entered */
+        struct timespec start;
+        /*!\brief errno of failed call (0 on success) */
+        int error;
+        /*!\brief bytes moved by call */
+        size_t bytes;
+
+        /*!\brief scope of callback running in this thread (NULL if none) */
+        static thread_local OperationScope* current;
+};
+
+/*!\struct Instrumented
+   \brief Wrapper counting calls of FUSE callback (see INSTRUMENT)
+*/
+template <fuse_operation op, typename F, F function>
+struct Instrumented;
+
+/*!\brief Wrapper of high-level API callback (result is returned) */
+template <fuse_operation op, typename R, typename... A, R (*function)(A...)>
+struct Instrumented<op, R (*)(A...), function> {
+    /*!\brief Calls callback in operation scope */
+    static R call(A... args) {
+        OperationScope scope(op);
+        R ret = function(args...);
+        scope.result((long)ret);
+        return ret;
+    }
+};
+
+/*!\brief Wrapper of low-level API callback (result is replied) */
+template <fuse_operation op, typename... A, void (*function)(A...)>
+struct Instrumented<op, void (*)(A...), function> {
+    /*!\brief Calls callback in operation scope */
+    static void call(A... args) {
+        OperationScope scope(op);
+        function(args...);
+    }
+};
+
+/*!\def INSTRUMENT
+   \brief Wraps FUSE callback to count its calls, errors, bytes and latency
+   \param op operation name (without op_ prefix)
+   \param function callback to wrap
+*/
+#define INSTRUMENT(op, function) \
+    (&Instrumented<op_##op, decltype(&function), &function>::call)
+
+} /* namespace clamfs */
+
+#endif /* CLAMFS_OPSTATS_HXX */
+
+/* EoF */
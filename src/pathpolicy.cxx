@@ -0,0 +1,293 @@
+/*!\file pathpolicy.cxx
+
+   \brief Path based scan policy routines
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "pathpolicy.hxx"
+
+#include <cstring>
+#include <map>
+#include <deque>
+#include <algorithm>
+
+namespace clamfs {
+
+/*!\enum nfa_match
+   \brief Kinds of NFA edges
+*/
+enum nfa_match { match_byte, match_noslash, match_any };
+
+/*!\struct NfaEdge
+   \brief Edge of non-deterministic automaton built from rules
+*/
+struct NfaEdge {
+    nfa_match kind;
+    unsigned char byte;
+    unsigned int target;
+};
+
+/*!\struct NfaNode
+   \brief Node of non-deterministic automaton built from rules
+*/
+struct NfaNode {
+    NfaNode(): acceptRule(-1) { }
+    vector<NfaEdge> edges;
+    vector<unsigned int> epsilon;
+    int acceptRule;
+};
+
+/*!\class NfaBuilder
+   \brief Thompson-like construction of NFA from prefixes and globs
+*/
+class NfaBuilder {
+    public:
+        NfaBuilder() { nodes.push_back(NfaNode()); /* global start */ }
+
+        unsigned int node() {
+            nodes.push_back(NfaNode());
+            return (unsigned int)nodes.size() - 1;
+        }
+
+        void edge(unsigned int from, nfa_match kind, unsigned char byte, unsigned int to) {
+            NfaEdge e;
+            e.kind = kind;
+            e.byte = byte;
+            e.target = to;
+            nodes[from].edges.push_back(e);
+        }
+
+        unsigned int literal(unsigned int from, unsigned char byte) {
+            unsigned int to = node();
+            edge(from, match_byte, byte, to);
+            return to;
+        }
+
+        void addRule(const PathRule& rule, int index) {
+            unsigned int cur = node();
+            nodes[0].epsilon.push_back(cur);
+
+            const string& p = rule.pattern;
+            if (!rule.glob) {
+                for (size_t i = 0; i < p.size(); ++i)
+                    cur = literal(cur, (unsigned char)p[i]);
+                edge(cur, match_any, 0, cur); /* anything may follow prefix */
+                nodes[cur].acceptRule = index;
+                return;
+            }
+
+            size_t i = 0;
+            if (p.find('/') == string::npos) {
+                cur = anyDirectories(cur); /* match base name anywhere */
+            }
+            while (i < p.size()) {
+                if (p.compare(i, 3, "**/") == 0) {
+                    cur = anyDirectories(cur);
+                    i += 3;
+                } else if (p.compare(i, 2, "**") == 0) {
+                    edge(cur, match_any, 0, cur);
+                    i += 2;
+                } else if (p[i] == '*') {
+                    unsigned int loop = node();
+                    nodes[cur].epsilon.push_back(loop);
+                    edge(loop, match_noslash, 0, loop);
+                    cur = loop;
+                    i += 1;
+                } else if (p[i] == '?') {
+                    unsigned int to = node();
+                    edge(cur, match_noslash, 0, to);
+                    cur = to;
+                    i += 1;
+                } else if (p[i] == '\\' && i + 1 < p.size()) {
+                    cur = literal(cur, (unsigned char)p[i + 1]);
+                    i += 2;
+                } else {
+                    cur = literal(cur, (unsigned char)p[i]);
+                    i += 1;
+                }
+            }
+            nodes[cur].acceptRule = index;
+        }
+
+        /* "**" followed by "/": zero or more whole directories */
+        unsigned int anyDirectories(unsigned int from) {
+            unsigned int loop = node();
+            unsigned int to = node();
+            nodes[from].epsilon.push_back(loop);
+            nodes[from].epsilon.push_back(to);
+            edge(loop, match_any, 0, loop);
+            edge(loop, match_byte, '/', to);
+            return to;
+        }
+
+        void closure(vector<unsigned int>& set) const {
+            vector<unsigned int> stack(set);
+            while (!stack.empty()) {
+                unsigned int n = stack.back();
+                stack.pop_back();
+                for (size_t e = 0; e < nodes[n].epsilon.size(); ++e) {
+                    unsigned int t = nodes[n].epsilon[e];
+                    if (find(set.begin(), set.end(), t) == set.end()) {
+                        set.push_back(t);
+                        stack.push_back(t);
+                    }
+                }
+            }
+            sort(set.begin(), set.end());
+        }
+
+        vector<NfaNode> nodes;
+};
+
+PathPolicy::PathPolicy() {
+    compile();
+}
+
+PathPolicy::~PathPolicy() {
+}
+
+void PathPolicy::addPrefix(const string& prefix, policy_action action, long long maximalSize) {
+    PathRule rule;
+    rule.pattern = prefix;
+    rule.glob = false;
+    rule.action = action;
+    rule.maximalSize = maximalSize;
+    rules.push_back(rule);
+}
+
+void PathPolicy::addGlob(const string& glob, policy_action action, long long maximalSize) {
+    PathRule rule;
+    rule.pattern = glob;
+    rule.glob = true;
+    rule.action = action;
+    rule.maximalSize = maximalSize;
+    rules.push_back(rule);
+}
+
+bool PathPolicy::compile() {
+    NfaBuilder nfa;
+    for (size_t r = 0; r < rules.size(); ++r)
+        nfa.addRule(rules[r], (int)r);
+
+    /*
+     * Character classes: each byte used literally by any rule gets its
+     * own class, "/" too (as wildcards treat it specially), all other
+     * bytes share class 0
+     */
+    memset(classOf, 0, sizeof(classOf));
+    classes = 1;
+    classOf[(unsigned char)'/'] = (unsigned char)classes++;
+    for (size_t n = 0; n < nfa.nodes.size(); ++n) {
+        for (size_t e = 0; e < nfa.nodes[n].edges.size(); ++e) {
+            const NfaEdge& edge = nfa.nodes[n].edges[e];
+            if (edge.kind == match_byte && classOf[edge.byte] == 0 && edge.byte != 0)
+                classOf[edge.byte] = (unsigned char)classes++;
+        }
+    }
+    /* representative byte for each class */
+    vector<unsigned char> sample(classes, 0);
+    for (unsigned int b = 255; b > 0; --b)
+        sample[classOf[b]] = (unsigned char)b;
+
+    /*
+     * Subset construction, state 0 is dead state (empty set)
+     */
+    map<vector<unsigned int>, unsigned int> ids;
+    deque< vector<unsigned int> > pending;
+    transitions.assign(classes, 0);
+    accept.assign(1, -1);
+
+    vector<unsigned int> start(1, 0);
+    nfa.closure(start);
+    ids[vector<unsigned int>()] = 0;
+    ids[start] = 1;
+    pending.push_back(start);
+    transitions.resize(2 * classes, 0);
+    accept.push_back(-1);
+
+    while (!pending.empty()) {
+        vector<unsigned int> set = pending.front();
+        pending.pop_front();
+        unsigned int state = ids[set];
+
+        int rule = -1;
+        for (size_t i = 0; i < set.size(); ++i) {
+            int a = nfa.nodes[set[i]].acceptRule;
+            if (a >= 0 && (rule < 0 || a < rule))
+                rule = a;
+        }
+        accept[state] = rule;
+
+        for (unsigned int c = 0; c < classes; ++c) {
+            unsigned char byte = sample[c];
+            vector<unsigned int> next;
+            for (size_t i = 0; i < set.size(); ++i) {
+                const vector<NfaEdge>& edges = nfa.nodes[set[i]].edges;
+                for (size_t e = 0; e < edges.size(); ++e) {
+                    bool hit = (edges[e].kind == match_any) ||
+                               (edges[e].kind == match_noslash && byte != '/') ||
+                               (edges[e].kind == match_byte && edges[e].byte == byte);
+                    if (hit && find(next.begin(), next.end(), edges[e].target) == next.end())
+                        next.push_back(edges[e].target);
+                }
+            }
+            nfa.closure(next);
+
+            map<vector<unsigned int>, unsigned int>::iterator it = ids.find(next);
+            unsigned int target;
+            if (it == ids.end()) {
+                if (accept.size() >= PATHPOLICY_MAX_STATES)
+                    return false;
+                target = (unsigned int)accept.size();
+                ids[next] = target;
+                accept.push_back(-1);
+                transitions.resize(accept.size() * classes, 0);
+                pending.push_back(next);
+            } else {
+                target = it->second;
+            }
+            transitions[state * classes + c] = target;
+        }
+    }
+
+    return true;
+}
+
+bool PathPolicy::uses(policy_action action) const {
+    for (size_t r = 0; r < rules.size(); ++r)
+        if (rules[r].action == action)
+            return true;
+    return false;
+}
+
+const PathRule* PathPolicy::match(const char* path) const {
+    unsigned int state = 1;
+    for (const unsigned char* p = (const unsigned char*)path; *p != '\0'; ++p) {
+        state = transitions[state * classes + classOf[*p]];
+        if (state == 0)
+            return NULL; /* dead state, nothing can match any more */
+    }
+    return (accept[state] >= 0) ? &rules[accept[state]] : NULL;
+}
+
+} /* namespace clamfs */
+
+/* EoF */
@@ -0,0 +1,153 @@
+/*!\file pathpolicy.hxx
+
+   \brief Path based scan policy routines (header file)
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef CLAMFS_PATHPOLICY_HXX
+#define CLAMFS_PATHPOLICY_HXX
+
+#include "config.h"
+
+#include <string>
+#include <vector>
+
+#ifdef DMALLOC
+   #include <stdlib.h>
+   #ifdef HAVE_MALLOC_H
+      #include <malloc.h>
+   #endif
+   #include <dmalloc.h>
+#endif
+
+/*!\def PATHPOLICY_MAX_STATES
+   \brief Maximal number of states of compiled path policy automaton
+*/
+#define PATHPOLICY_MAX_STATES 16384
+
+namespace clamfs {
+
+using namespace std;
+
+/*!\enum policy_action
+   \brief Enumeration of path policy rule actions
+*/
+enum policy_action {
+    policy_scan = 0, /*!< scan as usual (possibly with own maximal-size) */
+    policy_skip,     /*!< never scan */
+    policy_force,    /*!< always scan, regardless of size and extension */
+    policy_verify    /*!< open at once and scan in background */
+};
+
+/*!\struct PathRule
+   \brief Single path policy rule
+*/
+struct PathRule {
+    /*!\brief pattern as given in configuration */
+    string pattern;
+    /*!\brief true for glob, false for prefix rule */
+    bool glob;
+    /*!\brief action to take for matching path */
+    policy_action action;
+    /*!\brief maximal-size override for policy_scan (-1 if not set) */
+    long long maximalSize;
+};
+
+/*!\class PathPolicy
+   \brief Ordered path rules (prefixes and globs) deciding how to scan files
+
+   Rules are evaluated in order of definition, first matching rule wins.
+   All rules are compiled into single deterministic automaton at config
+   load, so matching takes one table lookup per character of path
+   regardless of number of rules.
+
+   Glob syntax: "*" matches any characters except "/", "?" matches one
+   character except "/" and "**" matches anything (including "/").
+   Glob without "/" matches base name in any directory (e.g. "*.o").
+   Prefix rule matches every path starting with given string.
+*/
+class PathPolicy {
+    public:
+        /*!\brief Constructor for PathPolicy */
+        PathPolicy();
+        /*!\brief Destructor for PathPolicy */
+        ~PathPolicy();
+
+        /*!\brief Appends prefix rule
+           \param prefix path prefix (e.g. "/build/cache/")
+           \param action action for matching paths
+           \param maximalSize maximal-size override or -1
+        */
+        void addPrefix(const string& prefix, policy_action action, long long maximalSize);
+
+        /*!\brief Appends glob rule
+           \param glob glob pattern (e.g. "*.o")
+           \param action action for matching paths
+           \param maximalSize maximal-size override or -1
+        */
+        void addGlob(const string& glob, policy_action action, long long maximalSize);
+
+        /*!\brief Compiles rules into automaton (call once after adding rules)
+           \returns false if automaton would exceed PATHPOLICY_MAX_STATES
+        */
+        bool compile();
+
+        /*!\brief Finds first rule matching path
+           \param path file path (relative to file system root)
+           \returns matching rule or NULL
+        */
+        const PathRule* match(const char* path) const;
+
+        /*!\brief Checks if any rule uses given action
+           \param action action to look for
+           \returns true if at least one rule uses action
+        */
+        bool uses(policy_action action) const;
+
+        /*!\brief Returns number of rules */
+        size_t size() const { return rules.size(); }
+
+        /*!\brief Returns number of automaton states */
+        size_t states() const { return accept.size(); }
+
+    private:
+        /*!\brief Forbid usage of copy constructor */
+        PathPolicy(const PathPolicy& aPathPolicy);
+        /*!\brief Forbid usage of assignment operator */
+        PathPolicy& operator = (const PathPolicy& aPathPolicy);
+
+        /*!\brief rules in order of definition */
+        vector<PathRule> rules;
+        /*!\brief maps input byte to character class */
+        unsigned char classOf[256];
+        /*!\brief number of character classes */
+        unsigned int classes;
+        /*!\brief transition table, state * classes + class */
+        vector<unsigned int> transitions;
+        /*!\brief first accepted rule index for each state (-1 if none) */
+        vector<int> accept;
+};
+
+} /* namespace clamfs */
+
+#endif /* CLAMFS_PATHPOLICY_HXX */
+
+/* EoF */
@@ -0,0 +1,402 @@
+/*!\file prescan.cxx
+
+   \brief Offline pre-scan of directory trees (clamfs-prescan)
+
+   Scans directory trees with clamd, many files at once, and writes
+   verdict database ClamFS imports into its ScanCache at mount time
+   (see import attribute of cache element).
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <Poco/Condition.h>
+#include <Poco/Net/SocketAddress.h>
+#include <Poco/Net/StreamSocket.h>
+#include <Poco/Net/SocketStream.h>
+
+#ifdef DMALLOC
+   #include <stdlib.h>
+   #ifdef HAVE_MALLOC_H
+      #include <malloc.h>
+   #endif
+   #include <dmalloc.h>
+#endif
+
+#include "logger.hxx"
+#include "clamav.hxx"
+#include "clamdclient.hxx"
+#include "verdictdb.hxx"
+
+/*!\def PRESCAN_DEFAULT_SOCKET
+   \brief Default clamd socket
+*/
+#define PRESCAN_DEFAULT_SOCKET "/var/run/clamav/clamd.ctl"
+
+/*!\def PRESCAN_OPEN_DIRS
+   \brief Maximal number of directories kept open by tree walk
+*/
+#define PRESCAN_OPEN_DIRS 64
+
+using namespace std;
+using namespace clamfs;
+
+namespace clamfs {
+
+/*!\brief Client sending files to clamd */
+ClamdClient* client = NULL;
+
+/*!\brief protects state below (shared by tree walk and I/O thread) */
+static FastMutex prescanMutex;
+/*!\brief signalled when scan completes */
+static Condition prescanDone;
+/*!\brief number of scans submitted and not completed */
+static unsigned int inFlight = 0;
+/*!\brief maximal number of scans submitted at once (bounds open files) */
+static unsigned int maxInFlight = 1;
+/*!\brief verdict database being written */
+static VerdictWriter writer;
+/*!\brief true if verdict could not be written */
+static bool writeFailed = false;
+/*!\brief number of clean files */
+static unsigned long cleanFiles = 0;
+/*!\brief number of infected files */
+static unsigned long infectedFiles = 0;
+/*!\brief number of files which could not be scanned */
+static unsigned long failedFiles = 0;
+/*!\brief number of files changed while being scanned */
+static unsigned long changedFiles = 0;
+/*!\brief command used to pass files to clamd */
+static clamd_command prescanCommand = command_instream;
+
+/*!\class PrescanRequest
+   \brief Scan of single file, records its verdict on completion
+*/
+class PrescanRequest: public ClamdRequest {
+    public:
+        /*!\brief Constructor for PrescanRequest
+           \param path name of file
+           \param descriptor readable file descriptor (closed on completion)
+           \param st file stat taken before scan
+           \param whole whole file range
+        */
+        PrescanRequest(const char* path, int descriptor, const struct stat& st,
+                       const vector<ScanRange>& whole);
+        /*!\brief Destructor for PrescanRequest */
+        virtual ~PrescanRequest();
+
+        /*!\brief Records verdict and frees request
+           \param reply clamd reply (empty on error)
+        */
+        virtual void complete(const string& reply);
+
+    private:
+        /*!\brief Forbid usage of copy constructor */
+        PrescanRequest(const PrescanRequest& aRequest);
+        /*!\brief Forbid usage of assignment operator */
+        PrescanRequest& operator = (const PrescanRequest& aRequest);
+
+        /*!\brief name of file */
+        string path;
+        /*!\brief readable file descriptor */
+        int file;
+        /*!\brief file stat taken before scan */
+        struct stat before;
+};
+
+PrescanRequest::PrescanRequest(const char* name, int descriptor, const struct stat& st,
+                               const vector<ScanRange>& whole):
+    ClamdRequest(prescanCommand, name, descriptor, whole, NULL),
+    path(name), file(descriptor), before(st) {
+}
+
+PrescanRequest::~PrescanRequest() {
+}
+
+void PrescanRequest::complete(const string& reply) {
+    Logger& logger = Logger::root();
+    struct stat after;
+
+    /* verdict is valid only for content clamd has seen */
+    bool unchanged = (fstat(file, &after) == 0) &&
+                     (after.st_mtime == before.st_mtime) &&
+                     (after.st_size == before.st_size);
+    close(file);
+
+    clamd_reply verdict = ClamavParseReply(reply);
+    {
+        FastMutex::ScopedLock lock(prescanMutex);
+        if (!unchanged) {
+            ++changedFiles;
+            poco_debug_f1(logger, "file %s changed while being scanned, verdict skipped", path);
+        } else if ((verdict == reply_clean) || (verdict == reply_infected)) {
+            if (verdict == reply_clean) {
+                ++cleanFiles;
+                poco_debug_f1(logger, "file %s is clean", path);
+            } else {
+                ++infectedFiles;
+                poco_warning_f2(logger, "file %s is infected: %s", path, reply);
+            }
+            if (!writer.add(before, verdict == reply_clean))
+                writeFailed = true;
+        } else {
+            ++failedFiles;
+            poco_warning_f2(logger, "cannot scan file %s: %s", path,
+                reply.empty() ? string("< empty clamd reply >") : reply);
+        }
+        --inFlight;
+        prescanDone.signal();
+    }
+
+    delete this;
+}
+
+/*!\brief Queries clamd version with VERSION command
+   \param socket clamd socket
+   \param version reply ("ClamAV <engine>/<signatures>/<date>")
+   \returns 0 on success and -1 on failure
+*/
+static int PrescanVersion(const char* socket, string& version) {
+    Logger& logger = Logger::root();
+
+    try {
+        StreamSocket clamdSocket;
+        clamdSocket.connect(SocketAddress(socket),
+                            (Timestamp::TimeDiff)CLAMD_DEFAULT_CONNECT_TIMEOUT * 1000);
+        clamdSocket.setReceiveTimeout((Timestamp::TimeDiff)CLAMD_DEFAULT_REPLY_TIMEOUT * 1000);
+        SocketStream clamd(clamdSocket);
+        clamd << "nVERSION" << endl;
+        getline(clamd, version);
+    } catch (Exception &exc) {
+        poco_warning_f2(logger, "error: unable to query clamd via %s: %s",
+            string(socket), exc.displayText());
+        return -1;
+    }
+
+    if (version.compare(0, 7, "ClamAV ") != 0) {
+        poco_warning_f1(logger, "invalid reply for VERSION received: %s", version);
+        return -1;
+    }
+    return 0;
+}
+
+/*!\brief nftw() callback, submits scan of each regular file */
+static int PrescanVisit(const char* path, const struct stat* sb, int type, struct FTW* ftwbuf) {
+    Logger& logger = Logger::root();
+    struct stat st;
+
+    (void)ftwbuf;
+    if ((type == FTW_DNR) || (type == FTW_NS)) {
+        poco_warning_f1(logger, "cannot read %s, skipped", string(path));
+        return 0;
+    }
+    if ((type != FTW_F) || !S_ISREG(sb->st_mode))
+        return 0;
+
+    int fd = open(path, O_RDONLY | O_NOCTTY | O_NOFOLLOW);
+    if ((fd < 0) || (fstat(fd, &st) != 0) || !S_ISREG(st.st_mode)) {
+        poco_warning_f2(logger, "cannot open file %s: %s", string(path), string(strerror(errno)));
+        if (fd >= 0)
+            close(fd);
+        FastMutex::ScopedLock lock(prescanMutex);
+        ++failedFiles;
+        return 0;
+    }
+
+    /*
+     * Keep pipelines of all connections full, but do not run out
+     * of file descriptors
+     */
+    {
+        FastMutex::ScopedLock lock(prescanMutex);
+        while (inFlight >= maxInFlight)
+            prescanDone.wait(prescanMutex);
+        ++inFlight;
+    }
+
+    vector<ScanRange> whole(1);
+    whole[0].offset = 0;
+    whole[0].length = st.st_size;
+    client->submit(new PrescanRequest(path, fd, st, whole));
+    return 0;
+}
+
+} /* namespace clamfs */
+
+/*!\brief Prints usage information
+   \param name program name
+*/
+static void usage(const char* name) {
+    fprintf(stderr,
+        "Usage: %s [options] <database> <directory>...\n"
+        "\n"
+        "Scans files below directories with clamd and writes verdict database\n"
+        "ClamFS imports at mount (<cache import=\"<database>\" ... />).\n"
+        "\n"
+        "Options:\n"
+        "  -s <socket>  clamd socket (default " PRESCAN_DEFAULT_SOCKET ")\n"
+        "  -m <mode>    fname, fdpass or stream (default fdpass if supported)\n"
+        "  -c <count>   clamd connections (default %d)\n"
+        "  -p <count>   requests outstanding on connection (default %d)\n"
+        "  -x           do not cross file system boundaries\n"
+        "  -v           verbose output\n",
+        name, CLAMD_DEFAULT_CONNECTIONS, CLAMD_DEFAULT_PIPELINE);
+}
+
+int main(int argc, char *argv[]);
+int main(int argc, char *argv[])
+{
+    const char* socket = PRESCAN_DEFAULT_SOCKET;
+    const char* mode = NULL;
+    unsigned int connections = CLAMD_DEFAULT_CONNECTIONS;
+    unsigned int pipeline = CLAMD_DEFAULT_PIPELINE;
+    int walkFlags = FTW_PHYS;
+    bool verbose = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:m:c:p:xvh")) != -1) {
+        switch (opt) {
+            case 's': socket = optarg; break;
+            case 'm': mode = optarg; break;
+            case 'c': connections = (unsigned int)atol(optarg); break;
+            case 'p': pipeline = (unsigned int)atol(optarg); break;
+            case 'x': walkFlags |= FTW_MOUNT; break;
+            case 'v': verbose = true; break;
+            default: usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if ((argc - optind < 2) || (connections == 0) || (pipeline == 0)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    LoggerOpenStdio();
+    Logger& logger = Logger::root();
+    if (!verbose)
+        logger.setLevel(Message::PRIO_INFORMATION);
+
+    /*
+     * Select scan command, FILDES keeps clamd from reading files
+     * through slow stream, SCAN needs absolute names
+     */
+    if ((mode == NULL) || (strncmp(mode, "fdpass", 6) == 0)) {
+#ifdef HAVE_FD_PASSING
+        prescanCommand = command_fildes;
+#else
+        if (mode != NULL) {
+            poco_warning(logger, "fdpass mode not available due to lack of fd passing");
+            return EXIT_FAILURE;
+        }
+        prescanCommand = command_instream;
+#endif
+    } else if (strncmp(mode, "stream", 6) == 0) {
+        prescanCommand = command_instream;
+    } else if (strncmp(mode, "fname", 5) == 0) {
+        prescanCommand = command_scan;
+    } else {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    /*
+     * Verdicts are valid only for signatures they were made with
+     */
+    string version;
+    if (PrescanVersion(socket, version) != 0)
+        return EXIT_FAILURE;
+    unsigned long signatures = ClamavSignatureVersion(version);
+    if (signatures == 0) {
+        poco_warning_f1(logger, "clamd did not report signatures version: %s", version);
+        return EXIT_FAILURE;
+    }
+    poco_information_f1(logger, "scanning with %s", version);
+
+    const char* database = argv[optind++];
+    if (!writer.open(database, signatures))
+        return EXIT_FAILURE;
+
+    client = new ClamdClient(socket, connections, pipeline);
+    client->setTimeouts(CLAMD_DEFAULT_CONNECT_TIMEOUT, CLAMD_DEFAULT_SEND_TIMEOUT,
+                        CLAMD_DEFAULT_REPLY_TIMEOUT, CLAMD_DEFAULT_REPLY_PER_MIB);
+    client->start();
+    maxInFlight = connections * pipeline * 2;
+
+    /*
+     * Walk trees and submit scans
+     */
+    int ret = EXIT_SUCCESS;
+    for (; optind < argc; ++optind) {
+        char resolved[PATH_MAX];
+        if (realpath(argv[optind], resolved) == NULL) {
+            poco_warning_f2(logger, "cannot resolve %s: %s",
+                string(argv[optind]), string(strerror(errno)));
+            ret = EXIT_FAILURE;
+            continue;
+        }
+        poco_information_f1(logger, "scanning %s", string(resolved));
+        if (nftw(resolved, PrescanVisit, PRESCAN_OPEN_DIRS, walkFlags) != 0) {
+            poco_warning_f2(logger, "cannot walk %s: %s", string(resolved), string(strerror(errno)));
+            ret = EXIT_FAILURE;
+        }
+    }
+
+    {
+        FastMutex::ScopedLock lock(prescanMutex);
+        while (inFlight > 0)
+            prescanDone.wait(prescanMutex);
+    }
+    client->stop();
+    delete client;
+    client = NULL;
+
+    poco_information_f4(logger, "%lu clean, %lu infected, %lu not scanned, %lu changed while scanned",
+        cleanFiles, infectedFiles, failedFiles, changedFiles);
+
+    /*
+     * Signatures updated in the middle of scan make verdicts mixed
+     */
+    string finalVersion;
+    if ((PrescanVersion(socket, finalVersion) != 0) ||
+        (ClamavSignatureVersion(finalVersion) != signatures)) {
+        poco_warning(logger, "clamd signatures changed during scan, database not written, run scan again");
+        writer.discard();
+        return EXIT_FAILURE;
+    }
+    if (writeFailed || !writer.close()) {
+        poco_warning_f1(logger, "cannot write verdict database %s", string(database));
+        writer.discard();
+        return EXIT_FAILURE;
+    }
+    poco_information_f2(logger, "%lu verdicts written to %s", writer.count(), string(database));
+
+    return ret;
+}
+
+/* EoF */
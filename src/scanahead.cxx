@@ -0,0 +1,384 @@
+/*!\file scanahead.cxx
+
+   \brief Speculative scan of listed directories
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "scanahead.hxx"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <Poco/ScopedUnlock.h>
+
+#include "logger.hxx"
+#include "clamav.hxx"
+#include "breaker.hxx"
+#include "extacl.hxx"
+#include "stats.hxx"
+
+namespace clamfs {
+
+extern ScanCache* cache;
+extern ExtensionACL* extensions;
+
+ScanAhead::Listing::~Listing() {
+    if (fd >= 0)
+        close(fd);
+}
+
+ScanAhead::ScanAhead(off_t size, size_t entries, long ttlMs, bool listed):
+    maximalSize(size), maximalEntries((entries > 0) ? entries : 1),
+    ttl((ttlMs > 0) ? ttlMs : 1), scanListed(listed), pending(0), stopping(false),
+    thread("scanahead") {
+}
+
+ScanAhead::~ScanAhead() {
+    stop();
+}
+
+void ScanAhead::listed(int dirfd, const vector<ahead_entry>& entries,
+                       const struct fuse_context* context) {
+    struct stat dirst;
+
+    if (!scanListed || entries.empty() || (fstat(dirfd, &dirst) != 0))
+        return;
+    scan_key_t dir = ScanCacheKey(dirst);
+
+    FastMutex::ScopedLock lock(mutex);
+    if (stopping)
+        return;
+
+    map<scan_key_t, SharedPtr<Listing> >::iterator it = listings.find(dir);
+    if (it == listings.end()) {
+        if (pending >= maximalEntries) {
+            ADD_STAT_COUNTER(aheadCancelled, entries.size());
+            return;
+        }
+        /* directory handle may be released before files are scanned */
+        int fd = fcntl(dirfd, F_DUPFD_CLOEXEC, 0);
+        if (fd < 0)
+            return;
+        SharedPtr<Listing> listing(new Listing);
+        listing->fd = fd;
+        listing->dir = dir;
+        listing->context = *context;
+        listing->context.fuse = NULL;
+        listing->context.private_data = NULL;
+        listing->armed = false;
+        listing->next = 0;
+        listing->pending = 0;
+        it = listings.insert(make_pair(dir, listing)).first;
+    }
+
+    Listing& listing = *it->second;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (pending >= maximalEntries) {
+            ADD_STAT_COUNTER(aheadCancelled, entries.size() - i);
+            break;
+        }
+        Candidate file;
+        file.name = entries[i].name;
+        file.key = make_pair(dirst.st_dev, entries[i].ino);
+        file.pending = true;
+        /* directory listed again (or file is still waiting elsewhere) */
+        if (candidates.find(file.key) != candidates.end())
+            continue;
+        candidates[file.key] = make_pair(dir, listing.files.size());
+        listing.files.push_back(file);
+        ++listing.pending;
+        ++pending;
+        INC_STAT_COUNTER(aheadListed);
+    }
+}
+
+void ScanAhead::predicted(const vector<string>& paths,
+                          const struct fuse_context* context) {
+    FastMutex::ScopedLock lock(mutex);
+    if (stopping)
+        return;
+
+    for (size_t i = 0; i < paths.size(); ++i) {
+        /* oldest predictions are least likely to be still useful */
+        if (predictions.size() >= maximalEntries)
+            predictions.pop_front();
+        Prediction file;
+        file.path = paths[i];
+        file.context = *context;
+        file.context.fuse = NULL;
+        file.context.private_data = NULL;
+        predictions.push_back(file);
+    }
+    if (!paths.empty())
+        wakeup.signal();
+}
+
+bool ScanAhead::opened(const scan_key_t& key) {
+    FastMutex::ScopedLock lock(mutex);
+
+    /*
+     * File scanned ahead, keep its listing going
+     */
+    map<scan_key_t, scan_key_t>::iterator done = scanned.find(key);
+    if (done != scanned.end()) {
+        map<scan_key_t, SharedPtr<Listing> >::iterator it = listings.find(done->second);
+        if (it != listings.end())
+            it->second->active.update();
+        scanned.erase(done);
+        return true;
+    }
+
+    /*
+     * File still waiting, arm its listing (file itself is scanned on open)
+     */
+    map<scan_key_t, pair<scan_key_t, size_t> >::iterator found = candidates.find(key);
+    if (found == candidates.end())
+        return false;
+    map<scan_key_t, SharedPtr<Listing> >::iterator it = listings.find(found->second.first);
+    if (it != listings.end()) {
+        Listing& listing = *it->second;
+        size_t index = found->second.second;
+        listing.files[index].pending = false;
+        --listing.pending;
+        --pending;
+        if (listing.next <= index)
+            listing.next = index + 1;
+        listing.active.update();
+        if (!listing.armed) {
+            listing.armed = true;
+            armed.push_back(it->first);
+            wakeup.signal();
+        }
+    }
+    candidates.erase(found);
+    return false;
+}
+
+void ScanAhead::cancel(const scan_key_t& dir) {
+    map<scan_key_t, SharedPtr<Listing> >::iterator it = listings.find(dir);
+    if (it == listings.end())
+        return;
+
+    Listing& listing = *it->second;
+    for (size_t i = 0; i < listing.files.size(); ++i) {
+        if (listing.files[i].pending)
+            candidates.erase(listing.files[i].key);
+    }
+    ADD_STAT_COUNTER(aheadCancelled, listing.pending);
+    pending -= listing.pending;
+    /* descriptor is closed when scanning thread releases listing */
+    listings.erase(it);
+}
+
+void ScanAhead::expire() {
+    vector<scan_key_t> idle;
+    for (map<scan_key_t, SharedPtr<Listing> >::iterator it = listings.begin();
+         it != listings.end(); ++it) {
+        if (it->second->active.isElapsed((Timestamp::TimeDiff)ttl * 1000))
+            idle.push_back(it->first);
+    }
+    for (size_t i = 0; i < idle.size(); ++i)
+        cancel(idle[i]);
+}
+
+bool ScanAhead::pick(SharedPtr<Listing>& listing, string& name) {
+    while (!armed.empty()) {
+        map<scan_key_t, SharedPtr<Listing> >::iterator it = listings.find(armed.front());
+        if ((it == listings.end()) || !it->second->armed) {
+            armed.pop_front(); /* cancelled meanwhile */
+            continue;
+        }
+
+        Listing& current = *it->second;
+        while ((current.next < current.files.size()) && !current.files[current.next].pending)
+            ++current.next;
+        if (current.next >= current.files.size()) {
+            /* files listed before opened one are not wanted */
+            armed.pop_front();
+            cancel(it->first);
+            continue;
+        }
+
+        Candidate& file = current.files[current.next++];
+        file.pending = false;
+        --current.pending;
+        --pending;
+        candidates.erase(file.key);
+        listing = it->second;
+        name = file.name;
+        return true;
+    }
+    return false;
+}
+
+scan_key_t ScanAhead::scan(Listing& listing, const string& name) {
+    /*
+     * Path is needed by fname mode and logs (resolved once per listing)
+     */
+    if (listing.path.empty()) {
+        Logger& logger = Logger::root();
+        char procname[64];
+        char buf[PATH_MAX];
+        snprintf(procname, sizeof(procname), "/proc/self/fd/%d", listing.fd);
+        ssize_t length = readlink(procname, buf, sizeof(buf) - 1);
+        if (length <= 0) {
+            poco_debug(logger, "scan-ahead: cannot resolve directory path");
+            return make_pair((dev_t)0, (ino_t)0);
+        }
+        buf[length] = '\0';
+        listing.path = buf;
+    }
+
+    return scan(listing.fd, name, listing.path + "/" + name, listing.context);
+}
+
+scan_key_t ScanAhead::scan(int dirfd, const string& name, const string& path,
+                           const struct fuse_context& context) {
+    Logger& logger = Logger::root();
+    scan_key_t none = make_pair((dev_t)0, (ino_t)0);
+    struct stat st;
+
+    /* do not count speculative scans as clamd failures */
+    if ((breaker != NULL) && !breaker->allow())
+        return none;
+    if ((extensions != NULL) && (extensions->match(name.c_str()) == whitelisted))
+        return none;
+
+    int flags = O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_NOCTTY | O_CLOEXEC;
+#ifdef O_NOATIME
+    /* files nobody opened yet keep their access time */
+    int fd = openat(dirfd, name.c_str(), flags | O_NOATIME);
+    if ((fd == -1) && (errno == EPERM))
+        fd = openat(dirfd, name.c_str(), flags);
+#else
+    int fd = openat(dirfd, name.c_str(), flags);
+#endif
+    if (fd == -1)
+        return none;
+    if ((fstat(fd, &st) != 0) || !S_ISREG(st.st_mode) ||
+        ((maximalSize >= 0) && (st.st_size > maximalSize))) {
+        close(fd);
+        return none;
+    }
+
+    /*
+     * Verdict may be known already (cached before or file opened meanwhile)
+     */
+    scan_key_t key = ScanCacheKey(st);
+    if (cache != NULL) {
+        SharedPtr<CachedResult> cached = cache->get(key);
+        if (cached && (cached->scanTimestamp == st.st_mtime) &&
+            (cached->fileSize < 0 || cached->fileSize == st.st_size) &&
+            (cached->isPartial == false)) {
+            close(fd);
+            return none;
+        }
+    }
+
+    poco_debug_f1(logger, "scanning ahead %s", path);
+    int result = ClamavScanFile(path.c_str(), fd, st.st_size, NULL, &context, NULL);
+    close(fd);
+
+    if ((result != 0) && (result != 1))
+        return none;
+    if (cache != NULL) {
+        CachedResult verdict(result == 0, st.st_mtime, false, st.st_size);
+        cache->add(key, verdict);
+    }
+    INC_STAT_COUNTER(aheadScanned);
+    return key;
+}
+
+void ScanAhead::start() {
+    thread.start(*this);
+}
+
+void ScanAhead::stop() {
+    {
+        FastMutex::ScopedLock lock(mutex);
+        if (stopping)
+            return;
+        stopping = true;
+        wakeup.broadcast();
+    }
+    if (thread.isRunning())
+        thread.join();
+}
+
+void ScanAhead::run() {
+    FastMutex::ScopedLock lock(mutex);
+    while (!stopping) {
+        expire();
+
+        /*
+         * Predicted files go first, they are opened soon
+         */
+        if (!predictions.empty()) {
+            Prediction file = predictions.front();
+            predictions.pop_front();
+
+            scan_key_t key;
+            {
+                ScopedUnlock<FastMutex> unlock(mutex);
+                key = scan(AT_FDCWD, file.path, file.path, file.context);
+            }
+            if (key.second == 0)
+                continue;
+            INC_STAT_COUNTER(historyScanned);
+            remember(key, make_pair((dev_t)0, (ino_t)0));
+            continue;
+        }
+
+        SharedPtr<Listing> listing;
+        string name;
+        if (!pick(listing, name)) {
+            wakeup.tryWait(mutex, ttl);
+            continue;
+        }
+
+        scan_key_t key;
+        {
+            ScopedUnlock<FastMutex> unlock(mutex);
+            key = scan(*listing, name);
+        }
+        if (key.second == 0)
+            continue;
+        remember(key, listing->dir);
+    }
+}
+
+void ScanAhead::remember(const scan_key_t& key, const scan_key_t& dir) {
+    /*
+     * Remember file until it is opened (hit) or forgotten (wasted)
+     */
+    scanned[key] = dir;
+    scannedOrder.push_back(key);
+    while (scannedOrder.size() > maximalEntries) {
+        scanned.erase(scannedOrder.front());
+        scannedOrder.pop_front();
+    }
+}
+
+} /* namespace clamfs */
+
+/* EoF */
@@ -0,0 +1,248 @@
+/*!\file scanahead.hxx
+
+   \brief Speculative scan of listed directories (header file)
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef CLAMFS_SCANAHEAD_HXX
+#define CLAMFS_SCANAHEAD_HXX
+
+#include "config.h"
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include <fuse.h>
+#include <sys/stat.h>
+#include <Poco/Mutex.h>
+#include <Poco/Condition.h>
+#include <Poco/Runnable.h>
+#include <Poco/SharedPtr.h>
+#include <Poco/Thread.h>
+#include <Poco/Timestamp.h>
+
+#ifdef DMALLOC
+   #include <stdlib.h>
+   #ifdef HAVE_MALLOC_H
+      #include <malloc.h>
+   #endif
+   #include <dmalloc.h>
+#endif
+
+#include "scancache.hxx"
+
+/*!\def SCANAHEAD_DEFAULT_ENTRIES
+   \brief Default maximal number of listed files waiting for scan-ahead
+*/
+#define SCANAHEAD_DEFAULT_ENTRIES 4096
+
+/*!\def SCANAHEAD_DEFAULT_TTL
+   \brief Default time listed files wait for first open in directory (in ms)
+*/
+#define SCANAHEAD_DEFAULT_TTL 5000
+
+namespace clamfs {
+
+using namespace std;
+using namespace Poco;
+
+/*!\struct ahead_entry
+   \brief Regular file found by readdir
+*/
+struct ahead_entry {
+    /*!\brief file name */
+    string name;
+    /*!\brief inode number (from directory entry) */
+    ino_t ino;
+};
+
+/*!\class ScanAhead
+   \brief Speculative background scan of files in listed directories
+
+   Regular files returned by readdir are remembered per directory.
+   Nothing is scanned until a file of that directory is opened, which
+   tells tar, rsync or compiler from plain ls. Then the rest of its
+   files (uncached and below size limit) are scanned one by one in
+   background, in listing order, so their opens are cache hits.
+   Listings no file was opened from within TTL, and armed listings
+   with no open for TTL, are cancelled. Files opened while still
+   waiting are left to the on-access scan.
+
+   Files predicted by AccessHistory are queued too and scanned before
+   files of armed listings.
+*/
+class ScanAhead: public Runnable {
+    public:
+        /*!\brief Constructor for ScanAhead
+           \param maximalSize files bigger than this are not scanned ahead
+           \param entries maximal number of listed files waiting for scan
+           \param ttl time listed files wait for open in directory (in ms)
+           \param listing false to scan predicted files only (readdir is ignored)
+        */
+        ScanAhead(off_t maximalSize, size_t entries, long ttl, bool listing = true);
+        /*!\brief Destructor for ScanAhead */
+        virtual ~ScanAhead();
+
+        /*!\brief Remembers regular files returned by readdir
+           \param dirfd descriptor of listed directory (duplicated if needed)
+           \param entries regular files (and entries of unknown type)
+           \param context process listing directory
+        */
+        void listed(int dirfd, const vector<ahead_entry>& entries,
+                    const struct fuse_context* context);
+        /*!\brief Queues files predicted to be opened soon
+           \param paths file paths in real filesystem tree
+           \param context process which opened file they were predicted from
+        */
+        void predicted(const vector<string>& paths, const struct fuse_context* context);
+        /*!\brief Notes file open, arms scan-ahead of its directory
+           \param key scan cache key of opened file
+           \returns true if file was scanned ahead (and not opened since)
+        */
+        bool opened(const scan_key_t& key);
+
+        /*!\brief Starts scanning thread */
+        void start();
+        /*!\brief Stops scanning thread */
+        void stop();
+        /*!\brief Scanning thread main loop */
+        virtual void run();
+
+    private:
+        /*!\brief Forbid usage of copy constructor */
+        ScanAhead(const ScanAhead& aScanAhead);
+        /*!\brief Forbid usage of assignment operator */
+        ScanAhead& operator = (const ScanAhead& aScanAhead);
+
+        /*!\brief Listed file waiting for scan */
+        struct Candidate {
+            /*!\brief file name */
+            string name;
+            /*!\brief cache key (directory device and entry inode) */
+            scan_key_t key;
+            /*!\brief false once scanned, opened or cancelled */
+            bool pending;
+        };
+
+        /*!\brief Listed files of one directory */
+        struct Listing {
+            /*!\brief Destructor for Listing (closes directory) */
+            ~Listing();
+
+            /*!\brief duplicated directory descriptor */
+            int fd;
+            /*!\brief directory cache key */
+            scan_key_t dir;
+            /*!\brief directory path in real filesystem tree (set by scanning thread) */
+            string path;
+            /*!\brief process which listed directory */
+            struct fuse_context context;
+            /*!\brief time of listing or of last open of its file */
+            Timestamp active;
+            /*!\brief true once file of directory was opened */
+            bool armed;
+            /*!\brief listed files (in order) */
+            vector<Candidate> files;
+            /*!\brief index of next file to scan */
+            size_t next;
+            /*!\brief number of pending files */
+            size_t pending;
+        };
+
+        /*!\brief Predicted file waiting for scan */
+        struct Prediction {
+            /*!\brief file path in real filesystem tree */
+            string path;
+            /*!\brief process which opened file it was predicted from */
+            struct fuse_context context;
+        };
+
+        /*!\brief Drops listing and cancels its pending files */
+        void cancel(const scan_key_t& dir);
+        /*!\brief Cancels listings not active within TTL */
+        void expire();
+        /*!\brief Picks next file to scan
+           \param listing listing of picked file
+           \param name name of picked file
+           \returns false if nothing is armed
+        */
+        bool pick(SharedPtr<Listing>& listing, string& name);
+        /*!\brief Remembers file scanned ahead until it is opened
+           \param key cache key of scanned file
+           \param dir key of its listing or (0, 0) for predicted file
+        */
+        void remember(const scan_key_t& key, const scan_key_t& dir);
+        /*!\brief Scans listed file (resolves path of its directory first)
+           \returns cache key of scanned file or (0, 0) if it was not scanned
+        */
+        scan_key_t scan(Listing& listing, const string& name);
+        /*!\brief Scans file and stores verdict in cache
+           \param dirfd directory name is relative to (or AT_FDCWD)
+           \param name file name (relative to dirfd)
+           \param path file path in real filesystem tree
+           \param context process scan is done for
+           \returns cache key of scanned file or (0, 0) if it was not scanned
+        */
+        scan_key_t scan(int dirfd, const string& name, const string& path,
+                        const struct fuse_context& context);
+
+        /*!\brief files bigger than this are not scanned ahead */
+        off_t maximalSize;
+        /*!\brief maximal number of pending files */
+        size_t maximalEntries;
+        /*!\brief time listing waits for activity (in ms) */
+        long ttl;
+        /*!\brief true if files of listed directories are scanned */
+        bool scanListed;
+
+        /*!\brief protects state below */
+        FastMutex mutex;
+        /*!\brief signalled when listing is armed or thread is stopped */
+        Condition wakeup;
+        /*!\brief listings by directory */
+        map<scan_key_t, SharedPtr<Listing> > listings;
+        /*!\brief pending files (listing key and index in it) by cache key */
+        map<scan_key_t, pair<scan_key_t, size_t> > candidates;
+        /*!\brief armed listings (in order of arming) */
+        deque<scan_key_t> armed;
+        /*!\brief predicted files (in order of prediction) */
+        deque<Prediction> predictions;
+        /*!\brief number of pending files */
+        size_t pending;
+        /*!\brief files scanned ahead and not opened yet (with their listing) */
+        map<scan_key_t, scan_key_t> scanned;
+        /*!\brief order of scanned (oldest first, to forget unused ones) */
+        deque<scan_key_t> scannedOrder;
+        /*!\brief stop request flag */
+        bool stopping;
+        /*!\brief scanning thread */
+        Thread thread;
+};
+
+/*!\brief extern to access scan-ahead pointer (NULL if disabled) */
+extern ScanAhead* scanahead;
+
+} /* namespace clamfs */
+
+#endif /* CLAMFS_SCANAHEAD_HXX */
+
+/* EoF */
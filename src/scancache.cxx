@@ -26,16 +26,19 @@
 
 namespace clamfs {
 
-CachedResult::CachedResult(bool isFileClean, time_t scanFileTimestamp) {
+CachedResult::CachedResult(bool isFileClean, time_t scanFileTimestamp, bool isPartialScan,
+                           off_t scanFileSize) {
     isClean = isFileClean;
     scanTimestamp = scanFileTimestamp;
+    isPartial = isPartialScan;
+    fileSize = scanFileSize;
 }
 
 CachedResult::~CachedResult() {
 }
 
 ScanCache::ScanCache(unsigned long int elements, long int expire):
-    ExpireLRUCache<ino_t, CachedResult>(elements, expire) {
+    ExpireLRUCache<scan_key_t, CachedResult>(elements, expire) {
 }
 
 ScanCache::~ScanCache() {
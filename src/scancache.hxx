@@ -27,6 +27,7 @@
 
 #include "config.h"
 
+#include <utility>
 #include <sys/stat.h>
 #include <Poco/ExpireLRUCache.h>
 
@@ -54,8 +55,11 @@ class CachedResult {
         /*!\brief Constructor for CachedResult
            \param isFileClean anti-virus scan result flag
            \param scanFileTimestamp last scan timestamp
+           \param isPartialScan true if only parts of file were scanned
+           \param scanFileSize size of file when it was scanned (-1 if not checked)
         */
-        CachedResult(bool isFileClean, time_t scanFileTimestamp);
+        CachedResult(bool isFileClean, time_t scanFileTimestamp, bool isPartialScan = false,
+                     off_t scanFileSize = -1);
         /*!\brief Destructor for CachedResult */
         ~CachedResult();
 
@@ -63,15 +67,35 @@ class CachedResult {
         bool isClean;
         /*!\brief last scan timestamp */
         time_t scanTimestamp;
+        /*!\brief partial scan flag (verdict not valid for full scan) */
+        bool isPartial;
+        /*!\brief size of scanned file (-1 if not checked) */
+        off_t fileSize;
 };
 
+/*!\typedef scan_key_t
+   \brief ScanCache key (device and inode of scanned file)
+
+   Inode numbers are unique only within one device, and mounts served
+   by one daemon can share the cache while living on different devices.
+*/
+typedef pair<dev_t, ino_t> scan_key_t;
+
+/*!\brief Returns ScanCache key of file
+   \param st file stat
+   \returns cache key
+*/
+static inline scan_key_t ScanCacheKey(const struct stat& st) {
+    return make_pair(st.st_dev, st.st_ino);
+}
+
 /*!\class ScanCache
    \brief LRU cache for anti-virus scan results storage
 
    LRU cache with time-based expiration. Based on Poco::ExpireLRUCache.
    This cache stores anti-virus scan results for later use.
 */
-class ScanCache: public ExpireLRUCache<ino_t, CachedResult> {
+class ScanCache: public ExpireLRUCache<scan_key_t, CachedResult> {
     public:
         /*!\brief Constructor for ScanCache
            \param elements maximal size of cache
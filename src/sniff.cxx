@@ -0,0 +1,205 @@
+/*!\file sniff.cxx
+
+   \brief File content type sniffing routines
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "sniff.hxx"
+
+#include <cctype>
+#include <cstring>
+#include <unistd.h>
+
+namespace clamfs {
+
+/*!\brief Reads big-endian 32 bit number */
+static inline unsigned long readBE32(const unsigned char* data) {
+    return ((unsigned long)data[0] << 24) | ((unsigned long)data[1] << 16) |
+           ((unsigned long)data[2] << 8) | (unsigned long)data[3];
+}
+
+/*!\brief Checks JFIF or Exif segment following JPEG start of image */
+static bool validJpeg(const unsigned char* data, size_t size) {
+    if (size < 12)
+        return false;
+    if (data[3] == 0xe0)
+        return memcmp(data + 6, "JFIF\0", 5) == 0;
+    if (data[3] == 0xe1)
+        return memcmp(data + 6, "Exif\0\0", 6) == 0;
+    return false;
+}
+
+/*!\brief Checks IHDR chunk following PNG signature */
+static bool validPng(const unsigned char* data, size_t size) {
+    return (size >= 16) && (memcmp(data + 8, "\0\0\0\rIHDR", 8) == 0);
+}
+
+/*!\brief Checks ID3v2 version and flags */
+static bool validId3(const unsigned char* data, size_t size) {
+    return (size >= 10) && (data[3] >= 2) && (data[3] <= 4) &&
+           (data[4] != 0xff) && ((data[5] & 0x0f) == 0);
+}
+
+/*!\brief Checks size and major brand of ISO base media ftyp box */
+static bool validFtyp(const unsigned char* data, size_t size) {
+    if (size < 16)
+        return false;
+    unsigned long box = readBE32(data);
+    if ((box < 16) || (box > 1024) || (box % 4 != 0))
+        return false;
+    for (size_t i = 8; i < 12; ++i)
+        if (!isalnum(data[i]) && (data[i] != ' '))
+            return false;
+    return true;
+}
+
+/*!\brief Checks Matroska or WebM document type in EBML header */
+static bool validMatroska(const unsigned char* data, size_t size) {
+    size_t length = (size < 64) ? size : 64;
+    return (memmem(data, length, "\x42\x82\x88" "matroska", 11) != NULL) ||
+           (memmem(data, length, "\x42\x82\x84" "webm", 7) != NULL);
+}
+
+/*!\brief Checks version and beginning of stream flag of first Ogg page */
+static bool validOgg(const unsigned char* data, size_t size) {
+    return (size >= 27) && (data[4] == 0) && (data[5] == 0x02);
+}
+
+/*!\brief Checks STREAMINFO block following FLAC signature */
+static bool validFlac(const unsigned char* data, size_t size) {
+    return (size >= 8) && ((data[4] & 0x7f) == 0) && (data[5] == 0) &&
+           (data[6] == 0) && (data[7] == 34);
+}
+
+/*!\brief Checks RIFF header of WAVE, AVI and WebP */
+static bool validRiff(const unsigned char* data, size_t size) {
+    return (size >= 16) && (memcmp(data, "RIFF", 4) == 0);
+}
+
+/*!\struct MagicNumber
+   \brief Magic number of file type
+*/
+struct MagicNumber {
+    /*!\brief offset of magic in file */
+    size_t offset;
+    /*!\brief magic bytes */
+    const char* magic;
+    /*!\brief length of magic */
+    size_t length;
+    /*!\brief class of file type */
+    content_class cls;
+    /*!\brief short name of file type */
+    const char* type;
+    /*!\brief checks rest of container header (NULL if magic is enough) */
+    bool (*valid)(const unsigned char* data, size_t size);
+};
+
+/*!\def MAGIC
+   \brief Defines MagicNumber from string literal
+*/
+#define MAGIC(offset, magic, cls, type) { offset, magic, sizeof(magic) - 1, cls, type, NULL }
+
+/*!\def CONTAINER
+   \brief Defines MagicNumber of container with header checked by function
+*/
+#define CONTAINER(offset, magic, type, valid) { offset, magic, sizeof(magic) - 1, content_inert, type, valid }
+
+/*!\brief Known magic numbers, dangerous types are checked first
+
+   Media containers are recognised by their whole header only, so few
+   matching leading bytes are not enough to shorten scan of file.
+*/
+static const MagicNumber magicNumbers[] = {
+    /* executables */
+    MAGIC(0, "\x7f" "ELF",                 content_dangerous, "ELF"),
+    MAGIC(0, "MZ",                         content_dangerous, "PE/DOS executable"),
+    MAGIC(0, "\xfe\xed\xfa\xce",           content_dangerous, "Mach-O"),
+    MAGIC(0, "\xfe\xed\xfa\xcf",           content_dangerous, "Mach-O"),
+    MAGIC(0, "\xce\xfa\xed\xfe",           content_dangerous, "Mach-O"),
+    MAGIC(0, "\xcf\xfa\xed\xfe",           content_dangerous, "Mach-O"),
+    MAGIC(0, "\xca\xfe\xba\xbe",           content_dangerous, "Mach-O fat/Java class"),
+    MAGIC(0, "dex\n",                      content_dangerous, "Dalvik executable"),
+    MAGIC(0, "#!",                         content_dangerous, "script"),
+    /* archives */
+    MAGIC(0, "PK\x03\x04",                 content_dangerous, "ZIP"),
+    MAGIC(0, "PK\x05\x06",                 content_dangerous, "ZIP"),
+    MAGIC(0, "Rar!\x1a\x07",               content_dangerous, "RAR"),
+    MAGIC(0, "7z\xbc\xaf\x27\x1c",         content_dangerous, "7-Zip"),
+    MAGIC(0, "\x1f\x8b",                   content_dangerous, "gzip"),
+    MAGIC(0, "BZh",                        content_dangerous, "bzip2"),
+    MAGIC(0, "\xfd" "7zXZ",                content_dangerous, "xz"),
+    MAGIC(0, "\x28\xb5\x2f\xfd",           content_dangerous, "zstd"),
+    MAGIC(0, "MSCF",                       content_dangerous, "CAB"),
+    MAGIC(0, "!<arch>",                    content_dangerous, "ar"),
+    MAGIC(257, "ustar",                    content_dangerous, "tar"),
+    /* documents */
+    MAGIC(0, "\xd0\xcf\x11\xe0\xa1\xb1\x1a\xe1", content_dangerous, "OLE2 document"),
+    MAGIC(0, "%PDF",                       content_dangerous, "PDF"),
+    MAGIC(0, "%!",                         content_dangerous, "PostScript"),
+    MAGIC(0, "{\\rtf",                     content_dangerous, "RTF"),
+    MAGIC(0, "FWS",                        content_dangerous, "Flash"),
+    MAGIC(0, "CWS",                        content_dangerous, "Flash"),
+    MAGIC(0, "ZWS",                        content_dangerous, "Flash"),
+    /* media containers */
+    CONTAINER(0, "\xff\xd8\xff",           "JPEG",          validJpeg),
+    CONTAINER(0, "\x89PNG\r\n\x1a\n",      "PNG",           validPng),
+    MAGIC(0, "GIF87a",                     content_inert, "GIF"),
+    MAGIC(0, "GIF89a",                     content_inert, "GIF"),
+    CONTAINER(0, "ID3",                    "MP3",           validId3),
+    CONTAINER(4, "ftyp",                   "MP4/QuickTime", validFtyp),
+    CONTAINER(0, "\x1a\x45\xdf\xa3",       "Matroska/WebM", validMatroska),
+    CONTAINER(0, "OggS",                   "Ogg",           validOgg),
+    CONTAINER(0, "fLaC",                   "FLAC",          validFlac),
+    CONTAINER(8, "WAVE",                   "WAV",           validRiff),
+    CONTAINER(8, "AVI ",                   "AVI",           validRiff),
+    CONTAINER(8, "WEBP",                   "WebP",          validRiff),
+};
+
+content_class SniffBuffer(const unsigned char* data, size_t size, const char** type) {
+    for (size_t i = 0; i < sizeof(magicNumbers) / sizeof(magicNumbers[0]); ++i) {
+        const MagicNumber& m = magicNumbers[i];
+        if (m.offset + m.length <= size &&
+            memcmp(data + m.offset, m.magic, m.length) == 0 &&
+            (m.valid == NULL || m.valid(data, size))) {
+            *type = m.type;
+            return m.cls;
+        }
+    }
+
+    *type = "unknown";
+    return content_unknown;
+}
+
+content_class SniffContent(int fd, const char** type) {
+    unsigned char data[SNIFF_SIZE];
+
+    ssize_t size = pread(fd, data, sizeof(data), 0);
+    if (size < 0) {
+        *type = "unreadable";
+        return content_unknown;
+    }
+
+    return SniffBuffer(data, (size_t)size, type);
+}
+
+} /* namespace clamfs */
+
+/* EoF */
@@ -0,0 +1,87 @@
+/*!\file sniff.hxx
+
+   \brief File content type sniffing routines (header file)
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef CLAMFS_SNIFF_HXX
+#define CLAMFS_SNIFF_HXX
+
+#include "config.h"
+
+#include <sys/types.h>
+
+#ifdef DMALLOC
+   #include <stdlib.h>
+   #ifdef HAVE_MALLOC_H
+      #include <malloc.h>
+   #endif
+   #include <dmalloc.h>
+#endif
+
+/*!\def SNIFF_SIZE
+   \brief Number of bytes read from beginning of file to detect its type
+
+   Has to be at least 262 bytes to cover tar header magic.
+*/
+#define SNIFF_SIZE 512
+
+/*!\def SNIFF_DEFAULT_HEAD
+   \brief Default number of bytes from beginning of inert file scanned
+*/
+#define SNIFF_DEFAULT_HEAD 1048576
+
+/*!\def SNIFF_DEFAULT_TAIL
+   \brief Default number of bytes from end of inert file scanned
+*/
+#define SNIFF_DEFAULT_TAIL 1048576
+
+namespace clamfs {
+
+/*!\enum content_class
+   \brief Classification of file content
+*/
+enum content_class {
+    content_unknown = 0, /*!< type not recognised, follow extension ACL */
+    content_inert,       /*!< media container, only head and tail are scanned */
+    content_dangerous    /*!< executable, archive or document, always scanned */
+};
+
+/*!\brief Detects type of file by its magic number
+   \param fd open file descriptor (read with pread(), offset is not changed)
+   \param type set to short name of detected type (for logging)
+   \returns class of file content
+*/
+content_class SniffContent(int fd, const char** type);
+
+/*!\brief Detects type of data by its magic number
+   \param data beginning of file
+   \param size number of bytes in data
+   \param type set to short name of detected type (for logging)
+   \returns class of file content
+*/
+content_class SniffBuffer(const unsigned char* data, size_t size, const char** type);
+
+} /* namespace clamfs */
+
+#endif /* CLAMFS_SNIFF_HXX */
+
+/* EoF */
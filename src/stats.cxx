@@ -24,6 +24,9 @@
 
 #include "stats.hxx"
 
+#include <errno.h>
+#include <stdio.h>
+
 namespace clamfs {
 
 Stats::Stats(time_t dumpEvery) {
@@ -35,13 +38,43 @@ Stats::Stats(time_t dumpEvery) {
     whitelistHit = 0;
     blacklistHit = 0;
 
+    policySkipHit = 0;
+    policyForceHit = 0;
+
+    sniffCalled = 0;
+    sniffInert = 0;
+    sniffDangerous = 0;
+    sniffTime = 0;
+
     tooBigFile = 0;
 
+    partialScan = 0;
+    partialScanBytes = 0;
+    partialCacheHit = 0;
+
+    asyncScan = 0;
+    asyncRevoked = 0;
+
+    aheadListed = 0;
+    aheadScanned = 0;
+    aheadHit = 0;
+    aheadCancelled = 0;
+    historyOpens = 0;
+    historyPredicted = 0;
+    historyUsed = 0;
+    historyScanned = 0;
+
+    passthroughOpen = 0;
+
     openCalled = 0;
     openAllowed = 0;
     openDenied = 0;
 
     scanFailed = 0;
+    breakerSkipped = 0;
+    breakerWaited = 0;
+
+    memset(operations, 0, sizeof(operations));
 
     memoryStats = false;
 
@@ -61,11 +94,105 @@ void Stats::dumpFilesystemStatsToLog() {
     poco_information_f1(logger, "Late cache miss:  %z", lateCacheMiss);
     poco_information_f1(logger, "Whitelist hit:    %z", whitelistHit);
     poco_information_f1(logger, "Blacklist hit:    %z", blacklistHit);
+    poco_information_f1(logger, "Path rule skip:   %z", policySkipHit);
+    poco_information_f1(logger, "Path rule force:  %z", policyForceHit);
+    if (sniffCalled) {
+        poco_information_f4(logger, "Content sniffed %z times (inert: %z, dangerous: %z), %z us per file",
+            sniffCalled, sniffInert, sniffDangerous, sniffTime / sniffCalled);
+        poco_information_f1(logger, "Scan shortened by content sniffing: %z%%", sniffInert * 100 / sniffCalled);
+    }
     poco_information_f1(logger, "Files bigger than maximal-size: %z", tooBigFile);
+    poco_information_f3(logger, "Partial scans: %z (%z bytes scanned, %z cache hits)",
+        partialScan, partialScanBytes, partialCacheHit);
+    poco_information_f2(logger, "Background scans: %z (revoked: %z)", asyncScan, asyncRevoked);
+    if (aheadListed) {
+        poco_information_f4(logger, "Scan-ahead: %z files listed, %z scanned ahead, %z cancelled, %z opened after scan",
+            aheadListed, aheadScanned, aheadCancelled, aheadHit);
+        if (aheadScanned)
+            poco_information_f1(logger, "Scan-ahead hit ratio: %z%%", aheadHit * 100 / aheadScanned);
+    }
+    if (historyOpens) {
+        poco_information_f4(logger, "Access history: %z opens, %z files predicted, %z predicted files opened, %z scanned in advance",
+            historyOpens, historyPredicted, historyUsed, historyScanned);
+        /* accuracy is share of right predictions, coverage share of predicted opens */
+        poco_information_f2(logger, "Access history accuracy: %z%%, coverage: %z%%",
+            historyPredicted ? historyUsed * 100 / historyPredicted : (size_t)0,
+            historyUsed * 100 / historyOpens);
+    }
+    if (passthroughOpen)
+        poco_information_f1(logger, "Handles opened with passthrough: %z", passthroughOpen);
     poco_information_f3(logger, "open() function called %z times (allowed: %z, denied: %z)",
             openCalled, openAllowed, openDenied);
     poco_information_f1(logger, "Scan failed %z times", scanFailed);
+    if (breakerSkipped)
+        poco_information_f1(logger, "Scan skipped while clamd was unavailable: %z", breakerSkipped);
+    if (breakerWaited)
+        poco_information_f1(logger, "Scan waited for unavailable clamd: %z", breakerWaited);
     poco_information(logger, "--- end of filesystem statistics ---");
+    dumpOperationStatsToLog();
+}
+
+/*!\brief Returns upper bound of latency percentile (in microseconds)
+   \param counters operation counters
+   \param percent percentile
+   \returns upper bound of histogram bucket percentile falls into
+*/
+static size_t latencyPercentile(const operation_stats& counters, size_t percent) {
+    size_t wanted = (counters.calls * percent + 99) / 100;
+    size_t seen = 0;
+    for (size_t i = 0; i < OPERATION_LATENCY_BUCKETS - 1; ++i) {
+        seen += counters.latency[i];
+        if (seen >= wanted)
+            return (size_t)1 << i;
+    }
+    return counters.longest;
+}
+
+void Stats::dumpOperationStatsToLog() {
+    Logger& logger = Logger::root();
+    char buf[128];
+
+    poco_information(logger, "--- begin of operation statistics ---");
+    for (int op = 0; op < op_count; ++op) {
+        const operation_stats& counters = operations[op];
+        if (counters.calls == 0)
+            continue;
+
+        string name = operationName((fuse_operation)op);
+        poco_information_f4(logger, "%s() called %z times (errors: %z, bytes: %z)",
+            name, counters.calls, counters.errors, counters.bytes);
+        snprintf(buf, sizeof(buf), "avg %zu us, p50 < %zu us, p90 < %zu us, p99 < %zu us, max %zu us",
+            counters.time / counters.calls, latencyPercentile(counters, 50),
+            latencyPercentile(counters, 90), latencyPercentile(counters, 99),
+            counters.longest);
+        poco_information_f2(logger, "%s() latency: %s", name, string(buf));
+
+        /* histogram and errors list non-empty buckets only */
+        string histogram;
+        for (size_t i = 0; i < OPERATION_LATENCY_BUCKETS; ++i) {
+            if (counters.latency[i] == 0)
+                continue;
+            if (i < OPERATION_LATENCY_BUCKETS - 1)
+                snprintf(buf, sizeof(buf), " <%zu:%zu", (size_t)1 << i, counters.latency[i]);
+            else
+                snprintf(buf, sizeof(buf), " >=%zu:%zu", (size_t)1 << (i - 1), counters.latency[i]);
+            histogram += buf;
+        }
+        poco_information_f2(logger, "%s() latency histogram (us:calls):%s", name, histogram);
+
+        if (counters.errors == 0)
+            continue;
+        string errors;
+        for (int err = 0; err < OPERATION_ERRNOS; ++err) {
+            if (counters.errnos[err] == 0)
+                continue;
+            snprintf(buf, sizeof(buf), "%s%s: %zu", errors.empty() ? "" : ", ",
+                err ? strerror(err) : "other", counters.errnos[err]);
+            errors += buf;
+        }
+        poco_information_f2(logger, "%s() errors: %s", name, errors);
+    }
+    poco_information(logger, "--- end of operation statistics ---");
 }
 
 void Stats::dumpMemoryStatsToLog() {
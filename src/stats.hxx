@@ -38,6 +38,7 @@
 #endif
 
 #include "logger.hxx"
+#include "opstats.hxx"
 
 namespace clamfs {
 
@@ -67,6 +68,9 @@ class Stats {
         /*!\brief Dump memory statistics to log */
         void dumpMemoryStatsToLog();
 
+        /*!\brief Dump FUSE operation statistics to log */
+        void dumpOperationStatsToLog();
+
          /*!\brief Periodically dump statistics to log */
         void periodicDumpToLog();
 
@@ -97,9 +101,55 @@ class Stats {
         /*!\brief blacklist hit counter */
         size_t blacklistHit;
 
+        /*!\brief path policy skip rule hit counter */
+        size_t policySkipHit;
+        /*!\brief path policy force rule hit counter */
+        size_t policyForceHit;
+
+        /*!\brief content sniffing call counter */
+        size_t sniffCalled;
+        /*!\brief content sniffed as inert (head and tail scanned) counter */
+        size_t sniffInert;
+        /*!\brief content sniffed as dangerous (scan forced) counter */
+        size_t sniffDangerous;
+        /*!\brief total time spent on content sniffing (in microseconds) */
+        size_t sniffTime;
+
         /*!\brief files bigger than maximal-size hit counter */
         size_t tooBigFile;
 
+        /*!\brief partial scans of files bigger than maximal-size counter */
+        size_t partialScan;
+        /*!\brief bytes sent to clamd by partial scans */
+        size_t partialScanBytes;
+        /*!\brief partial scan verdict found in cache counter */
+        size_t partialCacheHit;
+
+        /*!\brief files opened before background scan counter */
+        size_t asyncScan;
+        /*!\brief handles revoked by background scan counter */
+        size_t asyncRevoked;
+
+        /*!\brief listed files remembered for scan-ahead counter */
+        size_t aheadListed;
+        /*!\brief files scanned ahead counter */
+        size_t aheadScanned;
+        /*!\brief files scanned ahead and then opened counter */
+        size_t aheadHit;
+        /*!\brief listed files never scanned ahead (not needed or no room) counter */
+        size_t aheadCancelled;
+        /*!\brief opens seen by access history counter */
+        size_t historyOpens;
+        /*!\brief files predicted by access history counter */
+        size_t historyPredicted;
+        /*!\brief predicted files opened counter */
+        size_t historyUsed;
+        /*!\brief predicted files scanned in advance counter */
+        size_t historyScanned;
+
+        /*!\brief handles opened with FUSE passthrough counter */
+        size_t passthroughOpen;
+
         /*!\brief open() function call counter */
         size_t openCalled;
         /*!\brief open() call allowed by AV counter */
@@ -109,6 +159,13 @@ class Stats {
 
         /*!\brief a/v scan failed (clamd unavailable, permission problem, etc.) */
         size_t scanFailed;
+        /*!\brief scan not attempted because clamd circuit breaker was open */
+        size_t breakerSkipped;
+        /*!\brief scan waited for clamd because circuit breaker was open */
+        size_t breakerWaited;
+
+        /*!\brief counters of FUSE operations */
+        operation_stats operations[op_count];
 
         /*!\brief indicates that memory statistics should be included */
         bool memoryStats;
@@ -131,6 +188,17 @@ extern Stats* stats;
     }\
 } while(0)
 
+/*!\def ADD_STAT_COUNTER
+   \brief Add value to statistic module counter
+   \param counter name of counter to update
+   \param value value to add to counter
+*/
+#define ADD_STAT_COUNTER(counter, value) do {\
+    if (stats) {\
+        stats->counter += (value);\
+    }\
+} while(0)
+
 
 } /* namespace clamfs */
 
@@ -30,7 +30,6 @@
 #include <cstring>
 #include <stdlib.h>
 #include <fuse.h>
-#include <pwd.h>
 
 #ifdef DMALLOC
    #ifdef HAVE_MALLOC_H
@@ -39,6 +38,8 @@
    #include <dmalloc.h>
 #endif
 
+#include "idcache.hxx"
+
 namespace clamfs {
 
 /*!\struct ltstr
@@ -55,44 +56,21 @@ struct ltstr {
 };
 
 /*!\brief Returns the name of the process which accessed the file system
+   \param buf buffer to store process name in (CALLERNAME_MAX is enough)
+   \param size size of buffer
    \returns pointer to buffer contains process name
-*//*
-
-    This function was written by Remi Flament <rflament at laposte dot net>
-    Copyright (c) 2005 - 2007, Remi Flament
-    License: GNU GPL
-
 */
-static inline char* getcallername() {
-    char* filename = NULL;
-    char* res = NULL;
-    if (asprintf(&filename, "/proc/%d/cmdline", fuse_get_context()->pid) > 0) {
-        FILE* proc=fopen(filename, "rt");
-        if (proc != NULL) {
-            free(filename);
-            char cmdline[256];
-            memset(cmdline, 0, sizeof(cmdline));
-            size_t read = fread(cmdline, sizeof(cmdline) - 1, 1, proc);
-            if (1 == read) {
-                res = strdup(cmdline);
-            } else {
-                if (feof(proc))
-                    res = strdup(cmdline);
-            }
-            fclose(proc);
-       }
-    }
-    if (res == NULL)
-        res = strdup("< unknown >");
-    return res;
+static inline const char* getcallername(char* buf, size_t size) {
+    return processNameCache.lookup(fuse_get_context()->pid, buf, size);
 }
 
 /*!\brief Returns the name of the user accessed the filesystem
-   \returns pointer to buffer contains user name */
-static inline char* getusername() {
-    struct passwd* s_pwd;
-    s_pwd = getpwuid(fuse_get_context()->uid);
-    return strdup(s_pwd->pw_name);
+   \param buf buffer to store user name in (USERNAME_MAX is enough)
+   \param size size of buffer
+   \returns pointer to buffer contains user name
+*/
+static inline const char* getusername(char* buf, size_t size) {
+    return userNameCache.lookup(fuse_get_context()->uid, buf, size);
 }
 
 } /* namespace clamfs */
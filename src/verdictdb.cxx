@@ -0,0 +1,179 @@
+/*!\file verdictdb.cxx
+
+   \brief Verdict database made by offline pre-scan
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "verdictdb.hxx"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#include "logger.hxx"
+
+/*!\def VERDICTDB_BATCH
+   \brief Number of records read at once by import
+*/
+#define VERDICTDB_BATCH 4096
+
+namespace clamfs {
+
+VerdictWriter::VerdictWriter():
+    file(NULL), records(0) {
+}
+
+VerdictWriter::~VerdictWriter() {
+    discard();
+}
+
+bool VerdictWriter::open(const char* name, unsigned long signatures) {
+    Logger& logger = Logger::root();
+    verdict_header header;
+
+    discard();
+    filename = name;
+    temporary = filename + ".tmp";
+    records = 0;
+
+    file = fopen(temporary.c_str(), "wb");
+    if (file == NULL) {
+        poco_warning_f2(logger, "cannot create verdict database %s: %s",
+            temporary, string(strerror(errno)));
+        return false;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, VERDICTDB_MAGIC, sizeof(header.magic));
+    header.recordSize = sizeof(verdict_record);
+    header.signatures = signatures;
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        poco_warning_f2(logger, "cannot write verdict database %s: %s",
+            temporary, string(strerror(errno)));
+        discard();
+        return false;
+    }
+    return true;
+}
+
+bool VerdictWriter::add(const struct stat& st, bool clean) {
+    verdict_record record;
+
+    if (file == NULL)
+        return false;
+
+    memset(&record, 0, sizeof(record));
+    record.dev = st.st_dev;
+    record.ino = st.st_ino;
+    record.mtime = st.st_mtime;
+    record.size = st.st_size;
+    record.flags = clean ? VERDICT_CLEAN : 0;
+    if (fwrite(&record, sizeof(record), 1, file) != 1)
+        return false;
+    ++records;
+    return true;
+}
+
+bool VerdictWriter::close() {
+    Logger& logger = Logger::root();
+
+    if (file == NULL)
+        return false;
+
+    /* database has to be on disk before it replaces previous one */
+    bool written = (fflush(file) == 0) && (fsync(fileno(file)) == 0);
+    written = (fclose(file) == 0) && written;
+    file = NULL;
+    if (!written || (rename(temporary.c_str(), filename.c_str()) != 0)) {
+        poco_warning_f2(logger, "cannot write verdict database %s: %s",
+            filename, string(strerror(errno)));
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+void VerdictWriter::discard() {
+    if (file == NULL)
+        return;
+    fclose(file);
+    file = NULL;
+    unlink(temporary.c_str());
+}
+
+unsigned long VerdictWriter::count() const {
+    return records;
+}
+
+long ImportVerdicts(const char* filename, unsigned long signatures, ScanCache& cache) {
+    Logger& logger = Logger::root();
+    verdict_header header;
+
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        poco_warning_f2(logger, "cannot open verdict database %s: %s",
+            string(filename), string(strerror(errno)));
+        return -1;
+    }
+
+    if ((fread(&header, sizeof(header), 1, file) != 1) ||
+        (memcmp(header.magic, VERDICTDB_MAGIC, sizeof(header.magic)) != 0) ||
+        (header.recordSize != sizeof(verdict_record))) {
+        poco_warning_f1(logger, "%s is not a verdict database (or was made on other platform)",
+            string(filename));
+        fclose(file);
+        return -1;
+    }
+
+    /* verdicts of older (or newer) signatures are not valid anymore */
+    if (header.signatures != signatures) {
+        poco_warning_f3(logger, "verdict database %s was made with signatures version %lu, "
+            "but version %lu is used now, not imported",
+            string(filename), (unsigned long)header.signatures, signatures);
+        fclose(file);
+        return 0;
+    }
+
+    long imported = 0;
+    vector<verdict_record> batch(VERDICTDB_BATCH);
+    size_t count;
+    while ((count = fread(&batch[0], sizeof(verdict_record), batch.size(), file)) > 0) {
+        for (size_t i = 0; i < count; ++i) {
+            const verdict_record& record = batch[i];
+            CachedResult result((record.flags & VERDICT_CLEAN) != 0, (time_t)record.mtime,
+                                false, (off_t)record.size);
+            cache.add(make_pair((dev_t)record.dev, (ino_t)record.ino), result);
+            ++imported;
+        }
+    }
+    if (ferror(file)) {
+        poco_warning_f2(logger, "error reading verdict database %s: %s",
+            string(filename), string(strerror(errno)));
+    }
+    fclose(file);
+
+    return imported;
+}
+
+} /* namespace clamfs */
+
+/* EoF */
@@ -0,0 +1,157 @@
+/*!\file verdictdb.hxx
+
+   \brief Verdict database made by offline pre-scan (header file)
+
+*//*
+
+   ClamFS - An user-space anti-virus protected file system
+   Copyright (C) 2026 Krzysztof Burghardt
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef CLAMFS_VERDICTDB_HXX
+#define CLAMFS_VERDICTDB_HXX
+
+#include "config.h"
+
+#include <cstdio>
+#include <string>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#ifdef DMALLOC
+   #include <stdlib.h>
+   #ifdef HAVE_MALLOC_H
+      #include <malloc.h>
+   #endif
+   #include <dmalloc.h>
+#endif
+
+#include "scancache.hxx"
+
+/*!\def VERDICTDB_MAGIC
+   \brief Magic string starting verdict database file
+*/
+#define VERDICTDB_MAGIC "CLAMFSV1"
+
+/*!\def VERDICT_CLEAN
+   \brief Verdict record flag set if file was clean
+*/
+#define VERDICT_CLEAN 1
+
+namespace clamfs {
+
+using namespace std;
+
+/*!\struct verdict_header
+   \brief Verdict database header
+
+   Database is written and read on the same host, so fields are kept
+   in host byte order. Size of record guards against layout mismatch.
+*/
+struct verdict_header {
+    /*!\brief VERDICTDB_MAGIC (without terminating null) */
+    char magic[8];
+    /*!\brief size of verdict_record */
+    uint32_t recordSize;
+    /*!\brief reserved (zero) */
+    uint32_t reserved;
+    /*!\brief signature database version files were scanned with */
+    uint64_t signatures;
+};
+
+/*!\struct verdict_record
+   \brief Verdict of one file (fixed size, follows header)
+*/
+struct verdict_record {
+    /*!\brief device of file */
+    uint64_t dev;
+    /*!\brief inode of file */
+    uint64_t ino;
+    /*!\brief modification time of file when it was scanned */
+    int64_t mtime;
+    /*!\brief size of file when it was scanned */
+    int64_t size;
+    /*!\brief verdict flags (VERDICT_CLEAN) */
+    uint32_t flags;
+    /*!\brief reserved (zero) */
+    uint32_t reserved;
+};
+
+/*!\class VerdictWriter
+   \brief Writes verdict database
+
+   Records are written to temporary file renamed over database only
+   when it is closed, so readers never see partially written database.
+*/
+class VerdictWriter {
+    public:
+        /*!\brief Constructor for VerdictWriter */
+        VerdictWriter();
+        /*!\brief Destructor for VerdictWriter (discards database not closed) */
+        ~VerdictWriter();
+
+        /*!\brief Starts writing database
+           \param filename database file name
+           \param signatures signature database version files are scanned with
+           \returns true on success
+        */
+        bool open(const char* filename, unsigned long signatures);
+        /*!\brief Appends verdict
+           \param st file stat taken before scan
+           \param clean true if file was clean
+           \returns true on success
+        */
+        bool add(const struct stat& st, bool clean);
+        /*!\brief Finishes database and replaces previous one
+           \returns true on success
+        */
+        bool close();
+        /*!\brief Discards database being written */
+        void discard();
+        /*!\brief Returns number of verdicts added */
+        unsigned long count() const;
+
+    private:
+        /*!\brief Forbid usage of copy constructor */
+        VerdictWriter(const VerdictWriter& aWriter);
+        /*!\brief Forbid usage of assignment operator */
+        VerdictWriter& operator = (const VerdictWriter& aWriter);
+
+        /*!\brief database file name */
+        string filename;
+        /*!\brief temporary file name */
+        string temporary;
+        /*!\brief temporary file or NULL */
+        FILE* file;
+        /*!\brief number of verdicts added */
+        unsigned long records;
+};
+
+/*!\brief Imports verdict database into ScanCache
+   \param filename database file name
+   \param signatures signature database version currently used
+   \param cache cache to fill
+   \returns number of imported verdicts or -1 on error (database made
+            with other signatures is not imported and 0 is returned)
+*/
+long ImportVerdicts(const char* filename, unsigned long signatures, ScanCache& cache);
+
+} /* namespace clamfs */
+
+#endif /* CLAMFS_VERDICTDB_HXX */
+
+/* EoF */
@@ -0,0 +1,14 @@
+#!/usr/bin/env bats
+
+@test "Several file systems are served with low-level API" {
+    run ../src/clamfs filesystems-valid.xml
+    [[ "$status" -eq 255 ]]
+    [[ "$output" =~ "serving 2 file systems needs low-level FUSE API, enabling it" ]]
+    [[ "$output" =~ "cannot start without running clamd" ]]
+}
+
+@test "Each of several file systems needs root and mountpoint" {
+    run ../src/clamfs filesystems-incomplete.xml
+    [[ "$status" -eq 1 ]]
+    [[ "$output" =~ "each filesystem must define root and mountpoint when several are served" ]]
+}
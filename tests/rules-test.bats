@@ -0,0 +1,23 @@
+#!/usr/bin/env bats
+
+@test "Valid path rules are accepted" {
+    run ../src/clamfs rules-valid.xml
+    [[ "$status" -eq 255 ]]
+    [[ ! "$output" =~ "rejected" ]]
+    [[ "$output" =~ "cannot start without running clamd" ]]
+}
+
+@test "Path rule with unknown action rejects configuration" {
+    run ../src/clamfs rules-bad-action.xml
+    [[ "$status" -eq 1 ]]
+    [[ "$output" =~ "unknown path rule action ignore in <rule prefix=\"/cache/\" action=\"ignore\" />" ]]
+    [[ "$output" =~ "Configuration file rules-bad-action.xml rejected" ]]
+    [[ ! "$output" =~ "cannot start without running clamd" ]]
+}
+
+@test "Path rule with both prefix and glob rejects configuration" {
+    run ../src/clamfs rules-bad-pattern.xml
+    [[ "$status" -eq 1 ]]
+    [[ "$output" =~ "path rule needs exactly one of prefix or glob" ]]
+    [[ "$output" =~ "Configuration file rules-bad-pattern.xml rejected" ]]
+}